@@ -90,6 +90,12 @@ typedef int64 off64_t;
 #include	"stats.h"
 #include	"timing.h"
 #include	"lib_debug.h"
+#include	"lib_perf.h"
+#include	"lib_noise.h"
+#include	"lib_record.h"
+#include	"lib_cache.h"
+#include	"lib_trace.h"
+#include	"lib_topology.h"
 #include	"lib_tcp.h"
 #include	"lib_udp.h"
 #include	"lib_unix.h"
@@ -178,9 +184,19 @@ int	gettimeofday(struct timeval *tv, struct timezone *tz);
 
 #define	TRIES		11
 
+/*
+ * State which must be private to each benchmp worker when the
+ * workers are threads (LMBENCH_THREADS) rather than processes.
+ */
+#ifdef HAVE_PTHREAD
+#define	LMBENCH_TLS	__thread
+#else
+#define	LMBENCH_TLS
+#endif
+
 typedef struct {
-	uint64 u;
-	uint64 n;
+	uint64 u;	/* nanoseconds */
+	uint64 n;	/* iterations */
 } value_t;
 
 typedef struct {
@@ -195,6 +211,33 @@ void	save_minimum();
 void	set_results(result_t *r);
 result_t* get_results();
 
+/*
+ * Per-operation latency histogram, recorded by benchmp when
+ * LMBENCH_HISTOGRAM is set.  Buckets are log-linear, as in HDR
+ * histograms: values below HIST_SUB nanoseconds are exact, and
+ * above that each power of two is split into HIST_SUB buckets,
+ * so any value is within 1/HIST_SUB (about 1.6%) of its bucket.
+ * Values beyond 2^HIST_MAX_BITS nanoseconds land in the last bucket.
+ */
+#define	HIST_SUB_BITS	6
+#define	HIST_SUB	(1 << HIST_SUB_BITS)
+#define	HIST_MAX_BITS	40
+#define	HIST_BUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 2) * HIST_SUB)
+
+typedef struct {
+	uint64	count;
+	uint64	min;			/* nanoseconds */
+	uint64	max;			/* nanoseconds */
+	uint64	bucket[HIST_BUCKETS];
+} histogram_t;
+
+void	hist_init(histogram_t *h);
+void	hist_insert(uint64 ns, histogram_t *h);
+void	hist_merge(histogram_t *dst, histogram_t *src);
+uint64	hist_percentile(histogram_t *h, double p);
+void	set_histogram(histogram_t *h);
+histogram_t* get_histogram();
+
 
 #define	BENCHO(loop_body, overhead_body, enough) { 			\
 	int 		__i, __N;					\
@@ -206,10 +249,10 @@ result_t* get_results();
 	for (__i = 0; __i < __N; ++__i) {				\
 		BENCH1(overhead_body, enough);				\
 		if (gettime() > 0)					\
-			insertsort(gettime(), get_n(), &__overhead);	\
+			insertsort(gettime_ns(), get_n(), &__overhead);	\
 		BENCH1(loop_body, enough);				\
 		if (gettime() > 0)					\
-			insertsort(gettime(), get_n(), &__r);		\
+			insertsort(gettime_ns(), get_n(), &__r);		\
 	}								\
 	for (__i = 0; __i < __r.N; ++__i) {				\
 		__oh = __overhead.v[__i].u / (double)__overhead.v[__i].n; \
@@ -230,25 +273,28 @@ result_t* get_results();
 	for (__i = 0; __i < __N; ++__i) {				\
 		BENCH1(loop_body, enough);				\
 		if (gettime() > 0)					\
-			insertsort(gettime(), get_n(), &__r);		\
+			insertsort(gettime_ns(), get_n(), &__r);		\
 	}								\
 	*(get_results()) = __r;						\
 }
 
 #define	BENCH1(loop_body, enough) { 					\
-	double		__usecs;					\
+	double		__nsecs;					\
 	BENCH_INNER(loop_body, enough);  				\
-	__usecs = gettime();						\
-	__usecs -= t_overhead() + get_n() * l_overhead();		\
-	settime(__usecs >= 0. ? (uint64)__usecs : 0);			\
+	__nsecs = gettime_ns();						\
+	__nsecs -= t_overhead() + 1000. * get_n() * l_overhead();	\
+	settime_ns(__nsecs >= 0. ? (uint64)__nsecs : 0);		\
 }
 	
 #define	BENCH_INNER(loop_body, enough) { 				\
-	static iter_t	__iterations = 1;				\
+	static iter_t	__iterations = 0;				\
 	int		__enough = get_enough(enough);			\
 	iter_t		__n;						\
 	double		__result = 0.;					\
 									\
+	if (!__iterations)						\
+		__iterations = get_iterations(__FILE__, __LINE__, 	\
+					      __enough, 1);		\
 	while(__result < 0.95 * __enough) {				\
 		start(0);						\
 		for (__n = __iterations; __n > 0; __n--) {		\
@@ -270,7 +316,10 @@ result_t* get_results();
 			}						\
 		}							\
 	} /* while */							\
-	save_n((uint64)__iterations); settime((uint64)__result);	\
+	if (__result > 0.)						\
+		save_iterations(__FILE__, __LINE__, __enough, __iterations); \
+	save_n((uint64)__iterations);					\
+	settime_ns(__result > 0. ? gettime_ns() : 0);			\
 }
 
 /* getopt stuff */
@@ -300,6 +349,13 @@ extern void benchmp(benchmp_f initialize,
 		    void* cookie
 	);
 
+/*
+ * Parse the argument to -P: a number of workers, or a sweep over
+ * several ("1..8", "pow2", "pow2..16"), in which case benchmp runs
+ * each level in turn.  Returns the last level, or 0 if s is invalid.
+ */
+extern int benchmp_parallel(char* s);
+
 /* 
  * These are used by weird benchmarks which cannot return, such as page
  * protection fault handling.  See lat_sig.c for sample usage.
@@ -307,6 +363,14 @@ extern void benchmp(benchmp_f initialize,
 extern void* benchmp_getstate();
 extern iter_t benchmp_interval(void* _state);
 
+/*
+ * Benchmarks which can run their workers as threads in a single
+ * process (LMBENCH_THREADS=1) must tell benchmp how large their
+ * cookie is, so that each thread gets its own private copy just
+ * as each forked child does.  Otherwise benchmp always forks.
+ */
+extern void benchmp_thread_cookie(size_t size);
+
 /*
  * Which child process is this?
  * Returns a number in the range [0, ..., N-1], where N is the
@@ -314,6 +378,13 @@ extern iter_t benchmp_interval(void* _state);
  */
 extern int benchmp_childid();
 
+/*
+ * Starting and converged iteration counts of a timing loop, kept in
+ * the LMBENCH_CACHE calibration cache.
+ */
+extern iter_t get_iterations(char* file, int line, int enough, iter_t n);
+extern void save_iterations(char* file, int line, int enough, iter_t n);
+
 /*
  * harvest dead children to prevent zombies
  */
@@ -324,8 +395,18 @@ extern void sigchld_wait_handler(int signo);
  */
 extern int handle_scheduler(int childno, int benchproc, int nbenchprocs);
 extern int sched_pin(int cpu);
+extern int sched_ncpus();
+extern int sched_cpu();
+extern char* sched_realtime(int parallel);
+extern char* sched_realtime_end();
+extern int sched_lock_memory();
+extern int sched_nodes(int* nodes, int max, int memory);
+extern int sched_node_cpu(int node);
+extern int sched_node_cpus(int node, int* cpus, int max);
+extern int sched_mbind(void* addr, size_t len, int node);
 
 #include	"lib_mem.h"
+#include	"lib_bw.h"
 
 /*
  * Generated from msg.x which is included here:
@@ -58,7 +58,7 @@ main(int ac, char **av)
 	while (( c = getopt(ac, av, "P:W:N:C")) != EOF) {
 		switch(c) {
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
 			break;
 		case 'W':
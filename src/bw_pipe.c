@@ -147,7 +147,7 @@ main(int ac, char *av[])
 			state.bytes = bytes(optarg);
 			break;
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
 			break;
 		case 'W':
@@ -150,7 +150,7 @@ main(int argc, char *argv[])
 			state.bytes = bytes(optarg);
 			break;
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0) lmbench_usage(argc, argv, usage);
 			break;
 		case 'W':
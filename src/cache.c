@@ -87,16 +87,20 @@ int
 main(int ac, char **av)
 {
 	int	c;
-	int	i, j, n, start, level, prev, min;
+	int	i, j, n, start, level, prev, min, nknown;
+	int	set_maxlen = 0;
 	int	warmup = 0;
 	int	repetitions = (1000000 <= get_enough(0) ? 1 : TRIES);
 	ssize_t	line = 0;
 	size_t	maxlen = 32 * 1024 * 1024;
 	int	*levels;
+	char	buf[64];
 	double	par, maxpar, prev_lat;
 	char   *usage = "[-c] [-L <line size>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]\n";
 	struct cache_results* r;
 	struct mem_state state;
+	topology_cache_t known[TOPOLOGY_MAXCACHES];
+	topology_cache_t* k;
 
 	while (( c = getopt(ac, av, "L:M:W:N:")) != EOF) {
 		switch(c) {
@@ -107,6 +111,7 @@ main(int ac, char **av)
 			break;
 		case 'M':
 			maxlen = bytes(optarg);
+			set_maxlen = 1;
 			break;
 		case 'W':
 			warmup = atoi(optarg);
@@ -122,6 +127,19 @@ main(int ac, char **av)
 
 	sched_pin(0);
 
+	/*
+	 * Use the cache geometry the system reports, if any, as a
+	 * starting point: the line sizes need not be measured, and
+	 * there is no need to search much beyond the largest cache.
+	 */
+	nknown = topology_caches(known, TOPOLOGY_MAXCACHES);
+	if (line == 0 && topology_line() > 0)
+		line = topology_line();
+	if (!set_maxlen && nknown > 0 && 4 * known[nknown-1].size < maxlen) {
+		maxlen = 4 * known[nknown-1].size;
+		if (maxlen < 1024 * 1024) maxlen = 1024 * 1024;
+	}
+
 	state.width = 1;
 	state.len = maxlen;
 	state.maxlen = maxlen;
@@ -181,7 +199,10 @@ main(int ac, char **av)
 		}
 
 		/* Compute line size */
-		if (i == level - 1) {
+		k = topology_cache(i + 1);
+		if (k && k->line > 0) {
+			line = k->line;
+		} else if (i == level - 1) {
 			line = r[n-1].line;
 		} else {
 			j = (levels[i] + levels[i+1]) / 2;
@@ -200,6 +221,20 @@ main(int ac, char **av)
 		    "L%d cache: %lu bytes %.2f nanoseconds %ld linesize %.2f parallelism\n",
 		    (int)(i+1), (unsigned long)r[levels[i]].len, 
 		    r[min].latency, (long)line, maxpar);
+		sprintf(buf, "level=%d", (int)(i+1));
+		record("cache size", buf, (double)r[levels[i]].len, "bytes");
+		record("cache latency", buf, r[min].latency, "nanoseconds");
+		record("cache line size", buf, (double)line, "bytes");
+		record("cache parallelism", buf, maxpar, "loads");
+
+		/* cross-check against what the system reports */
+		if (k && (r[levels[i]].len > 1.5 * k->size
+			  || 1.5 * r[levels[i]].len < k->size)) {
+			fprintf(stderr, 
+			    "L%d cache: the system reports %lu bytes %d-way shared by %d processors\n",
+			    (int)(i+1), (unsigned long)k->size, 
+			    k->ways, k->shared);
+		}
 	}
 
 	/* Compute memory parallelism for main memory */
@@ -213,6 +248,8 @@ main(int ac, char **av)
 
 	fprintf(stderr, "Memory latency: %.2f nanoseconds %.2f parallelism\n",
 		r[n-1].latency, par);
+	record("memory latency", NULL, r[n-1].latency, "nanoseconds");
+	record("memory parallelism", NULL, par, "loads");
 
 	exit(0);
 }
@@ -449,13 +486,13 @@ measure(size_t size, int repetitions,
 
 	for (i = 0; i < repetitions; ++i) {
 		BENCH1(mem_benchmark(__n, state); __n = 1;, 0)
-		insertsort(gettime(), get_n(), r);
+		insertsort(gettime_ns(), get_n(), r);
 	}
 	set_results(r);
-	median = (1000. * (double)gettime()) / (100. * (double)get_n());
+	median = (double)gettime_ns() / (100. * (double)get_n());
 
 	save_minimum();
-	time = (1000. * (double)gettime()) / (100. * (double)get_n());
+	time = (double)gettime_ns() / (100. * (double)get_n());
 
 	/* Are the results stable, or do they vary? */
 	if (time != 0.)
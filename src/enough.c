@@ -7,7 +7,7 @@ int
 main()
 {
 	putenv("LOOP_O=0.0");
-	putenv("TIMING_O=0.0");
+	putenv("TIMING_O_NS=0.0");
 	printf("%u\n", get_enough(0));
 	return (0);
 }
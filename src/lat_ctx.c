@@ -51,6 +51,7 @@ main(int ac, char **av)
 	struct _state state;
 	char *usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>] [-s kbytes] processes [processes ...]\n";
 	double	time;
+	char	buf[64];
 
 	/*
 	 * Need 4 byte ints.
@@ -70,7 +71,7 @@ main(int ac, char **av)
 	while (( c = getopt(ac, av, "s:P:W:N:")) != EOF) {
 		switch(c) {
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
 			break;
 		case 'W':
@@ -118,8 +119,17 @@ main(int ac, char **av)
 		time /= state.procs;
 		time -= state.overhead;
 
-		if (time > 0.0)
+		if (time > 0.0) {
 			fprintf(stderr, "%d %.2f\n", state.procs, time);
+			sprintf(buf, "procs=%d size=%dk", 
+				state.procs, state.process_size/1024);
+			record("context switch", buf, time, "microseconds");
+		}
+
+		/* per-switch, but without the overhead subtracted */
+		sprintf(buf, "lat_ctx %d", state.procs);
+		print_histogram(buf, state.procs);
+		print_perf(buf, state.procs);
 	}
 
 	return (0);
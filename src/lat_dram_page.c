@@ -68,8 +68,11 @@ main(int ac, char **av)
 
 	if (dram_hit < 0.95 * dram_miss) {
 		fprintf(stderr, "%f\n", dram_miss - dram_hit);
+		record("dram page miss", NULL, dram_miss - dram_hit, 
+		       "nanoseconds");
 	} else {
 		fprintf(stderr, "0.0\n");
+		record("dram page miss", NULL, 0., "nanoseconds");
 	}
 
 	return (0);
@@ -51,7 +51,7 @@ main(int ac, char **av)
 			state.max = bytes(optarg);
 			break;
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
 			break;
 		case 'W':
@@ -87,12 +87,17 @@ main(int ac, char **av)
 void
 measure(size_t size, int parallel, int warmup, int repetitions, void* cookie)
 {
+	char	buf[64];
+
+	sprintf(buf, "size=%luk", size>>10);
 	fprintf(stderr, "%luk", size>>10);
 	benchmp(setup_names, benchmark_mk, cleanup_mk, 0, parallel,
 		warmup, repetitions, cookie);
 	if (gettime()) {
 		fprintf(stderr, "\t%lu\t%.0f", (unsigned long)get_n(), 
 			(double)(1000000. * get_n() / (double)gettime()));
+		record("file create", buf, 
+		       1000000. * get_n() / (double)gettime(), "files/sec");
 	} else {
 		fprintf(stderr, "\t-1\t-1");
 	}
@@ -102,6 +107,8 @@ measure(size_t size, int parallel, int warmup, int repetitions, void* cookie)
 	if (gettime()) {
 		fprintf(stderr, "\t%.0f", 
 			(double)(1000000. * get_n() / (double)gettime()));
+		record("file delete", buf, 
+		       1000000. * get_n() / (double)gettime(), "files/sec");
 	} else {
 		fprintf(stderr, "\t-1");
 	}
@@ -1,7 +1,15 @@
 /*
  * lat_mem_rd.c - measure memory load latency
  *
- * usage: lat_mem_rd [-P <parallelism>] [-W <warmup>] [-N <repetitions>] [-t] size-in-MB [stride ...]
+ * usage: lat_mem_rd [-P <parallelism>] [-W <warmup>] [-N <repetitions>] [-t] 
+ *	[-l <load workers> [-T rd|wr|rdwr] [-D delay,...]] size-in-MB [stride ...]
+ *
+ * -l measures the latency of size-in-MB on one processor while that many
+ * workers, each on a processor of its own, move data through buffers of
+ * the same size as bw_mem would.  Each delay (spins per 512 bytes) sets
+ * the workers' rate in turn, and the workers count the bytes they move
+ * while the chase is timed, so the result is a curve of latency against
+ * the injected bandwidth.
  *
  * Copyright (c) 1994 Larry McVoy.  
  * Copyright (c) 2003, 2004 Carl Staelin.
@@ -15,14 +23,43 @@
 char	*id = "$Id: s.lat_mem_rd.c 1.13 98/06/30 16:13:49-07:00 lm@lm.bitmover.com $\n";
 
 #include "bench.h"
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
 #define STRIDE  (512/sizeof(char *))
 #define	LOWER	512
 void	loads(size_t range, size_t stride, 
 	      int parallel, int warmup, int repetitions);
+double	chase(size_t range, size_t stride, 
+	      int parallel, int warmup, int repetitions);
+void	loaded(size_t len, size_t stride, int workers, char* traffic,
+	       char* delays, int warmup, int repetitions);
 size_t	step(size_t k);
 void	initialize(iter_t iterations, void* cookie);
 
+/*
+ * Loaded latency: the load workers share this with lat_mem_rd.  They
+ * read delay before each 64K of traffic, idle while it is negative,
+ * and add what they moved to their own count.  The chase adds what
+ * they moved while it was timed, and how long that was, to timed_bytes
+ * and timed_ns.
+ */
+typedef struct {
+	volatile int	delay;		/* spins per 512 bytes, or -1 */
+	volatile int	stop;
+	pid_t	parent;			/* the workers go with it */
+	int	workers;
+	volatile uint64	timed_bytes;
+	volatile uint64	timed_ns;
+	volatile uint64	bytes[1];	/* by each worker */
+} load_ctl_t;
+
+static uint64	load_bytes(load_ctl_t* ctl, int workers);
+
 benchmp_f	fpInit = stride_initialize;
+int		pin = -1;	/* processor of the chase, when loaded */
+load_ctl_t	*load_ctl = NULL;	/* the workers, when loaded */
 
 int
 main(int ac, char **av)
@@ -32,18 +69,34 @@ main(int ac, char **av)
 	int	parallel = 1;
 	int	warmup = 0;
 	int	repetitions = -1;
+	int	workers = 0;
         size_t	len;
 	size_t	range;
 	size_t	stride;
-	char   *usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>] [-t] len [stride...]\n";
+	char	*traffic = "rd";
+	char	*delays = "3200,1600,800,400,200,100,50,25,0";
+	char   *usage = "[-P <parallelism>] [-W <warmup>] [-N <repetitions>] [-t] [-l <load workers> [-T rd|wr|rdwr] [-D delay,...]] len [stride...]\n";
 
-	while (( c = getopt(ac, av, "tP:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "tP:W:N:l:T:D:")) != EOF) {
 		switch(c) {
 		case 't':
 			fpInit = thrash_initialize;
 			break;
+		case 'l':
+			workers = atoi(optarg);
+			if (workers <= 0) lmbench_usage(ac, av, usage);
+			break;
+		case 'T':
+			traffic = optarg;
+			if (strcmp(traffic, "rd") && strcmp(traffic, "wr")
+			    && strcmp(traffic, "rdwr"))
+				lmbench_usage(ac, av, usage);
+			break;
+		case 'D':
+			delays = optarg;
+			break;
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
 			break;
 		case 'W':
@@ -64,6 +117,17 @@ main(int ac, char **av)
         len = atoi(av[optind]);
 	len *= 1024 * 1024;
 
+	if (workers) {
+		/* the latency of one processor, under load */
+		if (parallel > 1 || len == 0) lmbench_usage(ac, av, usage);
+		for (i = optind + 1; i < ac || i == optind + 1; ++i) {
+			stride = i < ac ? bytes(av[i]) : STRIDE;
+			loaded(len, stride, workers, traffic, delays, 
+			       warmup, repetitions);
+		}
+		return(0);
+	}
+
 	if (optind == ac - 1) {
 		fprintf(stderr, "\"stride=%d\n", (int)STRIDE);
 		for (range = LOWER; 0 < range && range <= len; range = step(range)) {
@@ -98,12 +162,22 @@ benchmark_loads(iter_t iterations, void *cookie)
 	register char **p = (char**)state->p[0];
 	register size_t i;
 	register size_t count = state->len / (state->line * 100) + 1;
+	uint64	b0 = 0, t0 = 0;
 
+	if (load_ctl) {
+		b0 = load_bytes(load_ctl, load_ctl->workers);
+		t0 = now_ns();
+	}
 	while (iterations-- > 0) {
 		for (i = 0; i < count; ++i) {
 			HUNDRED;
 		}
 	}
+	if (load_ctl) {
+		load_ctl->timed_ns += now_ns() - t0;
+		load_ctl->timed_bytes += load_bytes(load_ctl, 
+						    load_ctl->workers) - b0;
+	}
 
 	use_pointer((void *)p);
 	state->p[0] = (char*)p;
@@ -115,11 +189,29 @@ loads(size_t range, size_t stride,
 	int parallel, int warmup, int repetitions)
 {
 	double result;
-	size_t count;
-	struct mem_state state;
+	char	buf[64];
 
 	if (range < stride) return;
 
+	result = chase(range, stride, parallel, warmup, repetitions);
+	if (0 < result) {
+		fprintf(stderr, "%.5f %.3f\n", range / (1024. * 1024.), result);
+		sprintf(buf, "size=%.5f stride=%lu", 
+			range / (1024. * 1024.), (unsigned long)stride);
+		record("load latency", buf, result, "nanoseconds");
+	}
+	sprintf(buf, "lat_mem_rd %.5f", range / (1024. * 1024.));
+	print_perf(buf, (double)(100 * (range / (stride * 100) + 1)));
+}
+
+/* the nanoseconds per load of a chain of range bytes, or 0 */
+double
+chase(size_t range, size_t stride, 
+	int parallel, int warmup, int repetitions)
+{
+	size_t count;
+	struct mem_state state;
+
 	state.width = 1;
 	state.len = range;
 	state.maxlen = range;
@@ -140,16 +232,175 @@ loads(size_t range, size_t stride,
 	/*
 	 * Now walk them and time it.
 	 */
-	benchmp(fpInit, benchmark_loads, mem_cleanup, 
+	benchmp_thread_cookie(sizeof(state));
+	benchmp(initialize, benchmark_loads, mem_cleanup, 
 		100000, parallel, warmup, repetitions, &state);
 #endif
 
 	/* We want to get to nanoseconds / load. */
 	save_minimum();
-	if (0 < gettime()) {
-		result = (1000. * (double)gettime()) / (double)(count * get_n());
-		fprintf(stderr, "%.5f %.3f\n", range / (1024. * 1024.), result);
+	if (0 < gettime())
+		return (double)gettime_ns() / (double)(count * get_n());
+	return 0.;
+}
+
+void
+initialize(iter_t iterations, void* cookie)
+{
+	if (!iterations && pin >= 0)
+		sched_pin(pin);
+	(*fpInit)(iterations, cookie);
+}
+
+#define	LOAD_STEP	(512 / sizeof(int))
+#define	LOAD_BATCH	128		/* steps between counts */
+
+void
+load_worker(load_ctl_t* ctl, int id, size_t len, char* traffic)
+{
+	register int	*p, *end, i, sum = 0;
+	register int	k, delay;
+	volatile int	spin;
+	int	*buf;
+
+	/* lat_mem_rd may be killed, and must not leave us spinning */
+#if defined(__linux__) && defined(PR_SET_PDEATHSIG)
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+	if (getppid() != ctl->parent)
+		exit(0);
+	if (sched_pin(id + 1) < 0)
+		exit(1);
+	buf = (int*)mem_pages_alloc(len);
+	if (!buf) {
+		perror("lat_mem_rd: load worker");
+		exit(1);
 	}
+	bzero(buf, len);
+	end = buf + (len / 512) * LOAD_STEP;
+
+	while (!ctl->stop && getppid() == ctl->parent) {
+		if ((delay = ctl->delay) < 0) {
+			usleep(1000);
+			continue;
+		}
+		for (p = buf; p < end && !ctl->stop && delay == ctl->delay
+			     && getppid() == ctl->parent; ) {
+			for (k = 0; k < LOAD_BATCH && p < end; ++k) {
+				if (traffic[0] == 'w') {
+					for (i = 0; i < LOAD_STEP; ++i)
+						p[i] = 1;
+				} else if (traffic[2] == 'w') {
+					for (i = 0; i < LOAD_STEP; ++i) {
+						sum += p[i];
+						p[i] = 1;
+					}
+				} else {
+					for (i = 0; i < LOAD_STEP; ++i)
+						sum += p[i];
+				}
+				p += LOAD_STEP;
+				for (spin = delay; spin > 0; --spin)
+					;
+			}
+			ctl->bytes[id] += k * 512;
+		}
+	}
+	use_int(sum);
+	exit(0);
+}
+
+/* what the workers have moved so far */
+static uint64
+load_bytes(load_ctl_t* ctl, int workers)
+{
+	int	i;
+	uint64	n = 0;
+
+	for (i = 0; i < workers; ++i)
+		n += ctl->bytes[i];
+	return n;
+}
+
+void
+loaded(size_t len, size_t stride, int workers, char* traffic,
+       char* delays, int warmup, int repetitions)
+{
+	int	i, delay;
+	double	result, mbs;
+	char	buf[128], *s;
+	pid_t	*pids;
+	load_ctl_t *ctl;
+
+	if (workers + 1 > sched_ncpus())
+		fprintf(stderr, "lat_mem_rd: %d load workers and the latency share %d processors\n", workers, sched_ncpus());
+
+	ctl = (load_ctl_t*)mmap(NULL, 
+				sizeof(load_ctl_t) + workers * sizeof(uint64),
+				PROT_READ | PROT_WRITE, 
+				MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	pids = (pid_t*)calloc(workers, sizeof(pid_t));
+	if (ctl == (load_ctl_t*)MAP_FAILED || !pids) {
+		perror("lat_mem_rd: loaded");
+		exit(1);
+	}
+	ctl->delay = -1;
+	ctl->stop = 0;
+	ctl->parent = getpid();
+	ctl->workers = workers;
+	for (i = 0; i < workers; ++i) {
+		ctl->bytes[i] = 0;
+		switch (pids[i] = fork()) {
+		case -1:
+			perror("fork");
+			ctl->stop = 1;
+			exit(1);
+		case 0:
+			load_worker(ctl, i, len, traffic);
+			exit(0);
+		default:
+			break;
+		}
+	}
+
+	/* idle first, then each delay: bandwidth and latency */
+	pin = 0;
+	load_ctl = ctl;
+	fprintf(stderr, "\"loaded stride=%d workers=%d traffic=%s\n", 
+		(int)stride, workers, traffic);
+	for (s = NULL, delay = -1; ; ) {
+		ctl->delay = delay;
+		usleep(20000);	/* the workers settle at the new rate */
+
+		ctl->timed_bytes = ctl->timed_ns = 0;
+		result = chase(len, stride, 1, warmup, repetitions);
+		mbs = ctl->timed_ns 
+			? ctl->timed_bytes * 1000. / ctl->timed_ns : 0.;
+
+		if (0 < result) {
+			fprintf(stderr, "%.2f %.3f\n", mbs, result);
+			sprintf(buf, "size=%.5f stride=%lu workers=%d traffic=%s delay=%d", 
+				len / (1024. * 1024.), (unsigned long)stride,
+				workers, traffic, delay);
+			record("loaded latency", buf, result, "nanoseconds");
+			record("injected bandwidth", buf, mbs, "MB/sec");
+		}
+
+		s = s ? strchr(s, ',') : delays;
+		if (!s) break;
+		if (*s == ',') ++s;
+		delay = atoi(s);
+		if (delay < 0) delay = 0;
+	}
+	fprintf(stderr, "\n");
+	pin = -1;
+	load_ctl = NULL;
+
+	ctl->stop = 1;
+	for (i = 0; i < workers; ++i)
+		waitpid(pids[i], NULL, 0);
+	munmap((void*)ctl, sizeof(load_ctl_t) + workers * sizeof(uint64));
+	free(pids);
 }
 
 size_t
@@ -52,7 +52,7 @@ main(int ac, char **av)
 	while (( c = getopt(ac, av, "rP:W:N:C")) != EOF) {
 		switch(c) {
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0)
 				lmbench_usage(ac, av, usage);
 			break;
@@ -83,6 +83,7 @@ main(int ac, char **av)
 		return (1);
 	}
 	state.name = av[optind+1];
+	benchmp_thread_cookie(sizeof(state));
 
 	benchmp(init, domapping, cleanup, 0, parallel, 
 		warmup, repetitions, &state);
@@ -104,14 +105,14 @@ init(iter_t iterations, void* cookie)
 		char buf[128];
 		char* s;
 
-		/* copy original file into a process-specific one */
-		sprintf(buf, "%d", (int)getpid());
+		/* copy original file into a worker-specific one */
+		sprintf(buf, "%d.%d", (int)getpid(), benchmp_childid());
 		s = (char*)malloc(strlen(state->name) + strlen(buf) + 1);
 		if (!s) {
 			perror("malloc");
 			exit(1);
 		}
-		sprintf(s, "%s%d", state->name, (int)getpid());
+		sprintf(s, "%s%s", state->name, buf);
 		if (cp(state->name, s, S_IREAD|S_IWRITE) < 0) {
 			perror("Could not copy file");
 			unlink(s);
@@ -411,7 +411,7 @@ main(int ac, char **av)
 			repetitions = atoi(optarg);
 			break;
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
 			break;
 		default:
@@ -50,7 +50,7 @@ main(int ac, char **av)
 	while (( c = getopt(ac, av, "P:W:N:C")) != EOF) {
 		switch(c) {
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
 			break;
 		case 'W':
@@ -74,6 +74,7 @@ main(int ac, char **av)
 	state.file = av[optind];
 	CHK(stat(state.file, &st));
 	state.npages = st.st_size / (size_t)getpagesize();
+	benchmp_thread_cookie(sizeof(state));
 
 #ifdef	MS_INVALIDATE
 	benchmp(initialize, benchmark_mmap, cleanup, 0, parallel, 
@@ -104,14 +105,14 @@ initialize(iter_t iterations, void* cookie)
 		char buf[128];
 		char* s;
 
-		/* copy original file into a process-specific one */
-		sprintf(buf, "%d", (int)getpid());
+		/* copy original file into a worker-specific one */
+		sprintf(buf, "%d.%d", (int)getpid(), benchmp_childid());
 		s = (char*)malloc(strlen(state->file) + strlen(buf) + 1);
 		if (!s) {
 			perror("malloc");
 			exit(1);
 		}
-		sprintf(s, "%s%d", state->file, (int)getpid());
+		sprintf(s, "%s%s", state->file, buf);
 		if (cp(state->file, s, S_IREAD|S_IWRITE) < 0) {
 			perror("Could not copy file");
 			unlink(s);
@@ -37,7 +37,7 @@ main(int ac, char **av)
 	while (( c = getopt(ac, av, "P:W:N:")) != EOF) {
 		switch(c) {
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
 			break;
 		case 'W':
@@ -60,6 +60,8 @@ main(int ac, char **av)
 	benchmp(initialize, doit, cleanup, SHORT, parallel, 
 		warmup, repetitions, &state);
 	micro("Pipe latency", get_n());
+	print_histogram("lat_pipe", 1);
+	print_perf("lat_pipe", 1);
 	return (0);
 }
 
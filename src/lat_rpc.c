@@ -127,7 +127,7 @@ main(int ac, char **av)
 			protocol = optarg;
 			break;
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0)
 				lmbench_usage(ac, av, usage);
 			break;
@@ -38,7 +38,7 @@ main(int ac, char **av)
 	while (( c = getopt(ac, av, "P:W:N:")) != EOF) {
 		switch(c) {
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
 			break;
 		case 'W':
@@ -61,6 +61,8 @@ main(int ac, char **av)
 	benchmp(initialize, doit, cleanup, SHORT, parallel, 
 		warmup, repetitions, &state);
 	micro("Semaphore latency", get_n() * 2);
+	print_histogram("lat_sem", 2);
+	print_perf("lat_sem", 2);
 	return (0);
 }
 
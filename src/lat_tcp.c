@@ -59,7 +59,7 @@ main(int ac, char **av)
 			state.msize = atoi(optarg);
 			break;
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0)
 				lmbench_usage(ac, av, usage);
 			break;
@@ -85,6 +85,9 @@ main(int ac, char **av)
 
 	sprintf(buf, "TCP latency using %s", state.server);
 	micro(buf, get_n());
+	sprintf(buf, "lat_tcp %s", state.server);
+	print_histogram(buf, 1);
+	print_perf(buf, 1);
 
 	exit(0);
 }
@@ -82,7 +82,7 @@ main(int ac, char **av)
 			}
 			break;
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0)
 				lmbench_usage(ac, av, usage);
 			break;
@@ -108,6 +108,9 @@ main(int ac, char **av)
 		warmup, repetitions, &state);
 	sprintf(buf, "UDP latency using %s", state.server);
 	micro(buf, get_n());
+	sprintf(buf, "lat_udp %s", state.server);
+	print_histogram(buf, 1);
+	print_perf(buf, 1);
 	exit(0);
 }
 
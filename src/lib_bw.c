@@ -0,0 +1,691 @@
+/*
+ * lib_bw.c - the memory bandwidth loops of bw_mem
+ *
+ * Reading, writing and copying a buffer, with the strided integer
+ * loops of bw_mem (rd, wr, rdwr and cp, every eighth word), the full
+ * ones (frd, fwr and fcp, every word) and the vector kernels, with
+ * the widest loads and stores the processor has, for anything that
+ * wants memory bandwidth: bw_mem and numa_mem.
+ *
+ * Copyright (c) 1994-1996 Larry McVoy.  Distributed under the FSF GPL with
+ * additional restriction that results may published only if
+ * (1) the benchmark is unmodified, and
+ * (2) the version in the sccsid below is included in the report.
+ * Support for this development by Sun Microsystems is gratefully acknowledged.
+ */
+#include "bench.h"
+
+#if defined(HAVE_X86_SIMD)
+#include <immintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(__ARM_FEATURE_SVE)
+#include <arm_sve.h>
+#endif
+/* the ratified v1.0 intrinsics; earlier releases spelled them otherwise */
+#if defined(__riscv_v_intrinsic) && __riscv_v_intrinsic >= 1000000
+#include <riscv_vector.h>
+#define	BW_RVV
+#endif
+
+#define TYPE    int
+
+static int	bw_scalar_supported(void);
+
+#if defined(HAVE_X86_SIMD)
+static int	bw_sse2_supported(void);
+static int	bw_avx2_supported(void);
+static int	bw_avx512_supported(void);
+void	bw_rd_sse2(iter_t iterations, void *cookie);
+void	bw_wr_sse2(iter_t iterations, void *cookie);
+void	bw_rdwr_sse2(iter_t iterations, void *cookie);
+void	bw_cp_sse2(iter_t iterations, void *cookie);
+void	bw_rd_avx2(iter_t iterations, void *cookie);
+void	bw_wr_avx2(iter_t iterations, void *cookie);
+void	bw_rdwr_avx2(iter_t iterations, void *cookie);
+void	bw_cp_avx2(iter_t iterations, void *cookie);
+void	bw_rd_avx512(iter_t iterations, void *cookie);
+void	bw_wr_avx512(iter_t iterations, void *cookie);
+void	bw_rdwr_avx512(iter_t iterations, void *cookie);
+void	bw_cp_avx512(iter_t iterations, void *cookie);
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+void	bw_rd_neon(iter_t iterations, void *cookie);
+void	bw_wr_neon(iter_t iterations, void *cookie);
+void	bw_rdwr_neon(iter_t iterations, void *cookie);
+void	bw_cp_neon(iter_t iterations, void *cookie);
+#endif
+#if defined(__ARM_FEATURE_SVE)
+void	bw_rd_sve(iter_t iterations, void *cookie);
+void	bw_wr_sve(iter_t iterations, void *cookie);
+void	bw_rdwr_sve(iter_t iterations, void *cookie);
+void	bw_cp_sve(iter_t iterations, void *cookie);
+#endif
+#ifdef BW_RVV
+void	bw_rd_rvv(iter_t iterations, void *cookie);
+void	bw_wr_rvv(iter_t iterations, void *cookie);
+void	bw_rdwr_rvv(iter_t iterations, void *cookie);
+void	bw_cp_rvv(iter_t iterations, void *cookie);
+#endif
+
+bw_kernel_t	bw_kernels[] = {
+#ifdef BW_RVV
+	{ "rvv", bw_scalar_supported, bw_rd_rvv, bw_wr_rvv, bw_rdwr_rvv,
+	  bw_cp_rvv },
+#endif
+#if defined(__ARM_FEATURE_SVE)
+	{ "sve", bw_scalar_supported, bw_rd_sve, bw_wr_sve, bw_rdwr_sve,
+	  bw_cp_sve },
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+	{ "neon", bw_scalar_supported, bw_rd_neon, bw_wr_neon, bw_rdwr_neon,
+	  bw_cp_neon },
+#endif
+#if defined(HAVE_X86_SIMD)
+	{ "avx512", bw_avx512_supported, bw_rd_avx512, bw_wr_avx512,
+	  bw_rdwr_avx512, bw_cp_avx512 },
+	{ "avx2", bw_avx2_supported, bw_rd_avx2, bw_wr_avx2, bw_rdwr_avx2,
+	  bw_cp_avx2 },
+	{ "sse2", bw_sse2_supported, bw_rd_sse2, bw_wr_sse2, bw_rdwr_sse2,
+	  bw_cp_sse2 },
+#endif
+	{ "scalar", bw_scalar_supported, NULL, NULL, NULL, NULL },
+	{ NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+/*
+ * Allocate and clear buf, and buf2 if need_buf2, nbytes each.  buf2
+ * is 128 bytes off the page with aligned, so that the copies conflict.
+ */
+void
+bw_initialize(iter_t iterations, void *cookie)
+{
+	struct bw_state *state = (struct bw_state *) cookie;
+
+	if (iterations) return;
+
+	state->buf = (TYPE *)mem_pages_alloc(state->nbytes);
+	state->buf2_orig = state->buf2 = NULL;
+	state->lastone = (TYPE*)((char *)state->buf + state->nbytes - 512);
+
+	if (!state->buf) {
+		perror("malloc");
+		exit(1);
+	}
+	bzero((void*)state->buf, state->nbytes);
+
+	if (state->need_buf2 == 1) {
+		state->buf2_orig = state->buf2 = (TYPE *)mem_pages_alloc(state->nbytes + 2048);
+		if (!state->buf2) {
+			perror("malloc");
+			exit(1);
+		}
+		bzero((void*)state->buf2, state->nbytes + 2048);
+
+		/* default is to have stuff unaligned wrt each other */
+		/* XXX - this is not well tested or thought out */
+		if (state->aligned) {
+			char	*tmp = (char *)state->buf2;
+
+			tmp += 2048 - 128;
+			state->buf2 = (TYPE *)tmp;
+		}
+	}
+}
+
+void
+bw_cleanup(iter_t iterations, void *cookie)
+{
+	struct bw_state *state = (struct bw_state *) cookie;
+
+	if (iterations) return;
+
+	mem_pages_free(state->buf);
+	if (state->buf2_orig) mem_pages_free(state->buf2_orig);
+}
+
+/*
+ * The named kernel, if this processor (and its OS) can run it, or the
+ * best one it can for "auto".
+ */
+bw_kernel_t*
+bw_kernel(char *name)
+{
+	bw_kernel_t	*k;
+
+	for (k = bw_kernels; k->name; ++k) {
+		if ((streq(name, "auto") || streq(name, k->name))
+		    && (*k->supported)())
+			return (k);
+	}
+	return (NULL);
+}
+
+static int
+bw_scalar_supported(void)
+{
+	return (1);
+}
+
+void
+bw_rd(iter_t iterations, void *cookie)
+{	
+	struct bw_state *state = (struct bw_state *) cookie;
+	register TYPE *lastone = state->lastone;
+	register int sum = 0;
+
+	while (iterations-- > 0) {
+	    register TYPE *p = state->buf;
+	    while (p <= lastone) {
+		sum += 
+#define	DOIT(i)	p[i]+
+		DOIT(0) DOIT(4) DOIT(8) DOIT(12) DOIT(16) DOIT(20) DOIT(24)
+		DOIT(28) DOIT(32) DOIT(36) DOIT(40) DOIT(44) DOIT(48) DOIT(52)
+		DOIT(56) DOIT(60) DOIT(64) DOIT(68) DOIT(72) DOIT(76)
+		DOIT(80) DOIT(84) DOIT(88) DOIT(92) DOIT(96) DOIT(100)
+		DOIT(104) DOIT(108) DOIT(112) DOIT(116) DOIT(120) 
+		p[124];
+		p +=  128;
+	    }
+	}
+	use_int(sum);
+}
+#undef	DOIT
+
+void
+bw_wr(iter_t iterations, void *cookie)
+{	
+	struct bw_state *state = (struct bw_state *) cookie;
+	register TYPE *lastone = state->lastone;
+
+	while (iterations-- > 0) {
+	    register TYPE *p = state->buf;
+	    while (p <= lastone) {
+#define	DOIT(i)	p[i] = 1;
+		DOIT(0) DOIT(4) DOIT(8) DOIT(12) DOIT(16) DOIT(20) DOIT(24)
+		DOIT(28) DOIT(32) DOIT(36) DOIT(40) DOIT(44) DOIT(48) DOIT(52)
+		DOIT(56) DOIT(60) DOIT(64) DOIT(68) DOIT(72) DOIT(76)
+		DOIT(80) DOIT(84) DOIT(88) DOIT(92) DOIT(96) DOIT(100)
+		DOIT(104) DOIT(108) DOIT(112) DOIT(116) DOIT(120) DOIT(124);
+		p +=  128;
+	    }
+	}
+}
+#undef	DOIT
+
+void
+bw_rdwr(iter_t iterations, void *cookie)
+{	
+	struct bw_state *state = (struct bw_state *) cookie;
+	register TYPE *lastone = state->lastone;
+	register int sum = 0;
+
+	while (iterations-- > 0) {
+	    register TYPE *p = state->buf;
+	    while (p <= lastone) {
+#define	DOIT(i)	sum += p[i]; p[i] = 1;
+		DOIT(0) DOIT(4) DOIT(8) DOIT(12) DOIT(16) DOIT(20) DOIT(24)
+		DOIT(28) DOIT(32) DOIT(36) DOIT(40) DOIT(44) DOIT(48) DOIT(52)
+		DOIT(56) DOIT(60) DOIT(64) DOIT(68) DOIT(72) DOIT(76)
+		DOIT(80) DOIT(84) DOIT(88) DOIT(92) DOIT(96) DOIT(100)
+		DOIT(104) DOIT(108) DOIT(112) DOIT(116) DOIT(120) DOIT(124);
+		p +=  128;
+	    }
+	}
+	use_int(sum);
+}
+#undef	DOIT
+
+void
+bw_cp(iter_t iterations, void *cookie)
+{	
+	struct bw_state *state = (struct bw_state *) cookie;
+	register TYPE *lastone = state->lastone;
+	TYPE* p_save = NULL;
+
+	while (iterations-- > 0) {
+	    register TYPE *p = state->buf;
+	    register TYPE *dst = state->buf2;
+	    while (p <= lastone) {
+#define	DOIT(i)	dst[i] = p[i];
+		DOIT(0) DOIT(4) DOIT(8) DOIT(12) DOIT(16) DOIT(20) DOIT(24)
+		DOIT(28) DOIT(32) DOIT(36) DOIT(40) DOIT(44) DOIT(48) DOIT(52)
+		DOIT(56) DOIT(60) DOIT(64) DOIT(68) DOIT(72) DOIT(76)
+		DOIT(80) DOIT(84) DOIT(88) DOIT(92) DOIT(96) DOIT(100)
+		DOIT(104) DOIT(108) DOIT(112) DOIT(116) DOIT(120) DOIT(124);
+		p += 128;
+		dst += 128;
+	    }
+	    p_save = p;
+	}
+	use_pointer(p_save);
+}
+#undef	DOIT
+
+void
+bw_fwr(iter_t iterations, void *cookie)
+{	
+	struct bw_state *state = (struct bw_state *) cookie;
+	register TYPE *lastone = state->lastone;
+	TYPE* p_save = NULL;
+
+	while (iterations-- > 0) {
+	    register TYPE *p = state->buf;
+	    while (p <= lastone) {
+#define	DOIT(i)	p[i]=
+		DOIT(0) DOIT(1) DOIT(2) DOIT(3) DOIT(4) DOIT(5) DOIT(6)
+		DOIT(7) DOIT(8) DOIT(9) DOIT(10) DOIT(11) DOIT(12)
+		DOIT(13) DOIT(14) DOIT(15) DOIT(16) DOIT(17) DOIT(18)
+		DOIT(19) DOIT(20) DOIT(21) DOIT(22) DOIT(23) DOIT(24)
+		DOIT(25) DOIT(26) DOIT(27) DOIT(28) DOIT(29) DOIT(30)
+		DOIT(31) DOIT(32) DOIT(33) DOIT(34) DOIT(35) DOIT(36)
+		DOIT(37) DOIT(38) DOIT(39) DOIT(40) DOIT(41) DOIT(42)
+		DOIT(43) DOIT(44) DOIT(45) DOIT(46) DOIT(47) DOIT(48)
+		DOIT(49) DOIT(50) DOIT(51) DOIT(52) DOIT(53) DOIT(54)
+		DOIT(55) DOIT(56) DOIT(57) DOIT(58) DOIT(59) DOIT(60)
+		DOIT(61) DOIT(62) DOIT(63) DOIT(64) DOIT(65) DOIT(66)
+		DOIT(67) DOIT(68) DOIT(69) DOIT(70) DOIT(71) DOIT(72)
+		DOIT(73) DOIT(74) DOIT(75) DOIT(76) DOIT(77) DOIT(78)
+		DOIT(79) DOIT(80) DOIT(81) DOIT(82) DOIT(83) DOIT(84)
+		DOIT(85) DOIT(86) DOIT(87) DOIT(88) DOIT(89) DOIT(90)
+		DOIT(91) DOIT(92) DOIT(93) DOIT(94) DOIT(95) DOIT(96)
+		DOIT(97) DOIT(98) DOIT(99) DOIT(100) DOIT(101) DOIT(102)
+		DOIT(103) DOIT(104) DOIT(105) DOIT(106) DOIT(107)
+		DOIT(108) DOIT(109) DOIT(110) DOIT(111) DOIT(112)
+		DOIT(113) DOIT(114) DOIT(115) DOIT(116) DOIT(117)
+		DOIT(118) DOIT(119) DOIT(120) DOIT(121) DOIT(122)
+		DOIT(123) DOIT(124) DOIT(125) DOIT(126) DOIT(127) 1;
+		p += 128;
+	    }
+	    p_save = p;
+	}
+	use_pointer(p_save);
+}
+#undef	DOIT
+
+void
+bw_frd(iter_t iterations, void *cookie)
+{	
+	struct bw_state *state = (struct bw_state *) cookie;
+	register int sum = 0;
+	register TYPE *lastone = state->lastone;
+
+	while (iterations-- > 0) {
+	    register TYPE *p = state->buf;
+	    while (p <= lastone) {
+		sum +=
+#define	DOIT(i)	p[i]+
+		DOIT(0) DOIT(1) DOIT(2) DOIT(3) DOIT(4) DOIT(5) DOIT(6)
+		DOIT(7) DOIT(8) DOIT(9) DOIT(10) DOIT(11) DOIT(12)
+		DOIT(13) DOIT(14) DOIT(15) DOIT(16) DOIT(17) DOIT(18)
+		DOIT(19) DOIT(20) DOIT(21) DOIT(22) DOIT(23) DOIT(24)
+		DOIT(25) DOIT(26) DOIT(27) DOIT(28) DOIT(29) DOIT(30)
+		DOIT(31) DOIT(32) DOIT(33) DOIT(34) DOIT(35) DOIT(36)
+		DOIT(37) DOIT(38) DOIT(39) DOIT(40) DOIT(41) DOIT(42)
+		DOIT(43) DOIT(44) DOIT(45) DOIT(46) DOIT(47) DOIT(48)
+		DOIT(49) DOIT(50) DOIT(51) DOIT(52) DOIT(53) DOIT(54)
+		DOIT(55) DOIT(56) DOIT(57) DOIT(58) DOIT(59) DOIT(60)
+		DOIT(61) DOIT(62) DOIT(63) DOIT(64) DOIT(65) DOIT(66)
+		DOIT(67) DOIT(68) DOIT(69) DOIT(70) DOIT(71) DOIT(72)
+		DOIT(73) DOIT(74) DOIT(75) DOIT(76) DOIT(77) DOIT(78)
+		DOIT(79) DOIT(80) DOIT(81) DOIT(82) DOIT(83) DOIT(84)
+		DOIT(85) DOIT(86) DOIT(87) DOIT(88) DOIT(89) DOIT(90)
+		DOIT(91) DOIT(92) DOIT(93) DOIT(94) DOIT(95) DOIT(96)
+		DOIT(97) DOIT(98) DOIT(99) DOIT(100) DOIT(101) DOIT(102)
+		DOIT(103) DOIT(104) DOIT(105) DOIT(106) DOIT(107)
+		DOIT(108) DOIT(109) DOIT(110) DOIT(111) DOIT(112)
+		DOIT(113) DOIT(114) DOIT(115) DOIT(116) DOIT(117)
+		DOIT(118) DOIT(119) DOIT(120) DOIT(121) DOIT(122)
+		DOIT(123) DOIT(124) DOIT(125) DOIT(126) p[127];
+		p += 128;
+	    }
+	}
+	use_int(sum);
+}
+#undef	DOIT
+
+void
+bw_fcp(iter_t iterations, void *cookie)
+{	
+	struct bw_state *state = (struct bw_state *) cookie;
+	register TYPE *lastone = state->lastone;
+
+	while (iterations-- > 0) {
+	    register TYPE *p = state->buf;
+	    register TYPE *dst = state->buf2;
+	    while (p <= lastone) {
+#define	DOIT(i)	dst[i]=p[i];
+		DOIT(0) DOIT(1) DOIT(2) DOIT(3) DOIT(4) DOIT(5) DOIT(6)
+		DOIT(7) DOIT(8) DOIT(9) DOIT(10) DOIT(11) DOIT(12)
+		DOIT(13) DOIT(14) DOIT(15) DOIT(16) DOIT(17) DOIT(18)
+		DOIT(19) DOIT(20) DOIT(21) DOIT(22) DOIT(23) DOIT(24)
+		DOIT(25) DOIT(26) DOIT(27) DOIT(28) DOIT(29) DOIT(30)
+		DOIT(31) DOIT(32) DOIT(33) DOIT(34) DOIT(35) DOIT(36)
+		DOIT(37) DOIT(38) DOIT(39) DOIT(40) DOIT(41) DOIT(42)
+		DOIT(43) DOIT(44) DOIT(45) DOIT(46) DOIT(47) DOIT(48)
+		DOIT(49) DOIT(50) DOIT(51) DOIT(52) DOIT(53) DOIT(54)
+		DOIT(55) DOIT(56) DOIT(57) DOIT(58) DOIT(59) DOIT(60)
+		DOIT(61) DOIT(62) DOIT(63) DOIT(64) DOIT(65) DOIT(66)
+		DOIT(67) DOIT(68) DOIT(69) DOIT(70) DOIT(71) DOIT(72)
+		DOIT(73) DOIT(74) DOIT(75) DOIT(76) DOIT(77) DOIT(78)
+		DOIT(79) DOIT(80) DOIT(81) DOIT(82) DOIT(83) DOIT(84)
+		DOIT(85) DOIT(86) DOIT(87) DOIT(88) DOIT(89) DOIT(90)
+		DOIT(91) DOIT(92) DOIT(93) DOIT(94) DOIT(95) DOIT(96)
+		DOIT(97) DOIT(98) DOIT(99) DOIT(100) DOIT(101) DOIT(102)
+		DOIT(103) DOIT(104) DOIT(105) DOIT(106) DOIT(107)
+		DOIT(108) DOIT(109) DOIT(110) DOIT(111) DOIT(112)
+		DOIT(113) DOIT(114) DOIT(115) DOIT(116) DOIT(117)
+		DOIT(118) DOIT(119) DOIT(120) DOIT(121) DOIT(122)
+		DOIT(123) DOIT(124) DOIT(125) DOIT(126) DOIT(127)
+		p += 128;
+		dst += 128;
+	    }
+	}
+}
+
+
+/*
+ * Vector versions of bw_rd, bw_wr, bw_rdwr and bw_cp.  Each step works on four
+ * vectors, with four accumulators so the loads need not wait on each
+ * other.  512 is a multiple of the step.
+ *
+ * BW_SIMD(isa, attribute, vector type, load, store, add, broadcast,
+ * to int) defines bw_rd_<isa>, bw_wr_<isa>, bw_rdwr_<isa> and
+ * bw_cp_<isa>.  They use unaligned loads and stores: the buffers are aligned anyway,
+ * except for the misaligned copies asked for.
+ */
+#define	BW_SIMD(isa, ATTR, VEC, LOAD, STORE, ADD, SET1, TOINT)		\
+ATTR void								\
+bw_rd_##isa(iter_t iterations, void *cookie)				\
+{									\
+	struct bw_state *state = (struct bw_state *) cookie;		\
+	char	*end = BW_END(state);			\
+	VEC	s0 = SET1(0), s1 = SET1(0), s2 = SET1(0), s3 = SET1(0);	\
+	const int w = sizeof(VEC);					\
+									\
+	while (iterations-- > 0) {					\
+	    register char *p = (char*)state->buf;			\
+	    for (; p < end; p += 4 * w) {				\
+		s0 = ADD(s0, LOAD(p));					\
+		s1 = ADD(s1, LOAD(p + w));				\
+		s2 = ADD(s2, LOAD(p + 2 * w));				\
+		s3 = ADD(s3, LOAD(p + 3 * w));				\
+	    }								\
+	}								\
+	use_int(TOINT(ADD(ADD(s0, s1), ADD(s2, s3))));			\
+}									\
+									\
+ATTR void								\
+bw_wr_##isa(iter_t iterations, void *cookie)				\
+{									\
+	struct bw_state *state = (struct bw_state *) cookie;		\
+	char	*end = BW_END(state);			\
+	VEC	one = SET1(1);						\
+	const int w = sizeof(VEC);					\
+									\
+	while (iterations-- > 0) {					\
+	    register char *p = (char*)state->buf;			\
+	    for (; p < end; p += 4 * w) {				\
+		STORE(p, one);						\
+		STORE(p + w, one);					\
+		STORE(p + 2 * w, one);					\
+		STORE(p + 3 * w, one);					\
+	    }								\
+	}								\
+}									\
+									\
+ATTR void								\
+bw_rdwr_##isa(iter_t iterations, void *cookie)				\
+{									\
+	struct bw_state *state = (struct bw_state *) cookie;		\
+	char	*end = BW_END(state);			\
+	VEC	s0 = SET1(0), s1 = SET1(0), one = SET1(1);		\
+	const int w = sizeof(VEC);					\
+									\
+	while (iterations-- > 0) {					\
+	    register char *p = (char*)state->buf;			\
+	    for (; p < end; p += 4 * w) {				\
+		s0 = ADD(s0, LOAD(p)); STORE(p, one);			\
+		s1 = ADD(s1, LOAD(p + w)); STORE(p + w, one);		\
+		s0 = ADD(s0, LOAD(p + 2 * w)); STORE(p + 2 * w, one);	\
+		s1 = ADD(s1, LOAD(p + 3 * w)); STORE(p + 3 * w, one);	\
+	    }								\
+	}								\
+	use_int(TOINT(ADD(s0, s1)));					\
+}									\
+									\
+ATTR void								\
+bw_cp_##isa(iter_t iterations, void *cookie)				\
+{									\
+	struct bw_state *state = (struct bw_state *) cookie;		\
+	char	*end = BW_END(state);			\
+	const int w = sizeof(VEC);					\
+									\
+	while (iterations-- > 0) {					\
+	    register char *p = (char*)state->buf;			\
+	    register char *dst = (char*)state->buf2;			\
+	    for (; p < end; p += 4 * w, dst += 4 * w) {			\
+		STORE(dst, LOAD(p));					\
+		STORE(dst + w, LOAD(p + w));				\
+		STORE(dst + 2 * w, LOAD(p + 2 * w));			\
+		STORE(dst + 3 * w, LOAD(p + 3 * w));			\
+	    }								\
+	}								\
+}
+
+#if defined(HAVE_X86_SIMD)
+/* __builtin_cpu_supports() also checks the OS saves the registers */
+static int
+bw_sse2_supported(void)
+{
+	return (__builtin_cpu_supports("sse2"));
+}
+
+static int
+bw_avx2_supported(void)
+{
+	return (__builtin_cpu_supports("avx2"));
+}
+
+static int
+bw_avx512_supported(void)
+{
+	return (__builtin_cpu_supports("avx512f"));
+}
+
+#define	SSE2_LOAD(p)		_mm_loadu_si128((__m128i*)(p))
+#define	SSE2_STORE(p, v)	_mm_storeu_si128((__m128i*)(p), v)
+#define	AVX2_LOAD(p)		_mm256_loadu_si256((__m256i*)(p))
+#define	AVX2_STORE(p, v)	_mm256_storeu_si256((__m256i*)(p), v)
+#define	AVX2_TOINT(v)		_mm256_extract_epi32(v, 0)
+#define	AVX512_LOAD(p)		_mm512_loadu_si512((void*)(p))
+#define	AVX512_STORE(p, v)	_mm512_storeu_si512((void*)(p), v)
+
+BW_SIMD(sse2, __attribute__((target("sse2"))), __m128i, SSE2_LOAD,
+	SSE2_STORE, _mm_add_epi32, _mm_set1_epi32, _mm_cvtsi128_si32)
+BW_SIMD(avx2, __attribute__((target("avx2"))), __m256i, AVX2_LOAD,
+	AVX2_STORE, _mm256_add_epi32, _mm256_set1_epi32, AVX2_TOINT)
+BW_SIMD(avx512, __attribute__((target("avx512f"))), __m512i, AVX512_LOAD,
+	AVX512_STORE, _mm512_add_epi32, _mm512_set1_epi32,
+	_mm512_reduce_add_epi32)
+#endif /* HAVE_X86_SIMD */
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+/* NEON is part of every AArch64 processor */
+#define	NEON_LOAD(p)		vld1q_s32((int32_t*)(p))
+#define	NEON_STORE(p, v)	vst1q_s32((int32_t*)(p), v)
+#define	NEON_TOINT(v)		vgetq_lane_s32(v, 0)
+
+BW_SIMD(neon, , int32x4_t, NEON_LOAD, NEON_STORE, vaddq_s32, vdupq_n_s32,
+	NEON_TOINT)
+#endif
+
+#if defined(__ARM_FEATURE_SVE)
+/*
+ * SVE vectors are as wide as the processor makes them, so sizeof()
+ * does not apply and the step need not divide 512: built with SVE,
+ * we can only be run with it.
+ */
+#define	SVE_ALL			svptrue_b32()
+#define	SVE_WIDTH		((int)svcntb())
+
+void
+bw_rd_sve(iter_t iterations, void *cookie)
+{
+	struct bw_state *state = (struct bw_state *) cookie;
+	char	*end = BW_END(state);
+	svint32_t s0 = svdup_s32(0), s1 = svdup_s32(0);
+	const int w = SVE_WIDTH;
+
+	while (iterations-- > 0) {
+	    register char *p = (char*)state->buf;
+	    for (; p + 2 * w <= end; p += 2 * w) {
+		s0 = svadd_s32_x(SVE_ALL, s0, svld1_s32(SVE_ALL, (int32_t*)p));
+		s1 = svadd_s32_x(SVE_ALL, s1,
+				 svld1_s32(SVE_ALL, (int32_t*)(p + w)));
+	    }
+	}
+	use_int((int)svaddv_s32(SVE_ALL, svadd_s32_x(SVE_ALL, s0, s1)));
+}
+
+void
+bw_wr_sve(iter_t iterations, void *cookie)
+{
+	struct bw_state *state = (struct bw_state *) cookie;
+	char	*end = BW_END(state);
+	svint32_t one = svdup_s32(1);
+	const int w = SVE_WIDTH;
+
+	while (iterations-- > 0) {
+	    register char *p = (char*)state->buf;
+	    for (; p + 2 * w <= end; p += 2 * w) {
+		svst1_s32(SVE_ALL, (int32_t*)p, one);
+		svst1_s32(SVE_ALL, (int32_t*)(p + w), one);
+	    }
+	}
+}
+
+void
+bw_rdwr_sve(iter_t iterations, void *cookie)
+{
+	struct bw_state *state = (struct bw_state *) cookie;
+	char	*end = BW_END(state);
+	svint32_t s0 = svdup_s32(0), one = svdup_s32(1);
+	const int w = SVE_WIDTH;
+
+	while (iterations-- > 0) {
+	    register char *p = (char*)state->buf;
+	    for (; p + w <= end; p += w) {
+		s0 = svadd_s32_x(SVE_ALL, s0, svld1_s32(SVE_ALL, (int32_t*)p));
+		svst1_s32(SVE_ALL, (int32_t*)p, one);
+	    }
+	}
+	use_int((int)svaddv_s32(SVE_ALL, s0));
+}
+
+void
+bw_cp_sve(iter_t iterations, void *cookie)
+{
+	struct bw_state *state = (struct bw_state *) cookie;
+	char	*end = BW_END(state);
+	const int w = SVE_WIDTH;
+
+	while (iterations-- > 0) {
+	    register char *p = (char*)state->buf;
+	    register char *dst = (char*)state->buf2;
+	    for (; p + w <= end; p += w, dst += w) {
+		svst1_s32(SVE_ALL, (int32_t*)dst,
+			  svld1_s32(SVE_ALL, (int32_t*)p));
+	    }
+	}
+}
+#endif /* __ARM_FEATURE_SVE */
+
+#ifdef BW_RVV
+/*
+ * Like SVE, RVV vectors are as wide as the processor makes them, and
+ * built with V we can only be run with it.  LMUL is 1.
+ */
+#define	RVV_VL			__riscv_vsetvlmax_e32m1()
+#define	RVV_DUP(x, vl)		__riscv_vmv_v_x_i32m1(x, vl)
+#define	RVV_LOAD(p, vl)		__riscv_vle32_v_i32m1((int32_t*)(p), vl)
+#define	RVV_STORE(p, v, vl)	__riscv_vse32_v_i32m1((int32_t*)(p), v, vl)
+#define	RVV_ADD(a, b, vl)	__riscv_vadd_vv_i32m1(a, b, vl)
+#define	RVV_TOINT(v, vl)	__riscv_vmv_x_s_i32m1_i32(		\
+	__riscv_vredsum_vs_i32m1_i32m1(v, RVV_DUP(0, vl), vl))
+
+void
+bw_rd_rvv(iter_t iterations, void *cookie)
+{
+	struct bw_state *state = (struct bw_state *) cookie;
+	char	*end = BW_END(state);
+	size_t	vl = RVV_VL;
+	vint32m1_t s0 = RVV_DUP(0, vl), s1 = RVV_DUP(0, vl);
+	const int w = vl * sizeof(int32_t);
+
+	while (iterations-- > 0) {
+	    register char *p = (char*)state->buf;
+	    for (; p + 2 * w <= end; p += 2 * w) {
+		s0 = RVV_ADD(s0, RVV_LOAD(p, vl), vl);
+		s1 = RVV_ADD(s1, RVV_LOAD(p + w, vl), vl);
+	    }
+	}
+	use_int((int)RVV_TOINT(RVV_ADD(s0, s1, vl), vl));
+}
+
+void
+bw_wr_rvv(iter_t iterations, void *cookie)
+{
+	struct bw_state *state = (struct bw_state *) cookie;
+	char	*end = BW_END(state);
+	size_t	vl = RVV_VL;
+	vint32m1_t one = RVV_DUP(1, vl);
+	const int w = vl * sizeof(int32_t);
+
+	while (iterations-- > 0) {
+	    register char *p = (char*)state->buf;
+	    for (; p + 2 * w <= end; p += 2 * w) {
+		RVV_STORE(p, one, vl);
+		RVV_STORE(p + w, one, vl);
+	    }
+	}
+}
+
+void
+bw_rdwr_rvv(iter_t iterations, void *cookie)
+{
+	struct bw_state *state = (struct bw_state *) cookie;
+	char	*end = BW_END(state);
+	size_t	vl = RVV_VL;
+	vint32m1_t s0 = RVV_DUP(0, vl), one = RVV_DUP(1, vl);
+	const int w = vl * sizeof(int32_t);
+
+	while (iterations-- > 0) {
+	    register char *p = (char*)state->buf;
+	    for (; p + w <= end; p += w) {
+		s0 = RVV_ADD(s0, RVV_LOAD(p, vl), vl);
+		RVV_STORE(p, one, vl);
+	    }
+	}
+	use_int((int)RVV_TOINT(s0, vl));
+}
+
+void
+bw_cp_rvv(iter_t iterations, void *cookie)
+{
+	struct bw_state *state = (struct bw_state *) cookie;
+	char	*end = BW_END(state);
+	size_t	vl = RVV_VL;
+	const int w = vl * sizeof(int32_t);
+
+	while (iterations-- > 0) {
+	    register char *p = (char*)state->buf;
+	    register char *dst = (char*)state->buf2;
+	    for (; p + w <= end; p += w, dst += w) {
+		RVV_STORE(dst, RVV_LOAD(p, vl), vl);
+	    }
+	}
+}
+#endif /* BW_RVV */
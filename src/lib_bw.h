@@ -0,0 +1,64 @@
+#ifndef LMBENCH_BW_H
+#define LMBENCH_BW_H
+
+/*
+ * The bandwidth loops of lib_bw.c.  Their cookie is a struct bw_state,
+ * or a benchmark's state with one as its first member; bw_initialize()
+ * and bw_cleanup() allocate and free its buffers.
+ */
+struct bw_state {
+	size_t	nbytes;		/* a multiple of 512 */
+	int	need_buf2;	/* copies need a destination */
+	int	aligned;	/* buf2 128 bytes into a page */
+	int*	buf;
+	int*	buf2;
+	int*	buf2_orig;	/* as allocated */
+	int*	lastone;	/* the last 512 byte chunk */
+};
+
+/* the end of the whole 512 byte chunks, which are all the loops do */
+#define	BW_END(state)	((char*)(state)->buf + ((state)->nbytes & ~(size_t)511))
+
+void	bw_initialize(iter_t iterations, void *cookie);
+void	bw_cleanup(iter_t iterations, void *cookie);
+
+/*
+ * rd - 4 byte read, 32 byte stride
+ * wr - 4 byte write, 32 byte stride
+ * rdwr - 4 byte read followed by 4 byte write to same place, 32 byte stride
+ * cp - 4 byte read then 4 byte write to different place, 32 byte stride
+ * fwr - write every 4 byte word
+ * frd - read every 4 byte word
+ * fcp - copy every 4 byte word
+ *
+ * All tests do 512 byte chunks in a loop.
+ */
+void	bw_rd(iter_t iterations, void *cookie);
+void	bw_wr(iter_t iterations, void *cookie);
+void	bw_rdwr(iter_t iterations, void *cookie);
+void	bw_cp(iter_t iterations, void *cookie);
+void	bw_fwr(iter_t iterations, void *cookie);
+void	bw_frd(iter_t iterations, void *cookie);
+void	bw_fcp(iter_t iterations, void *cookie);
+
+/*
+ * The vector kernels do the same with the widest loads and stores the
+ * processor has.  A vector covers 16 bytes or more, so they touch
+ * every word: rd is frd, wr is fwr and cp is fcp.  bw_kernels[] lists
+ * them in order of preference, ending with scalar, whose NULL loops
+ * mean the ones above; bw_kernel() returns the named kernel, if this
+ * processor can run it, or the best one it can for "auto".
+ */
+typedef struct {
+	char	*name;
+	int	(*supported)(void);
+	void	(*rd)(iter_t iterations, void *cookie);
+	void	(*wr)(iter_t iterations, void *cookie);
+	void	(*rdwr)(iter_t iterations, void *cookie);
+	void	(*cp)(iter_t iterations, void *cookie);
+} bw_kernel_t;
+
+extern bw_kernel_t	bw_kernels[];
+bw_kernel_t*	bw_kernel(char *name);
+
+#endif /* LMBENCH_BW_H */
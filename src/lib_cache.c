@@ -0,0 +1,215 @@
+/*
+ * lib_cache.c - persistent timing calibration cache
+ *
+ * When LMBENCH_CACHE names a file, lib_timing keeps the results of
+ * its calibration there: enough, the timing and loop overheads, and
+ * the iteration counts that each benchmark converged on.  Later runs
+ * start from those values instead of recomputing them.
+ *
+ * The file is plain text.  Its first line is a key describing the
+ * host, machine, CPU model, kernel and timing clock; if any of them
+ * has changed the whole cache is ignored, and rewritten as values
+ * are recomputed.  Each following line is "<value> <name>".
+ *
+ * Every cache_put() merges with what is on disk and rewrites the file
+ * through a rename(), so concurrent runs may lose an update but never
+ * see a torn file.
+ */
+#include "bench.h"
+#ifndef WIN32
+#include <sys/utsname.h>
+#endif
+
+/* #define _DEBUG */
+
+#define	CACHE_MAX	1024	/* entries kept, the oldest are dropped */
+#define	CACHE_LINE	1024
+
+typedef struct {
+	double	value;
+	char	*name;
+} cache_entry;
+
+static cache_entry	cache[CACHE_MAX];
+static int		cache_n = -1;	/* not loaded yet */
+static char		cache_key[CACHE_LINE];
+
+int
+cache_enabled(void)
+{
+	char	*s = getenv("LMBENCH_CACHE");
+
+	return (s && *s);
+}
+
+/*
+ * Anything that changes the calibration must be in the key.
+ */
+static void
+cache_getkey(void)
+{
+	char		model[256];
+	char		line[CACHE_LINE];
+	char		*s;
+	FILE		*f;
+#ifndef WIN32
+	struct utsname	u;
+#endif
+
+	if (cache_key[0]) return;
+	strcpy(model, "unknown");
+	if ((f = fopen("/proc/cpuinfo", "r")) != NULL) {
+		while (fgets(line, sizeof(line), f)) {
+			if (strncmp(line, "model name", 10)
+			    && strncmp(line, "cpu model", 9)
+			    && strncmp(line, "cpu\t", 4))
+				continue;
+			if (!(s = strchr(line, ':'))) continue;
+			for (++s; *s == ' ' || *s == '\t'; ++s)
+				;
+			strncpy(model, s, sizeof(model) - 1);
+			model[sizeof(model) - 1] = 0;
+			if ((s = strchr(model, '\n')) != NULL) *s = 0;
+			break;
+		}
+		fclose(f);
+	}
+#ifndef WIN32
+	if (uname(&u) == 0) {
+		snprintf(cache_key, sizeof(cache_key),
+			 "host=%s machine=%s kernel=%s %s cpu=%s clock=%s",
+			 u.nodename, u.machine, u.release, u.version,
+			 model, timing_clock());
+	} else
+#endif
+	snprintf(cache_key, sizeof(cache_key), "cpu=%s clock=%s",
+		 model, timing_clock());
+	/* it is one line in the file */
+	for (s = cache_key; *s; ++s) {
+		if (*s == '\n') *s = ' ';
+	}
+}
+
+static void
+cache_clear(void)
+{
+	int	i;
+
+	for (i = 0; i < cache_n; ++i)
+		free(cache[i].name);
+	cache_n = 0;
+}
+
+static int
+cache_find(char* name)
+{
+	int	i;
+
+	for (i = 0; i < cache_n; ++i) {
+		if (!strcmp(cache[i].name, name))
+			return (i);
+	}
+	return (-1);
+}
+
+static void
+cache_set(char* name, double value)
+{
+	int	i = cache_find(name);
+
+	if (i < 0) {
+		if (cache_n == CACHE_MAX) {
+			free(cache[0].name);
+			bcopy((void*)&cache[1], (void*)&cache[0],
+			      (CACHE_MAX - 1) * sizeof(cache_entry));
+			--cache_n;
+		}
+		if (!(name = strdup(name))) return;
+		i = cache_n++;
+		cache[i].name = name;
+	}
+	cache[i].value = value;
+}
+
+static void
+cache_load(void)
+{
+	char	line[CACHE_LINE];
+	char	*s;
+	double	v;
+	FILE	*f;
+
+	cache_getkey();
+	cache_clear();
+	if (!(f = fopen(getenv("LMBENCH_CACHE"), "r"))) return;
+	if (!fgets(line, sizeof(line), f)
+	    || strncmp(line, "key ", 4)
+	    || strncmp(line + 4, cache_key, strlen(cache_key))
+	    || line[4 + strlen(cache_key)] != '\n') {
+#ifdef _DEBUG
+		fprintf(stderr, "cache_load: stale key\n");
+#endif
+		fclose(f);
+		return;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if ((s = strchr(line, '\n')) != NULL) *s = 0;
+		v = strtod(line, &s);
+		if (s == line || *s != ' ') continue;
+		cache_set(s + 1, v);
+	}
+	fclose(f);
+}
+
+static void
+cache_save(void)
+{
+	int	i;
+	char	*file = getenv("LMBENCH_CACHE");
+	char	*tmp;
+	FILE	*f;
+
+	if (!(tmp = (char*)malloc(strlen(file) + 32))) return;
+	sprintf(tmp, "%s.%d", file, (int)getpid());
+	if (!(f = fopen(tmp, "w"))) {
+		free(tmp);
+		return;
+	}
+	fprintf(f, "key %s\n", cache_key);
+	for (i = 0; i < cache_n; ++i)
+		fprintf(f, "%.17g %s\n", cache[i].value, cache[i].name);
+	if (fclose(f) == 0 && rename(tmp, file) == 0) {
+		free(tmp);
+		return;
+	}
+	unlink(tmp);
+	free(tmp);
+}
+
+/*
+ * Look up name, returns 1 and sets *value if it is cached.
+ */
+int
+cache_get(char* name, double* value)
+{
+	int	i;
+
+	if (!cache_enabled()) return (0);
+	if (cache_n < 0) cache_load();
+	if ((i = cache_find(name)) < 0) return (0);
+	*value = cache[i].value;
+#ifdef _DEBUG
+	fprintf(stderr, "cache_get(%s) = %g\n", name, *value);
+#endif
+	return (1);
+}
+
+void
+cache_put(char* name, double value)
+{
+	if (!cache_enabled()) return;
+	/* pick up what other runs have saved meanwhile */
+	cache_load();
+	cache_set(name, value);
+	cache_save();
+}
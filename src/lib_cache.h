@@ -0,0 +1,12 @@
+#ifndef _LIB_CACHE_H
+#define _LIB_CACHE_H
+
+/*
+ * Timing calibration cache, enabled with LMBENCH_CACHE.
+ * See lib_cache.c.
+ */
+int	cache_enabled(void);
+int	cache_get(char* name, double* value);
+void	cache_put(char* name, double value);
+
+#endif /* _LIB_CACHE_H */
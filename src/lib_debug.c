@@ -30,6 +30,7 @@ percent_point(double fraction)
 		r += results->v[(int)t+1].u / (double)results->v[(int)t+1].n;
 		r /= 2.0;
 	}
+	r /= 1000.;	/* result_t carries nanoseconds */
 
 	return r;
 }
@@ -42,7 +43,7 @@ print_results(int details)
 
 	fprintf(stderr, "N=%d, t={", results->N);
 	for (i = 0; i < results->N; ++i) {
-		fprintf(stderr, "%.2f", (double)results->v[i].u/results->v[i].n);
+		fprintf(stderr, "%.2f", (double)results->v[i].u/(1000. * results->v[i].n));
 		if (i < results->N - 1) 
 			fprintf(stderr, ", ");
 	}
@@ -57,7 +58,31 @@ print_results(int details)
 		}
 		fprintf(stderr, "} */\n");
 	}
-		
+	if (get_histogram())
+		print_histogram("\tresults", 1);
+}
+
+/*
+ * Prints the latency distribution recorded with LMBENCH_HISTOGRAM,
+ * in micro-seconds per operation.
+ *
+ * ops - operations per iteration
+ */
+void
+print_histogram(char* s, uint64 ops)
+{
+	histogram_t* h = get_histogram();
+	double	scale = 1000. * (ops ? ops : 1);
+
+	if (!h || h->count == 0) return;
+	fprintf(stderr, "%s histogram: N=%llu min=%.4f p50=%.4f p90=%.4f p99=%.4f p99.9=%.4f max=%.4f microseconds\n",
+		s, (unsigned long long)h->count,
+		h->min / scale,
+		hist_percentile(h, 0.50) / scale,
+		hist_percentile(h, 0.90) / scale,
+		hist_percentile(h, 0.99) / scale,
+		hist_percentile(h, 0.999) / scale,
+		h->max / scale);
 }
 
 /*
@@ -2,6 +2,7 @@
 #define _LIB_DEBUG_H
 
 void	print_results(int details);
+void	print_histogram(char* s, uint64 ops);
 void	bw_quartile(uint64 bytes);
 void	nano_quartile(uint64 n);
 void	print_mem(char* addr, size_t size, size_t line);
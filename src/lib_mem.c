@@ -14,27 +14,34 @@
 
 #include "bench.h"
 
+#if defined(MEM_ZERO) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
 #define	FIVE(m)		m m m m m
 #define	TEN(m)		FIVE(m) FIVE(m)
 #define	FIFTY(m)	TEN(m) TEN(m) TEN(m) TEN(m) TEN(m)
 #define	HUNDRED(m)	FIFTY(m) FIFTY(m)
 
 #define DEREF(N)	p##N = (char**)*p##N;
-#define DECLARE(N)	static char **sp##N; register char **p##N;
+#define DECLARE(N)	static LMBENCH_TLS char **sp##N; register char **p##N;
 #define INIT(N)		p##N = (mem_benchmark_rerun && addr_save==state->addr) ? sp##N : (char**)state->p[N];
 #define SAVE(N)		sp##N = p##N;
 
 #define MEM_BENCHMARK_F(N) mem_benchmark_##N,
 benchmp_f mem_benchmarks[] = {REPEAT_15(MEM_BENCHMARK_F)};
 
-static int mem_benchmark_rerun = 0;
+static LMBENCH_TLS int mem_benchmark_rerun = 0;
+
+static char*	mem_pages_mode(void);
+static void	mem_pages_probe(void);
 
 #define MEM_BENCHMARK_DEF(N,repeat,body) 				\
 void									\
 mem_benchmark_##N(iter_t iterations, void *cookie)			\
 {									\
 	struct mem_state* state = (struct mem_state*)cookie;		\
-	static char *addr_save = NULL;					\
+	static LMBENCH_TLS char *addr_save = NULL;			\
 	repeat(DECLARE);						\
 									\
 	repeat(INIT);							\
@@ -82,7 +89,7 @@ mem_cleanup(iter_t iterations, void* cookie)
 	if (iterations) return;
 
 	if (state->addr) {
-		free(state->addr);
+		mem_pages_free(state->addr);
 		state->addr = NULL;
 	}
 	if (state->lines) {
@@ -110,7 +117,7 @@ tlb_cleanup(iter_t iterations, void* cookie)
 
 	if (addr) {
 		for (i = 0; i < state->npages; ++i) {
-			if (addr[i]) free(addr[i]);
+			if (addr[i]) mem_pages_free(addr[i]);
 		}
 		free(addr);
 		state->addr = NULL;
@@ -150,7 +157,7 @@ base_initialize(iter_t iterations, void* cookie)
 	words = NULL;
 	lines = NULL;
 	pages = permutation(nmpages, state->pagesize);
-	p = state->addr = (char*)malloc(state->maxlen + 2 * state->pagesize);
+	p = state->addr = (char*)mem_pages_malloc(state->maxlen + 2 * state->pagesize);
 	if (!p) {
 		perror("base_initialize: malloc");
 		exit(1);
@@ -470,7 +477,12 @@ tlb_initialize(iter_t iterations, void* cookie)
 	}
 
 	/* first, layout the sequence of page accesses */
-	for (i = 0; i < npages; ++i) {
+	if (mem_pages_mode()) {
+		/* one mapping, so that it can be in huge pages */
+		p = addr[0] = (char*)mem_pages_alloc(npages * pagesize);
+		for (i = 0; i < npages; ++i)
+			pages[i] = p + i * pagesize;
+	} else for (i = 0; i < npages; ++i) {
 		p = addr[i] = (char*)valloc(pagesize);
 		if (!p) {
 			perror("tlb_initialize: valloc");
@@ -631,11 +643,11 @@ line_test(size_t line, int warmup, int repetitions, struct mem_state* state)
 		/*
 		fprintf(stderr, "%d\t%d\t%d\n", line, (int)gettime(), (int)get_n()); 
 		/**/
-		insertsort(gettime(), get_n(), r);
+		insertsort(gettime_ns(), get_n(), r);
 	}
 	use_pointer(p);
 	set_results(r);
-	t = 10. * (double)gettime() / (double)get_n();
+	t = (double)gettime_ns() / (100. * (double)get_n());
 	set_results(r_save);
 	free(r);
 	
@@ -726,3 +738,303 @@ par_mem(size_t len, int warmup, int repetitions, struct mem_state* state)
 }
 
 
+
+/*
+ * The bytes MEM_ZERO_LINE() zeroes, or 0 if it may not be used here.
+ */
+size_t
+mem_zero_size(void)
+{
+	size_t	size = 0;
+#if defined(MEM_ZERO) && defined(__aarch64__)
+	uint64	dczid;
+
+	/* log2 of the block size in words, unless DZP prohibits it */
+	__asm__ __volatile__("mrs %0, dczid_el0" : "=r"(dczid));
+	if (!(dczid & 0x10))
+		size = (size_t)4 << (dczid & 0xf);
+#elif defined(MEM_ZERO)
+	unsigned int	eax, ebx, ecx, edx;
+
+	/* AMD's CLZERO zeroes a line of the CLFLUSH size */
+	if (__get_cpuid(0x80000008, &eax, &ebx, &ecx, &edx)
+	    && (ebx & 1)
+	    && __get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		size = ((ebx >> 8) & 0xff) * 8;
+#endif
+	return (size);
+}
+
+/*
+ * LMBENCH_PAGES chooses the pages behind the benchmark buffers:
+ *
+ *	4k	base pages only (MADV_NOHUGEPAGE)
+ *	thp	transparent huge pages (MADV_HUGEPAGE)
+ *	2m, 1g	hugetlbfs pages of that size (MAP_HUGETLB), which must
+ *		have been reserved, e.g. in /proc/sys/vm/nr_hugepages
+ *
+ * Each buffer is touched as soon as it is mapped, and /proc/self/smaps
+ * says how much of it the huge pages actually back; the workers add
+ * that up in a page shared with benchmp, for mem_pages_end().
+ */
+typedef struct mem_map {
+	char		*addr;
+	size_t		len;
+	struct mem_map	*next;
+} mem_map_t;
+
+typedef struct {
+	size_t	bytes;		/* mapped by the workers */
+	size_t	huge;		/* of those, in huge pages */
+	size_t	pagesize;	/* the largest page seen */
+	int	failed;		/* workers that could not map theirs */
+} mem_pages_t;
+
+static LMBENCH_TLS mem_map_t	*mem_maps = NULL;
+static mem_pages_t	*mem_pages_shared = NULL;
+
+static char*
+mem_pages_mode(void)
+{
+	static char	*mode = NULL;
+	static int	checked = 0;
+	char	*s;
+
+	if (checked) return mode;
+	checked = 1;
+	if ((s = getenv("LMBENCH_PAGES")) == NULL || !*s) return NULL;
+	if (!strcasecmp(s, "4k")) mode = "4k";
+	else if (!strcasecmp(s, "thp")) mode = "thp";
+	else if (!strcasecmp(s, "2m")) mode = "2m";
+	else if (!strcasecmp(s, "1g")) mode = "1g";
+	else fprintf(stderr, "LMBENCH_PAGES=%s: not 4k, thp, 2m or 1g\n", s);
+	return mode;
+}
+
+/* the transparent huge page size */
+static size_t
+mem_thp_size(void)
+{
+	FILE	*f;
+	unsigned long	size = 0;
+
+	f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+	if (f) {
+		if (fscanf(f, "%lu", &size) != 1) size = 0;
+		fclose(f);
+	}
+	return size ? (size_t)size : 2 * 1024 * 1024;
+}
+
+/*
+ * Look up the mapping holding p in /proc/self/smaps and add how much
+ * of it is in huge pages to the shared totals.  Neighbouring buffers
+ * may share a mapping, but then they were asked for the same pages.
+ */
+static void
+mem_pages_check(char* p, size_t len, char* mode)
+{
+	FILE	*f;
+	char	line[256];
+	unsigned long	start, end, kb;
+	size_t	size = 0, anonhuge = 0, kpage = 0, huge, pagesize;
+	int	found = 0;
+
+	if (!mem_pages_shared || !(f = fopen("/proc/self/smaps", "r")))
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2
+		    && strchr(line, '-') < strchr(line, ' ')) {
+			if (found) break;
+			found = (start <= (unsigned long)p 
+				 && (unsigned long)p < end);
+			continue;
+		}
+		if (!found) continue;
+		if (sscanf(line, "Size: %lu kB", &kb) == 1)
+			size = kb * 1024;
+		else if (sscanf(line, "KernelPageSize: %lu kB", &kb) == 1)
+			kpage = kb * 1024;
+		else if (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+			anonhuge = kb * 1024;
+	}
+	fclose(f);
+	if (!found || !size) return;
+
+	pagesize = kpage ? kpage : getpagesize();
+	if (pagesize > (size_t)getpagesize()) {
+		huge = len;
+	} else {
+		huge = (size_t)((double)len * anonhuge / size);
+		if (anonhuge) pagesize = mem_thp_size();
+	}
+	__sync_fetch_and_add(&mem_pages_shared->bytes, len);
+	__sync_fetch_and_add(&mem_pages_shared->huge, huge);
+	while (mem_pages_shared->pagesize < pagesize)
+		__sync_val_compare_and_swap(&mem_pages_shared->pagesize,
+					    mem_pages_shared->pagesize,
+					    pagesize);
+}
+
+/*
+ * Map one huge page before any worker starts, so that a machine with
+ * none reserved fails the benchmark once, here in the parent, instead
+ * of in every worker of every run.
+ */
+static void
+mem_pages_probe(void)
+{
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+	char	*mode = mem_pages_mode();
+	size_t	len;
+	void	*p;
+
+	if (strcmp(mode, "2m") && strcmp(mode, "1g")) return;
+	len = mode[1] == 'm' ? (1UL << 21) : (1UL << 30);
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE, 
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB 
+		 | ((mode[1] == 'm' ? 21 : 30) << MAP_HUGE_SHIFT), -1, 0);
+	if (p == MAP_FAILED) {
+		fprintf(stderr, "LMBENCH_PAGES=%s: mmap of %lu bytes: %s\n",
+			mode, (unsigned long)len, strerror(errno));
+		fprintf(stderr, "LMBENCH_PAGES=%s: reserve more huge pages, see /sys/kernel/mm/hugepages\n", mode);
+		exit(1);
+	}
+	munmap(p, len);
+#endif
+}
+
+void*
+mem_pages_alloc(size_t size)
+{
+	char	*mode = mem_pages_mode();
+	char	*p, *q;
+	size_t	align, len;
+	int	flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	mem_map_t *m;
+
+	if (!mode) return valloc(size);
+
+	if (!strcmp(mode, "2m") || !strcmp(mode, "1g")) {
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+		align = mode[1] == 'm' ? (1UL << 21) : (1UL << 30);
+		flags |= MAP_HUGETLB 
+			| ((mode[1] == 'm' ? 21 : 30) << MAP_HUGE_SHIFT);
+#else
+		fprintf(stderr, "LMBENCH_PAGES=%s: no MAP_HUGETLB here\n", mode);
+		exit(1);
+#endif
+	} else {
+		align = strcmp(mode, "thp") ? getpagesize() : mem_thp_size();
+	}
+	len = (size + align - 1) & ~(align - 1);
+
+	/* hugetlb mappings are aligned already, map more to align thp */
+	p = (char*)mmap(NULL, len + (flags & MAP_HUGETLB ? 0 : align), 
+			PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (p == (char*)MAP_FAILED) {
+		/* one message for all the workers, mem_pages_end() fails */
+		if (mem_pages_shared 
+		    && __sync_fetch_and_add(&mem_pages_shared->failed, 1))
+			exit(1);
+		fprintf(stderr, "LMBENCH_PAGES=%s: mmap of %lu bytes: %s\n",
+			mode, (unsigned long)len, strerror(errno));
+		if (flags & MAP_HUGETLB)
+			fprintf(stderr, "LMBENCH_PAGES=%s: reserve more huge pages, see /sys/kernel/mm/hugepages\n", mode);
+		exit(1);
+	}
+	if (!(flags & MAP_HUGETLB)) {
+		q = (char*)(((unsigned long)p + align - 1) & ~(align - 1));
+		if (q > p) munmap(p, q - p);
+		munmap(q + len, p + align - q);
+		p = q;
+#if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+		if (madvise(p, len, strcmp(mode, "thp") 
+			    ? MADV_NOHUGEPAGE : MADV_HUGEPAGE) < 0)
+			fprintf(stderr, "LMBENCH_PAGES=%s: madvise: %s\n",
+				mode, strerror(errno));
+#endif
+	}
+
+	/* fault it in, so smaps can tell what it got */
+	for (q = p; q < p + len; q += getpagesize())
+		*q = 0;
+	mem_pages_check(p, len, mode);
+
+	if ((m = (mem_map_t*)malloc(sizeof(*m))) != NULL) {
+		m->addr = p;
+		m->len = len;
+		m->next = mem_maps;
+		mem_maps = m;
+	}
+	return p;
+}
+
+void*
+mem_pages_malloc(size_t size)
+{
+	if (!mem_pages_mode()) return malloc(size);
+	return mem_pages_alloc(size);
+}
+
+void
+mem_pages_free(void* p)
+{
+	mem_map_t **m, *n;
+
+	for (m = &mem_maps; *m; m = &(*m)->next) {
+		if ((*m)->addr == (char*)p) {
+			n = *m;
+			*m = n->next;
+			munmap(n->addr, n->len);
+			free(n);
+			return;
+		}
+	}
+	free(p);
+}
+
+void
+mem_pages_begin(void)
+{
+	if (!mem_pages_mode()) return;
+	if (!mem_pages_shared) {
+		mem_pages_shared = (mem_pages_t*)mmap(NULL, sizeof(mem_pages_t),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, 
+			-1, 0);
+		if (mem_pages_shared == (mem_pages_t*)MAP_FAILED) {
+			mem_pages_shared = NULL;
+			return;
+		}
+		mem_pages_probe();
+	}
+	bzero(mem_pages_shared, sizeof(mem_pages_t));
+}
+
+/*
+ * What the workers' buffers got since mem_pages_begin().  It goes in
+ * the records, and to stderr when it falls short of LMBENCH_PAGES, as
+ * thp may, so that the output itself is unchanged.  The benchmark
+ * fails when a worker could not map its buffer at all.
+ */
+char*
+mem_pages_end(void)
+{
+	static char	result[128], last[128];
+	mem_pages_t	*s = mem_pages_shared;
+	int	pct;
+
+	if (s && s->failed) exit(1);
+	if (!s || !s->bytes) return NULL;
+	pct = (int)(100. * s->huge / s->bytes + 0.5);
+	sprintf(result, "pages=%s achieved=%luK huge=%d%%", 
+		mem_pages_mode(), (unsigned long)s->pagesize / 1024, pct);
+	if ((strcmp(mem_pages_mode(), "4k") ? pct < 100 : pct > 0)
+	    && strcmp(result, last)) {
+		fprintf(stderr, "LMBENCH_PAGES=%s: got %luK pages for %d%% of the buffers\n",
+			mem_pages_mode(), (unsigned long)s->pagesize / 1024, 
+			pct);
+		strcpy(last, result);
+	}
+	return result;
+}
@@ -52,6 +52,59 @@ void tlb_cleanup(iter_t iterations, void* cookie);
 REPEAT_15(MEM_BENCHMARK_DECL)
 extern benchmp_f mem_benchmarks[];
 
+/*
+ * Stores which bypass the caches, so a line written in full is not
+ * first read for ownership, where the ISA has them (MEM_NT names
+ * them):  MEM_NT_STORE2(p, x, y) stores the doubles x and y at p,
+ * which must be 16 byte aligned, and MEM_NT_FENCE() orders them
+ * before what follows.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#include <emmintrin.h>
+#define	MEM_NT			"sse2"
+#define	MEM_NT_STORE2(p, x, y)	_mm_stream_pd((p), _mm_set_pd((y), (x)))
+#define	MEM_NT_FENCE()		_mm_sfence()
+#elif defined(__aarch64__) && defined(__GNUC__)
+#define	MEM_NT			"stnp"
+#define	MEM_NT_STORE2(p, x, y)	do {					\
+	double _x = (x), _y = (y);					\
+	__asm__ __volatile__("stnp %d0, %d1, [%2]"			\
+			     : : "w"(_x), "w"(_y), "r"(p) : "memory");	\
+} while (0)
+#define	MEM_NT_FENCE()		__asm__ __volatile__("dmb ishst" : : : "memory")
+#endif
+
+/*
+ * Zeroing a whole cache line (or block) without reading it, where the
+ * ISA has an instruction for it: MEM_ZERO_LINE(p) zeroes the
+ * mem_zero_size() bytes at p, which must be aligned to them.
+ * mem_zero_size() is 0 when the processor cannot, or may not.
+ */
+#if defined(__aarch64__) && defined(__GNUC__)
+#define	MEM_ZERO		"dc-zva"
+#define	MEM_ZERO_LINE(p)	__asm__ __volatile__("dc zva, %0"	\
+					: : "r"(p) : "memory")
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define	MEM_ZERO		"clzero"
+#define	MEM_ZERO_LINE(p)	__asm__ __volatile__(".byte 0x0f, 0x01, 0xfc" \
+					: : "a"(p) : "memory")
+#endif
+size_t	mem_zero_size(void);
+
+/*
+ * Benchmark buffers, backed by the pages LMBENCH_PAGES asks for (4k,
+ * thp, 2m or 1g), or else by valloc(3), or malloc(3) for
+ * mem_pages_malloc().  benchmp brackets its workers
+ * with mem_pages_begin() and mem_pages_end(), which returns what the
+ * workers' buffers actually got, as "pages=... achieved=... huge=...",
+ * or NULL when LMBENCH_PAGES is not set.
+ */
+void*	mem_pages_alloc(size_t size);
+void*	mem_pages_malloc(size_t size);
+void	mem_pages_free(void* p);
+void	mem_pages_begin(void);
+char*	mem_pages_end(void);
+
 ssize_t	line_find(size_t l, int warmup, int repetitions, struct mem_state* state);
 double	line_test(size_t l, int warmup, int repetitions, struct mem_state* state);
 double	par_mem(size_t l, int warmup, int repetitions, struct mem_state* state);
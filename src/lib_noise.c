@@ -0,0 +1,356 @@
+/*
+ * lib_noise.c - detect interference with benchmp's measurements
+ *
+ * When LMBENCH_NOISE is set, each benchmp worker takes a snapshot of
+ * the machine just before and just after every timing interval:
+ *
+ *	its own involuntary context switches and CPU time (getrusage),
+ *	the busy and steal time of its processor (/proc/stat),
+ *	the interrupts taken by its processor (/proc/interrupts),
+ *	the cpu and memory "some" and io "full" stall time (/proc/pressure).
+ *
+ * A repetition is disturbed when the worker was preempted, when other
+ * work ran on its processor for more than a tenth of the interval,
+ * when the hypervisor stole more than a hundredth of it, when the
+ * processor took more than NOISE_IRQ_RATE interrupts a second, or
+ * when tasks stalled for more than a tenth of it.  Other work
+ * includes the benchmark's own helper processes (e.g. lat_pipe's
+ * writer) when they share the worker's processor.
+ *
+ * LMBENCH_NOISE=flag (or 1) counts the disturbed repetitions and
+ * their causes, which benchmp prints and LMBENCH_RECORD records;
+ * LMBENCH_NOISE=discard also retakes them, up to once per repetition,
+ * so that a noisy host produces fewer, not false, results.
+ *
+ * The snapshots are taken outside the timed intervals, but they do
+ * read /proc, which disturbs the caches a little between intervals.
+ * The files are held open, and what cannot be read (no PSI, not
+ * Linux) is left out.
+ */
+#include "bench.h"
+
+/* #define _DEBUG */
+
+#if defined(__linux__) && !defined(RUSAGE_THREAD)
+#define	RUSAGE_THREAD	1
+#endif
+
+#define	NOISE_IRQ_RATE	20000	/* interrupts per second */
+#define	NOISE_BUFSIZE	(256 * 1024)
+
+#define	NOISE_STAT	0
+#define	NOISE_INTERRUPTS 1
+#define	NOISE_PSI_CPU	2
+#define	NOISE_PSI_MEMORY 3
+#define	NOISE_PSI_IO	4
+#define	NOISE_FILES	5
+
+static char	*noise_names[NOISE_KINDS] = {
+	"preempt", "load", "steal", "irq", "pressure"
+};
+
+static char	*noise_files[NOISE_FILES] = {
+	"/proc/stat", "/proc/interrupts", "/proc/pressure/cpu",
+	"/proc/pressure/memory", "/proc/pressure/io"
+};
+
+/* what a snapshot could see, by NOISE_* kind */
+typedef struct {
+	int	valid;
+	int	cpu;
+	long	nivcsw;
+	uint64	own_us;		/* our user and system time */
+	uint64	busy;		/* ticks our processor was busy */
+	uint64	steal;		/* and had stolen */
+	uint64	irqs;		/* interrupts on our processor */
+	uint64	stall_us;	/* PSI stall time */
+} noise_snap_t;
+
+static LMBENCH_TLS noise_t*	noise = NULL;
+static LMBENCH_TLS noise_snap_t	noise_before;
+static LMBENCH_TLS int		noise_fd[NOISE_FILES] = { -2, -2, -2, -2, -2 };
+static LMBENCH_TLS char*	noise_buf = NULL;
+
+int
+noise_enabled(void)
+{
+	static int	enabled = -1;
+	char		*s;
+
+	if (enabled < 0) {
+		enabled = 0;
+		s = getenv("LMBENCH_NOISE");
+		if (s && *s && strcmp(s, "0") && strcasecmp(s, "NO"))
+			enabled = NOISE_FLAG;
+		if (s && !strcasecmp(s, "DISCARD"))
+			enabled = NOISE_DISCARD;
+	}
+	return (enabled);
+}
+
+/* read one of the files into noise_buf, or return 0 */
+static int
+noise_read(int file)
+{
+	int	n;
+
+	if (!noise_buf && !(noise_buf = (char*)malloc(NOISE_BUFSIZE)))
+		return (0);
+	if (noise_fd[file] == -2)
+		noise_fd[file] = open(noise_files[file], O_RDONLY);
+	if (noise_fd[file] < 0)
+		return (0);
+	n = pread(noise_fd[file], noise_buf, NOISE_BUFSIZE - 1, 0);
+	if (n <= 0)
+		return (0);
+	noise_buf[n] = 0;
+	return (1);
+}
+
+/* the "cpu<N>" line of /proc/stat */
+static int
+noise_stat(int cpu, noise_snap_t* s)
+{
+	int		i;
+	char		*p, name[32];
+	uint64		v[8];
+
+	if (cpu < 0 || !noise_read(NOISE_STAT))
+		return (0);
+	sprintf(name, "\ncpu%d ", cpu);
+	if (!(p = strstr(noise_buf, name)))
+		return (0);
+	p += strlen(name);
+	/* user nice system idle iowait irq softirq steal */
+	for (i = 0; i < 8; ++i)
+		v[i] = strtoull(p, &p, 10);
+	s->busy = v[0] + v[1] + v[2] + v[5] + v[6];
+	s->steal = v[7];
+	return (1);
+}
+
+/* the column for processor cpu of /proc/interrupts, summed */
+static int
+noise_interrupts(int cpu, noise_snap_t* s)
+{
+	int		i, col;
+	size_t		n;
+	char		*p, *e, *line, *next, name[32];
+	uint64		v = 0;
+
+	if (cpu < 0 || !noise_read(NOISE_INTERRUPTS))
+		return (0);
+	if (!(next = strchr(noise_buf, '\n')))
+		return (0);
+	*next++ = 0;
+	sprintf(name, "CPU%d", cpu);
+	/* not strtok(), the worker threads parse this at the same time */
+	for (col = 0, p = noise_buf; *(p += strspn(p, " \t")); p += n, ++col) {
+		n = strcspn(p, " \t");
+		if (n == strlen(name) && !strncmp(p, name, n)) break;
+	}
+	if (!*p) return (0);
+
+	s->irqs = 0;
+	for (line = next; line && *line; line = next) {
+		if ((next = strchr(line, '\n')) == NULL)
+			break;		/* truncated */
+		*next++ = 0;
+		if (!(p = strchr(line, ':')))
+			continue;
+		for (i = 0, ++p; i <= col; ++i, p = e) {
+			v = strtoull(p, &e, 10);
+			if (e == p) break;
+		}
+		if (i > col)
+			s->irqs += v;
+	}
+	return (1);
+}
+
+/* the total= of the "some" or "full" line of a PSI file */
+static int
+noise_psi(int file, char* which, uint64* total)
+{
+	char	*p;
+
+	if (!noise_read(file))
+		return (0);
+	if (!(p = strstr(noise_buf, which)) || !(p = strstr(p, "total=")))
+		return (0);
+	*total += strtoull(p + strlen("total="), NULL, 10);
+	return (1);
+}
+
+static void
+noise_snapshot(noise_snap_t* s)
+{
+	struct rusage	ru;
+
+	bzero((void*)s, sizeof(*s));
+	s->cpu = sched_cpu();
+	/* the calling thread, which is the worker even in thread mode */
+#ifdef RUSAGE_THREAD
+	if (getrusage(RUSAGE_THREAD, &ru) == 0) {
+#else
+	if (getrusage(RUSAGE_SELF, &ru) == 0) {
+#endif
+		s->nivcsw = ru.ru_nivcsw;
+		s->own_us = ru.ru_utime.tv_sec * 1000000 + ru.ru_utime.tv_usec
+			  + ru.ru_stime.tv_sec * 1000000 + ru.ru_stime.tv_usec;
+		s->valid |= (1 << NOISE_PREEMPT);
+	}
+	if (noise_stat(s->cpu, s)) {
+		s->valid |= (1 << NOISE_LOAD) | (1 << NOISE_STEAL);
+		if (!(s->valid & (1 << NOISE_PREEMPT)))
+			s->valid &= ~(1 << NOISE_LOAD);
+	}
+	if (noise_interrupts(s->cpu, s))
+		s->valid |= (1 << NOISE_IRQ);
+	if (noise_psi(NOISE_PSI_CPU, "some", &s->stall_us)
+	    + noise_psi(NOISE_PSI_MEMORY, "some", &s->stall_us)
+	    + noise_psi(NOISE_PSI_IO, "full", &s->stall_us) == 3)
+		s->valid |= (1 << NOISE_PRESSURE);
+}
+
+/* just before a timing interval */
+void
+noise_begin(void)
+{
+	noise_snapshot(&noise_before);
+}
+
+/*
+ * Just after a timing interval of ns nanoseconds: returns the
+ * NOISE_* kinds of interference seen during it, as a bitmask.
+ */
+int
+noise_end(uint64 ns)
+{
+	int		mask = 0;
+	double		us = ns / 1000., tick, other;
+	noise_snap_t	after;
+	noise_snap_t*	b = &noise_before;
+
+	noise_snapshot(&after);
+	after.valid &= b->valid;
+	tick = 1000000. / sysconf(_SC_CLK_TCK);
+
+	if ((after.valid & (1 << NOISE_PREEMPT)) && after.nivcsw > b->nivcsw)
+		mask |= (1 << NOISE_PREEMPT);
+	/* the per-processor counts mean nothing if we migrated */
+	if (after.cpu == b->cpu) {
+		if (after.valid & (1 << NOISE_LOAD)) {
+			other = (after.busy - b->busy) * tick
+				- (double)(after.own_us - b->own_us);
+			if (other > 0.1 * us && other > 2 * tick)
+				mask |= (1 << NOISE_LOAD);
+		}
+		if ((after.valid & (1 << NOISE_STEAL))
+		    && (after.steal - b->steal) * tick > 0.01 * us)
+			mask |= (1 << NOISE_STEAL);
+		if ((after.valid & (1 << NOISE_IRQ)) && us > 0.
+		    && after.irqs - b->irqs > 20
+		    && (after.irqs - b->irqs) * 1000000. / us > NOISE_IRQ_RATE)
+			mask |= (1 << NOISE_IRQ);
+	}
+	if ((after.valid & (1 << NOISE_PRESSURE))
+	    && after.stall_us - b->stall_us > 0.1 * us)
+		mask |= (1 << NOISE_PRESSURE);
+#ifdef _DEBUG
+	fprintf(stderr, "noise_end(%llu): cpu=%d->%d nivcsw=%ld busy=%llu steal=%llu irqs=%llu stall=%llu mask=%x\n", (unsigned long long)ns, b->cpu, after.cpu, after.nivcsw - b->nivcsw, (unsigned long long)(after.busy - b->busy), (unsigned long long)(after.steal - b->steal), (unsigned long long)(after.irqs - b->irqs), (unsigned long long)(after.stall_us - b->stall_us), mask);
+#endif
+	return (mask);
+}
+
+/* count a checked repetition in n */
+void
+noise_save(noise_t *n, int mask, int discarded)
+{
+	int	i;
+
+	n->repetitions++;
+	if (!mask) return;
+	n->noisy++;
+	if (discarded) n->discarded++;
+	for (i = 0; i < NOISE_KINDS; ++i) {
+		if (mask & (1 << i))
+			n->count[i]++;
+	}
+}
+
+void
+noise_init(noise_t *n)
+{
+	bzero((void*)n, sizeof(*n));
+}
+
+void
+noise_merge(noise_t *dst, noise_t *src)
+{
+	int	i;
+
+	dst->repetitions += src->repetitions;
+	dst->noisy += src->noisy;
+	dst->discarded += src->discarded;
+	for (i = 0; i < NOISE_KINDS; ++i)
+		dst->count[i] += src->count[i];
+}
+
+char*
+noise_name(int kind)
+{
+	return (noise_names[kind]);
+}
+
+noise_t*
+get_noise()
+{
+	return (noise);
+}
+
+void
+set_noise(noise_t *n)
+{
+	noise = n;
+}
+
+/* "repetitions=11 noisy=2 discarded=0 preempt=2 load=0 ..." */
+char*
+noise_string(noise_t *n)
+{
+	int		i;
+	static char	buf[256];
+
+	sprintf(buf, "repetitions=%d noisy=%d discarded=%d",
+		n->repetitions, n->noisy, n->discarded);
+	for (i = 0; i < NOISE_KINDS; ++i)
+		sprintf(buf + strlen(buf), " %s=%d", noise_names[i], n->count[i]);
+	return (buf);
+}
+
+/*
+ * Prints how many of the last benchmp's repetitions were disturbed,
+ * and by what, when any were.
+ */
+void
+print_noise(void)
+{
+	int	i;
+	char	*sep = "";
+	noise_t	*n = get_noise();
+
+	if (!n || !n->noisy) return;
+	fprintf(stderr, "noise: %d of %d repetitions disturbed (",
+		n->noisy, n->repetitions);
+	for (i = 0; i < NOISE_KINDS; ++i) {
+		if (n->count[i]) {
+			fprintf(stderr, "%s%s=%d", sep, noise_names[i], n->count[i]);
+			sep = " ";
+		}
+	}
+	fprintf(stderr, ")");
+	if (n->discarded)
+		fprintf(stderr, ", %d retaken", n->discarded);
+	fprintf(stderr, "\n");
+}
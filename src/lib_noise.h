@@ -0,0 +1,37 @@
+#ifndef _LIB_NOISE_H
+#define _LIB_NOISE_H
+
+/*
+ * Interference detection around benchmp's timing intervals,
+ * enabled with LMBENCH_NOISE.  See lib_noise.c.
+ */
+#define	NOISE_PREEMPT	0	/* involuntary context switches */
+#define	NOISE_LOAD	1	/* other work on our processor */
+#define	NOISE_STEAL	2	/* time stolen by the hypervisor */
+#define	NOISE_IRQ	3	/* interrupt storm on our processor */
+#define	NOISE_PRESSURE	4	/* cpu, memory or io stalls (PSI) */
+#define	NOISE_KINDS	5
+
+#define	NOISE_FLAG	1	/* annotate noisy repetitions */
+#define	NOISE_DISCARD	2	/* and retake them */
+
+typedef struct {
+	int	repetitions;		/* repetitions checked */
+	int	noisy;			/* of which were disturbed */
+	int	discarded;		/* and were retaken */
+	int	count[NOISE_KINDS];	/* repetitions disturbed by each */
+} noise_t;
+
+int	noise_enabled(void);
+void	noise_begin(void);
+int	noise_end(uint64 ns);
+void	noise_save(noise_t *n, int mask, int discarded);
+void	noise_init(noise_t *n);
+void	noise_merge(noise_t *dst, noise_t *src);
+void	set_noise(noise_t *n);
+noise_t* get_noise();
+char*	noise_name(int kind);
+char*	noise_string(noise_t *n);
+void	print_noise(void);
+
+#endif /* _LIB_NOISE_H */
@@ -0,0 +1,262 @@
+/*
+ * lib_perf.c - hardware performance counters for benchmp
+ *
+ * When LMBENCH_PERF is set, each benchmp worker opens a group of
+ * counters (cycles, instructions, cache misses, dTLB load misses,
+ * branch misses and context switches) with perf_event_open(2).
+ * The group is enabled just before start(0) and disabled just after
+ * stop(0,0) for each timing interval, and the counts from intervals
+ * which produced a result are accumulated and sent back to the
+ * parent with the results.  print_perf() then reports them per
+ * operation.
+ *
+ * Counters which cannot be opened (no PMU under a VM, a restrictive
+ * perf_event_paranoid, a non-Linux system) are simply left out.
+ * If the kernel may not be counted, only user space is counted.
+ */
+#include "bench.h"
+
+/* #define _DEBUG */
+
+#ifdef HAVE_PERF_EVENT
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+static char	*perf_names[PERF_EVENTS] = {
+	"cycles", "instructions", "cache-misses",
+	"dTLB-load-misses", "branch-misses", "context-switches"
+};
+
+static LMBENCH_TLS perf_t* perf = NULL;
+
+int
+perf_enabled(void)
+{
+	static int	enabled = -1;
+	char		*s;
+
+	if (enabled < 0) {
+		s = getenv("LMBENCH_PERF");
+		enabled = (s && *s && strcmp(s, "0") && strcasecmp(s, "NO"));
+	}
+	return (enabled);
+}
+
+#ifdef HAVE_PERF_EVENT
+static struct {
+	unsigned int	type;
+	uint64		config;
+} perf_events[PERF_EVENTS] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB
+			      | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+			      | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES }
+};
+
+static LMBENCH_TLS int	perf_leader = -1;
+static LMBENCH_TLS int	perf_nopen;
+static LMBENCH_TLS int	perf_valid;
+static LMBENCH_TLS int	perf_fd[PERF_EVENTS];
+static LMBENCH_TLS int	perf_order[PERF_EVENTS];	/* group slot -> event */
+static LMBENCH_TLS int	perf_last_ok;
+static LMBENCH_TLS uint64 perf_last[PERF_EVENTS];
+
+static int
+perf_event_open(struct perf_event_attr *attr, int group)
+{
+	return (int)syscall(SYS_perf_event_open, attr, 0, -1, group, 0);
+}
+#endif /* HAVE_PERF_EVENT */
+
+/*
+ * Open the counters for the calling process (or thread).
+ * Returns the number of counters which could be opened.
+ */
+int
+perf_open(void)
+{
+	static int	warned = 0;
+#ifdef HAVE_PERF_EVENT
+	int		i, fd;
+	struct perf_event_attr attr;
+
+	perf_leader = -1;
+	perf_nopen = 0;
+	perf_valid = 0;
+	perf_last_ok = 0;
+	if (!perf_enabled()) return (0);
+
+	for (i = 0; i < PERF_EVENTS; ++i) {
+		bzero((void*)&attr, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = perf_events[i].type;
+		attr.config = perf_events[i].config;
+		/* the rest of the group follows the leader */
+		attr.disabled = (perf_leader < 0);
+		attr.read_format = PERF_FORMAT_GROUP
+			| PERF_FORMAT_TOTAL_TIME_ENABLED
+			| PERF_FORMAT_TOTAL_TIME_RUNNING;
+		fd = perf_event_open(&attr, perf_leader);
+		if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+			/* we may not count the kernel, so count the user */
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fd = perf_event_open(&attr, perf_leader);
+		}
+		if (fd < 0) {
+#ifdef _DEBUG
+			fprintf(stderr, "perf_open: %s: %s\n",
+				perf_names[i], strerror(errno));
+#endif
+			continue;
+		}
+		if (perf_leader < 0) perf_leader = fd;
+		perf_fd[perf_nopen] = fd;
+		perf_order[perf_nopen++] = i;
+		perf_valid |= (1 << i);
+	}
+	if (perf_nopen) return (perf_nopen);
+#endif /* HAVE_PERF_EVENT */
+	if (perf_enabled() && !warned) {
+		fprintf(stderr, "LMBENCH_PERF: no performance counters available\n");
+		warned = 1;
+	}
+	return (0);
+}
+
+void
+perf_close(void)
+{
+#ifdef HAVE_PERF_EVENT
+	int	i;
+
+	for (i = 0; i < perf_nopen; ++i)
+		close(perf_fd[i]);
+	perf_nopen = 0;
+	perf_leader = -1;
+#endif
+}
+
+void
+perf_start(void)
+{
+#ifdef HAVE_PERF_EVENT
+	if (perf_leader < 0) return;
+	ioctl(perf_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(perf_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+void
+perf_stop(void)
+{
+#ifdef HAVE_PERF_EVENT
+	int	i;
+	uint64	buf[3 + PERF_EVENTS];	/* nr, enabled, running, values */
+	double	scale = 1.;
+
+	if (perf_leader < 0) return;
+	ioctl(perf_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+	perf_last_ok = 0;
+	if (read(perf_leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64))
+	    || buf[0] != perf_nopen || buf[2] == 0)
+		return;
+
+	/* the PMU was shared with someone else, so extrapolate */
+	if (buf[2] < buf[1])
+		scale = (double)buf[1] / (double)buf[2];
+	for (i = 0; i < perf_nopen; ++i)
+		perf_last[perf_order[i]] = (uint64)(buf[3 + i] * scale);
+	perf_last_ok = 1;
+#endif
+}
+
+/* add the counts from the last interval to p */
+void
+perf_save(perf_t *p, uint64 iterations)
+{
+#ifdef HAVE_PERF_EVENT
+	int	i;
+
+	if (!perf_last_ok) return;
+	for (i = 0; i < PERF_EVENTS; ++i) {
+		if (perf_valid & (1 << i))
+			p->count[i] += perf_last[i];
+	}
+	p->valid = perf_valid;
+	p->iterations += iterations;
+#endif
+}
+
+void
+perf_init(perf_t *p)
+{
+	bzero((void*)p, sizeof(*p));
+}
+
+void
+perf_merge(perf_t *dst, perf_t *src)
+{
+	int	i;
+
+	if (src->iterations == 0) return;
+	/* only report what every worker could count */
+	dst->valid = (dst->iterations ? dst->valid & src->valid : src->valid);
+	for (i = 0; i < PERF_EVENTS; ++i)
+		dst->count[i] += src->count[i];
+	dst->iterations += src->iterations;
+}
+
+perf_t*
+get_perf()
+{
+	return (perf);
+}
+
+void
+set_perf(perf_t *p)
+{
+	perf = p;
+}
+
+/*
+ * Prints the counters recorded with LMBENCH_PERF, per operation.
+ *
+ * ops - operations per iteration
+ */
+void
+print_perf(char* s, double ops)
+{
+	print_perf_per(s, ops, "op");
+}
+
+/*
+ * Likewise, per unit of work other than an operation.
+ *
+ * n - units per iteration
+ * unit - what they are, e.g. "byte"
+ */
+void
+print_perf_per(char* s, double n, char* unit)
+{
+	int	i;
+	perf_t*	p = get_perf();
+
+	if (!p || !p->iterations || !p->valid) return;
+	n = p->iterations * (n > 0. ? n : 1.);
+	fprintf(stderr, "%s perf:", s);
+	for (i = 0; i < PERF_EVENTS; ++i) {
+		if (p->valid & (1 << i))
+			fprintf(stderr, " %s=%.4g", perf_names[i], p->count[i] / n);
+	}
+	if ((p->valid & 3) == 3 && p->count[0])
+		fprintf(stderr, " ipc=%.2f", p->count[1] / (double)p->count[0]);
+	fprintf(stderr, " per %s\n", unit);
+}
@@ -0,0 +1,29 @@
+#ifndef _LIB_PERF_H
+#define _LIB_PERF_H
+
+/*
+ * Hardware performance counters around benchmp's timing intervals,
+ * enabled with LMBENCH_PERF.  See lib_perf.c.
+ */
+#define	PERF_EVENTS	6
+
+typedef struct {
+	uint64	iterations;		/* timed iterations counted */
+	int	valid;			/* bitmask of working counters */
+	uint64	count[PERF_EVENTS];
+} perf_t;
+
+int	perf_enabled(void);
+int	perf_open(void);
+void	perf_close(void);
+void	perf_start(void);
+void	perf_stop(void);
+void	perf_save(perf_t *p, uint64 iterations);
+void	perf_init(perf_t *p);
+void	perf_merge(perf_t *dst, perf_t *src);
+void	set_perf(perf_t *p);
+perf_t*	get_perf();
+void	print_perf(char* s, double ops);
+void	print_perf_per(char* s, double n, char* unit);
+
+#endif /* _LIB_PERF_H */
@@ -0,0 +1,612 @@
+/*
+ * lib_record.c - machine-readable result records
+ *
+ * When LMBENCH_RECORD is set to "json" or "csv", every result printed
+ * through micro(), nano(), bandwidth() and friends (and by benchmarks
+ * which format their own results) is also written as one record:
+ * a JSON object per line, or a CSV row under a header line.  Each
+ * record carries the benchmark, its command line, the measurement's
+ * name, parameters, value and units, the benchmp parameters, every
+ * raw sample from get_results() and statistics derived from them,
+ * with the interference counts of LMBENCH_NOISE and the run mode of
+ * LMBENCH_REALTIME when those are set.
+ *
+ * Every record is stamped with the time it was written, so that
+ * repeated runs (see lmbench_mc -m) make a time series.
+ *
+ * Records go to LMBENCH_RECORD_FILE, which is appended to, or to
+ * stderr mixed in with the usual output.  A LMBENCH_RECORD_FILE of
+ * unix:<path> sends them to the local socket at path instead, a
+ * stream socket or else a datagram one, a record per line.
+ *
+ * LMBENCH_RECORD may also name a metrics sink, which publishes each
+ * result as a gauge labelled with the benchmark, its name, params and
+ * size, the parallelism and the scheduling policy.  Times are given
+ * in seconds and bandwidths in bytes a second, anything else as is.
+ *
+ *	prometheus	the text exposition format, kept in a .prom file
+ *			per benchmark command line in the node_exporter
+ *			textfile directory LMBENCH_RECORD_FILE (rewritten
+ *			by rename, so never seen half written), or
+ *			written to stderr
+ *	statsd		a datagram per result, with DogStatsD tags, to
+ *			the agent at LMBENCH_RECORD_FILE (host:port,
+ *			default localhost:8125)
+ */
+#include "bench.h"
+
+/* #define _DEBUG */
+
+static struct {
+	int	enough;
+	int	parallel;
+	int	warmup;
+	int	repetitions;
+} record_params = { 0, 1, 0, 0 };
+
+static FILE	*frecord = NULL;
+static char	record_command[1024];
+static char	record_run_mode[512];
+
+static char	*record_csv_header = "benchmark,name,params,value,units,"
+	"parallel,warmup,repetitions,enough,"
+	"n,min,median,mean,max,stddev,p50,p99,p99.9,samples,noise,mode,time,"
+	"command\n";
+
+int
+record_format(void)
+{
+	static int	format = -1;
+	char		*s;
+
+	if (format < 0) {
+		format = RECORD_NONE;
+		s = getenv("LMBENCH_RECORD");
+		if (s && !strcasecmp(s, "json")) format = RECORD_JSON;
+		if (s && !strcasecmp(s, "csv")) format = RECORD_CSV;
+		if (s && !strcasecmp(s, "prometheus"))
+			format = RECORD_PROMETHEUS;
+		if (s && !strcasecmp(s, "statsd")) format = RECORD_STATSD;
+	}
+	return (format);
+}
+
+/* benchmp() reports the parameters of each run */
+void
+record_benchmp(int enough, int parallel, int warmup, int repetitions)
+{
+	record_params.enough = enough;
+	record_params.parallel = parallel;
+	record_params.warmup = warmup;
+	record_params.repetitions = repetitions;
+}
+
+/* the repetitions actually taken, when benchmp chose how many */
+void
+record_repetitions(int repetitions)
+{
+	record_params.repetitions = repetitions;
+}
+
+/*
+ * How the run was set up, e.g. by sched_realtime(), as "key=value ..."
+ */
+void
+record_mode(char* mode)
+{
+	record_run_mode[0] = 0;
+	if (mode)
+		strncpy(record_run_mode, mode, sizeof(record_run_mode) - 1);
+}
+
+/*
+ * Add to the run mode what was learned while running, e.g. the pages
+ * mem_pages_end() saw.
+ */
+void
+record_mode_add(char* mode)
+{
+	size_t	n = strlen(record_run_mode);
+
+	if (!mode || !*mode) return;
+	snprintf(record_run_mode + n, sizeof(record_run_mode) - n, 
+		 "%s%s", n ? " " : "", mode);
+}
+
+/*
+ * Name the command line for the records, when /proc/self/cmdline
+ * would not (e.g. a benchmark run inside lmbench_mc).
+ */
+void
+record_args(int ac, char **av)
+{
+	int	i;
+	size_t	len = 0;
+
+	record_command[0] = 0;
+	for (i = 0; i < ac; ++i) {
+		if (len + strlen(av[i]) + 2 > sizeof(record_command))
+			break;
+		if (i) record_command[len++] = ' ';
+		strcpy(record_command + len, av[i]);
+		len += strlen(av[i]);
+	}
+}
+
+/*
+ * The command line being run, also used to key the timing cache.
+ */
+char*
+record_cmdline(void)
+{
+#ifdef __linux__
+	int	fd, i, n;
+
+	if (record_command[0]) return (record_command);
+	if ((fd = open("/proc/self/cmdline", O_RDONLY)) < 0)
+		return (record_command);
+	n = read(fd, record_command, sizeof(record_command) - 1);
+	close(fd);
+	if (n <= 0) n = 0;
+	for (i = 0; i < n; ++i) {
+		if (!record_command[i]) record_command[i] = ' ';
+	}
+	while (n > 0 && record_command[n-1] == ' ') --n;
+	record_command[n] = 0;
+#endif
+	return (record_command);
+}
+
+static char*
+record_benchmark(void)
+{
+	static char	name[128];
+	char		*s, *e;
+
+	record_cmdline();
+	if (!(e = strchr(record_command, ' ')))
+		e = record_command + strlen(record_command);
+	for (s = e; s > record_command && s[-1] != '/'; --s)
+		;
+	if (e - s >= sizeof(name)) e = s + sizeof(name) - 1;
+	strncpy(name, s, e - s);
+	name[e - s] = 0;
+	return (name);
+}
+
+/*
+ * connect to the socket at path, a stream one or else a datagram one
+ */
+static FILE*
+record_socket(char *path)
+{
+	int			sock, err;
+	struct sockaddr_un	s;
+	FILE			*f;
+
+	if (strlen(path) >= sizeof(s.sun_path)) {
+		fprintf(stderr, "%s: path too long\n", path);
+		return (NULL);
+	}
+	bzero((void*)&s, sizeof(s));
+	s.sun_family = AF_UNIX;
+	strcpy(s.sun_path, path);
+	if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0
+	    && connect(sock, (struct sockaddr*)&s, sizeof(s)) < 0) {
+		err = errno;
+		close(sock);
+		sock = -1;
+		if (err == EPROTOTYPE
+		    && (sock = socket(AF_UNIX, SOCK_DGRAM, 0)) >= 0
+		    && connect(sock, (struct sockaddr*)&s, sizeof(s)) < 0) {
+			close(sock);
+			sock = -1;
+		}
+	}
+	if (sock < 0 || !(f = fdopen(sock, "w"))) {
+		perror(path);
+		if (sock >= 0) close(sock);
+		return (NULL);
+	}
+	/* a record per write, and a lost reader must not kill us */
+	setvbuf(f, NULL, _IOLBF, 0);
+	signal(SIGPIPE, SIG_IGN);
+	return (f);
+}
+
+static FILE*
+record_open(void)
+{
+	char	*s;
+
+	if (frecord) return (frecord);
+	s = getenv("LMBENCH_RECORD_FILE");
+	if (s && !strncmp(s, "unix:", 5)) {
+		frecord = record_socket(s + 5);
+	} else if (s && *s && !(frecord = fopen(s, "a"))) {
+		perror(s);
+	}
+	if (!frecord)
+		frecord = stderr;
+	/* one header per file, or per run on stderr or a socket */
+	if (record_format() == RECORD_CSV
+	    && (frecord == stderr || ftell(frecord) <= 0))
+		fputs(record_csv_header, frecord);
+	return (frecord);
+}
+
+/*
+ * The metric for a result in units, and what takes it to base units.
+ */
+static char*
+record_metric(char *units, double *scale)
+{
+	*scale = 1.;
+	if (!units) return ("lmbench_result");
+	if (!strcmp(units, "nanoseconds")) {
+		*scale = 1.0e-9;
+	} else if (!strcmp(units, "microseconds")) {
+		*scale = 1.0e-6;
+	} else if (!strcmp(units, "milliseconds")) {
+		*scale = 1.0e-3;
+	} else if (strcmp(units, "seconds")) {
+		if (!strcmp(units, "MB/sec") || !strcmp(units, "MB/s")) {
+			*scale = 1.0e6;
+		} else if (!strcmp(units, "KB/sec")) {
+			*scale = 1.0e3;
+		} else if (!strcmp(units, "GB/sec")) {
+			*scale = 1.0e9;
+		} else {
+			return ("lmbench_result");
+		}
+		return ("lmbench_bandwidth_bytes_per_second");
+	}
+	return ("lmbench_latency_seconds");
+}
+
+/*
+ * The labels of a metric, as name, value pairs ending in NULL.  The
+ * size is the size= of params, if any; the scheduling policy is
+ * LMBENCH_SCHED's, and realtime the policy of LMBENCH_REALTIME.
+ */
+static char**
+record_labels(char *name, char *params, char *units, char *metric)
+{
+	static char	parallel[16], size[64], sched[64], realtime[64];
+	static char	*labels[20];
+	char		*s;
+	int		i = 0, n;
+
+	sprintf(parallel, "%d", record_params.parallel);
+	size[0] = 0;
+	if (params && (s = strstr(params, "size=")) != NULL
+	    && (s == params || s[-1] == ' ')) {
+		s += strlen("size=");
+		n = strcspn(s, " ");
+		if (n >= sizeof(size)) n = sizeof(size) - 1;
+		strncpy(size, s, n);
+		size[n] = 0;
+	}
+	s = getenv("LMBENCH_SCHED");
+	sprintf(sched, "%.63s", s && *s ? s : "DEFAULT");
+	strcpy(realtime, "none");
+	if ((s = strstr(record_run_mode, "realtime=")) != NULL) {
+		s += strlen("realtime=");
+		n = strcspn(s, " ");
+		sprintf(realtime, "%.*s", n > 63 ? 63 : n, s);
+	}
+
+	labels[i++] = "benchmark"; labels[i++] = record_benchmark();
+	labels[i++] = "name"; labels[i++] = name ? name : "";
+	labels[i++] = "params"; labels[i++] = params ? params : "";
+	labels[i++] = "size"; labels[i++] = size;
+	labels[i++] = "parallel"; labels[i++] = parallel;
+	labels[i++] = "sched"; labels[i++] = sched;
+	labels[i++] = "realtime"; labels[i++] = realtime;
+	if (!strcmp(metric, "lmbench_result")) {
+		labels[i++] = "units"; labels[i++] = units ? units : "";
+	}
+	labels[i] = NULL;
+	return (labels);
+}
+
+/* a Prometheus sample line, kept until the file is rewritten */
+static char	**record_prom = NULL;
+static int	record_nprom = 0;
+
+/*
+ * Rewrite the benchmark's .prom file with every sample so far, the
+ * newest of each series.  node_exporter reads the whole directory,
+ * so each command line gets its own file, and it must not see a
+ * partial one.
+ */
+static void
+record_prometheus(char *name, char *params, double value, char *units)
+{
+	int		i, j, len;
+	unsigned int	hash = 5381;
+	double		scale;
+	char		*metric, *p, *s, **l;
+	char		line[4096], path[1024], tmp[1100];
+	char		*dir = getenv("LMBENCH_RECORD_FILE");
+	FILE		*f;
+
+	metric = record_metric(units, &scale);
+	l = record_labels(name, params, units, metric);
+	len = sprintf(line, "%s{", metric);
+	for (i = 0; l[i]; i += 2) {
+		len += sprintf(line + len, "%s%s=\"", i ? "," : "", l[i]);
+		for (s = l[i+1]; *s && len < sizeof(line) - 64; ++s) {
+			if (*s == '\\' || *s == '"') line[len++] = '\\';
+			line[len++] = *s == '\n' ? ' ' : *s;
+		}
+		line[len++] = '"';
+	}
+	line[len++] = '}';
+	/* same series: replace the sample */
+	for (i = 0; i < record_nprom; ++i) {
+		if (!strncmp(record_prom[i], line, len)
+		    && record_prom[i][len] == ' ')
+			break;
+	}
+	sprintf(line + len, " %.6g\n", value * scale);
+	if (i == record_nprom) {
+		l = (char**)realloc(record_prom, (i + 1) * sizeof(char*));
+		if (!l) return;
+		record_prom = l;
+		record_prom[record_nprom++] = NULL;
+	}
+	if (record_prom[i]) free(record_prom[i]);
+	if (!(record_prom[i] = strdup(line))) return;
+
+	if (!dir || !*dir) {
+		fputs(record_prom[i], stderr);
+		return;
+	}
+	for (p = record_cmdline(); *p; ++p)
+		hash = hash * 33 + (unsigned char)*p;
+	sprintf(path, "%.900s/lmbench_%.64s_%08x.prom",
+		dir, record_benchmark(), hash);
+	sprintf(tmp, "%s.%d", path, (int)getpid());
+	if (!(f = fopen(tmp, "w"))) {
+		perror(tmp);
+		return;
+	}
+	/*
+	 * The samples of a metric must follow its one TYPE line, but
+	 * record_prom is in the order the results came, so write each
+	 * metric's samples where it first appears.
+	 */
+	for (i = 0; i < record_nprom; ++i) {
+		len = strcspn(record_prom[i], "{");
+		for (j = 0; j < i; ++j) {
+			if (!strncmp(record_prom[j], record_prom[i], len + 1))
+				break;
+		}
+		if (j < i) continue;
+		fprintf(f, "# TYPE %.*s gauge\n", len, record_prom[i]);
+		for (j = i; j < record_nprom; ++j) {
+			if (!strncmp(record_prom[j], record_prom[i], len + 1))
+				fputs(record_prom[j], f);
+		}
+	}
+	if (fclose(f) || rename(tmp, path) < 0) {
+		perror(path);
+		unlink(tmp);
+	}
+}
+
+/*
+ * Send a gauge to the statsd agent, e.g.
+ * lmbench.latency_seconds:1.2e-07|g|#benchmark:lat_syscall,...
+ * Tag values keep only characters that are safe in every agent.
+ */
+static void
+record_statsd(char *name, char *params, double value, char *units)
+{
+	static int		sock = -2;
+	static struct sockaddr_in	addr;
+	struct hostent		*h;
+	int			i, len;
+	double			scale;
+	char			*metric, *s, **l;
+	char			host[256], buf[2048];
+	char			*port;
+
+	if (sock == -2) {
+		s = getenv("LMBENCH_RECORD_FILE");
+		sprintf(host, "%.255s", s && *s ? s : "localhost:8125");
+		if ((port = strrchr(host, ':')) != NULL) *port++ = 0;
+		sock = -1;
+		bzero((void*)&addr, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port ? atoi(port) : 8125);
+		if (!(h = gethostbyname(host))) {
+			fprintf(stderr, "%s: unknown host\n", host);
+			return;
+		}
+		bcopy((void*)h->h_addr, (void*)&addr.sin_addr, h->h_length);
+		if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+			perror("socket");
+	}
+	if (sock < 0) return;
+
+	metric = record_metric(units, &scale);
+	l = record_labels(name, params, units, metric);
+	len = sprintf(buf, "lmbench.%s:%.6g|g|#",
+		      metric + strlen("lmbench_"), value * scale);
+	for (i = 0; l[i]; i += 2) {
+		if (!*l[i+1]) continue;
+		len += sprintf(buf + len, "%s%s:", buf[len-1] != '#' ? "," : "", l[i]);
+		for (s = l[i+1]; *s && len < sizeof(buf) - 64; ++s) {
+			buf[len++] = (isalnum((unsigned char)*s)
+				      || strchr("_-./=", *s)) ? *s : '_';
+		}
+	}
+	/* fire and forget, there may be no agent */
+	sendto(sock, buf, len, 0, (struct sockaddr*)&addr, sizeof(addr));
+}
+
+/*
+ * quote s as a JSON string, or as a CSV field
+ */
+static void
+record_string(FILE *f, char *s)
+{
+	int	json = (record_format() == RECORD_JSON);
+
+	putc('"', f);
+	for (; s && *s; ++s) {
+		if (*s == '"') {
+			fputs(json ? "\\\"" : "\"\"", f);
+		} else if (json && *s == '\\') {
+			fputs("\\\\", f);
+		} else if ((unsigned char)*s < ' ') {
+			if (json) fprintf(f, "\\u%04x", *s);
+			else putc(' ', f);
+		} else {
+			putc(*s, f);
+		}
+	}
+	putc('"', f);
+}
+
+/*
+ * Write one record.
+ *
+ * name - what was measured, e.g. "Pipe latency"
+ * params - the measurement's parameters as "key=value ...", or NULL
+ * value, units - the reported result
+ *
+ * The samples and statistics are the raw nanoseconds per iteration
+ * from the last benchmp(), whatever the reported units.
+ */
+void
+record(char* name, char* params, double value, char* units)
+{
+	int		i, N;
+	double		t, sum = 0., sum2 = 0., mean = 0., sd = 0.;
+	double		min = 0., median = 0., max = 0.;
+	double		p50 = 0., p99 = 0., p999 = 0.;
+	FILE		*f;
+	result_t	*r = get_results();
+	histogram_t	*h = get_histogram();
+	noise_t		*z = get_noise();
+	struct timeval	now;
+
+	switch (record_format()) {
+	case RECORD_NONE:
+		return;
+	case RECORD_PROMETHEUS:
+		record_prometheus(name, params, value, units);
+		return;
+	case RECORD_STATSD:
+		record_statsd(name, params, value, units);
+		return;
+	}
+	f = record_open();
+	gettimeofday(&now, NULL);
+
+	N = r ? r->N : 0;
+	for (i = 0; i < N; ++i) {
+		t = r->v[i].u / (double)r->v[i].n;
+		sum += t;
+		sum2 += t * t;
+	}
+	if (N > 0) {
+		/* sorted from largest to smallest */
+		max = r->v[0].u / (double)r->v[0].n;
+		min = r->v[N-1].u / (double)r->v[N-1].n;
+		median = r->v[N/2].u / (double)r->v[N/2].n;
+		if (N % 2 == 0) {
+			median += r->v[N/2-1].u / (double)r->v[N/2-1].n;
+			median /= 2.;
+		}
+		mean = sum / N;
+		if (N > 1 && sum2 / N > mean * mean)
+			sd = sqrt((sum2 - N * mean * mean) / (N - 1));
+	}
+	if (h && h->count) {
+		p50 = hist_percentile(h, 0.50);
+		p99 = hist_percentile(h, 0.99);
+		p999 = hist_percentile(h, 0.999);
+	}
+
+	if (record_format() == RECORD_JSON) {
+		fprintf(f, "{\"benchmark\":");
+		record_string(f, record_benchmark());
+		fprintf(f, ",\"name\":");
+		record_string(f, name);
+		fprintf(f, ",\"params\":");
+		record_string(f, params);
+		fprintf(f, ",\"value\":%.6g,\"units\":", value);
+		record_string(f, units);
+		fprintf(f, ",\"parallel\":%d,\"warmup\":%d"
+			",\"repetitions\":%d,\"enough\":%d",
+			record_params.parallel, record_params.warmup,
+			record_params.repetitions, record_params.enough);
+		fprintf(f, ",\"stats\":{\"n\":%d,\"min\":%.6g,\"median\":%.6g"
+			",\"mean\":%.6g,\"max\":%.6g,\"stddev\":%.6g",
+			N, min, median, mean, max, sd);
+		if (h && h->count)
+			fprintf(f, ",\"p50\":%.6g,\"p99\":%.6g,\"p99.9\":%.6g",
+				p50, p99, p999);
+		fprintf(f, "},\"samples\":[");
+		for (i = 0; i < N; ++i) {
+			fprintf(f, "%s{\"ns\":%llu,\"n\":%llu}", i ? "," : "",
+				(unsigned long long)r->v[i].u,
+				(unsigned long long)r->v[i].n);
+		}
+		fprintf(f, "]");
+		if (z) {
+			fprintf(f, ",\"noise\":{\"repetitions\":%d"
+				",\"noisy\":%d,\"discarded\":%d",
+				z->repetitions, z->noisy, z->discarded);
+			for (i = 0; i < NOISE_KINDS; ++i)
+				fprintf(f, ",\"%s\":%d", 
+					noise_name(i), z->count[i]);
+			fprintf(f, "}");
+		}
+		if (record_run_mode[0]) {
+			fprintf(f, ",\"mode\":");
+			record_string(f, record_run_mode);
+		}
+		fprintf(f, ",\"time\":%ld.%03ld,\"command\":",
+			(long)now.tv_sec, (long)now.tv_usec / 1000);
+		record_string(f, record_command);
+		fprintf(f, "}\n");
+	} else {
+		record_string(f, record_benchmark());
+		putc(',', f);
+		record_string(f, name);
+		putc(',', f);
+		record_string(f, params);
+		fprintf(f, ",%.6g,", value);
+		record_string(f, units);
+		fprintf(f, ",%d,%d,%d,%d",
+			record_params.parallel, record_params.warmup,
+			record_params.repetitions, record_params.enough);
+		fprintf(f, ",%d,%.6g,%.6g,%.6g,%.6g,%.6g",
+			N, min, median, mean, max, sd);
+		if (h && h->count) {
+			fprintf(f, ",%.6g,%.6g,%.6g", p50, p99, p999);
+		} else {
+			fprintf(f, ",,,");
+		}
+		/* samples as "ns/n" pairs separated by spaces */
+		fprintf(f, ",\"");
+		for (i = 0; i < N; ++i) {
+			fprintf(f, "%s%llu/%llu", i ? " " : "",
+				(unsigned long long)r->v[i].u,
+				(unsigned long long)r->v[i].n);
+		}
+		fprintf(f, "\",");
+		record_string(f, z ? noise_string(z) : NULL);
+		putc(',', f);
+		record_string(f, record_run_mode);
+		fprintf(f, ",%ld.%03ld,", (long)now.tv_sec, (long)now.tv_usec / 1000);
+		record_string(f, record_command);
+		putc('\n', f);
+	}
+	fflush(f);
+}
@@ -0,0 +1,23 @@
+#ifndef _LIB_RECORD_H
+#define _LIB_RECORD_H
+
+/*
+ * Machine-readable result records, enabled with LMBENCH_RECORD.
+ * See lib_record.c.
+ */
+#define	RECORD_NONE	0
+#define	RECORD_JSON	1
+#define	RECORD_CSV	2
+#define	RECORD_PROMETHEUS 3	/* metrics sinks */
+#define	RECORD_STATSD	4
+
+int	record_format(void);
+void	record_args(int ac, char **av);
+char*	record_cmdline(void);
+void	record_mode(char* mode);
+void	record_mode_add(char* mode);
+void	record_benchmp(int enough, int parallel, int warmup, int repetitions);
+void	record_repetitions(int repetitions);
+void	record(char* name, char* params, double value, char* units);
+
+#endif /* _LIB_RECORD_H */
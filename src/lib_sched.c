@@ -25,10 +25,68 @@
 #include <sched.h>
 #endif
 
+#if defined(HAVE_SET_MEMPOLICY)
+#include <sys/syscall.h>
+#ifndef MPOL_BIND
+#define	MPOL_BIND	2
+#endif
+#ifndef MPOL_MF_STRICT
+#define	MPOL_MF_STRICT	(1<<0)
+#define	MPOL_MF_MOVE	(1<<1)
+#endif
+#endif
+
+#if defined(_POSIX_PRIORITY_SCHEDULING) && !defined(HAVE_SCHED_SETAFFINITY)
+#include <sched.h>
+#endif
+
+#if defined(_POSIX_MEMLOCK)
+#include <sys/mman.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include <dirent.h>
+
 extern int custom(char* str, int cpu);
 extern int reverse_bits(int cpu);
 extern int sched_ncpus();
+extern int sched_cpu();
 extern int sched_pin(int cpu);
+extern int sched_topology(int policy, int childno, int benchproc, 
+			  int nbenchprocs);
+extern int sched_bind_memory(int cpu);
+extern int sched_nodes(int* nodes, int max, int memory);
+extern int sched_node_cpu(int node);
+extern int sched_node_cpus(int node, int* cpus, int max);
+extern int sched_mbind(void* addr, size_t len, int node);
+extern int sched_realtime_policy();
+extern char* sched_realtime(int parallel);
+extern char* sched_realtime_end();
+extern int sched_lock_memory();
+
+static int sched_isolated(int slot);
+static int sched_pin_id(int id);
+static int sched_node(int id);
+static int sched_bind_node(int node);
+static int sched_realtime_worker();
+
+/*
+ * Topology-aware placement policies, see sched_topology()
+ */
+#define	TOPO_CORES	0	/* one worker per physical core */
+#define	TOPO_SMT	1	/* SMT siblings of each core together */
+#define	TOPO_NODES	2	/* workers round-robin over NUMA nodes */
+#define	TOPO_NODE_FILL	3	/* fill a node's cores, then its siblings */
+
+/*
+ * Real-time isolation mode, see sched_realtime()
+ */
+#define	RT_NONE		0
+#define	RT_FIFO		1	/* SCHED_FIFO */
+#define	RT_DEADLINE	2	/* SCHED_DEADLINE, else SCHED_FIFO */
 
 /*
  * The interface used by benchmp.
@@ -48,9 +106,13 @@ handle_scheduler(int childno, int benchproc, int nbenchprocs)
 	int	cpu = 0;
 	char*	sched = getenv("LMBENCH_SCHED");
 	
+	/* real-time runs default to the isolated processors */
+	if (!sched && sched_realtime_policy() != RT_NONE)
+		sched = "ISOLATED";
+
 	if (!sched || strcasecmp(sched, "DEFAULT") == 0) {
 		/* do nothing.  Allow scheduler to control placement */
-		return 0;
+		return sched_realtime_worker();
 	} else if (strcasecmp(sched, "SINGLE") == 0) {
 		/* assign all processes to CPU 0 */
 		cpu = 0;
@@ -89,34 +151,80 @@ handle_scheduler(int childno, int benchproc, int nbenchprocs)
 	} else if (strncasecmp(sched, "CUSTOM_SPREAD ", strlen("CUSTOM_SPREAD ")) == 0) {
 		cpu = custom(sched + strlen("CUSTOM_SPREAD"), 
 			     childno * (nbenchprocs + 1) + benchproc);
+	} else if (strcasecmp(sched, "CORES") == 0) {
+		cpu = sched_topology(TOPO_CORES, 
+				     childno, benchproc, nbenchprocs);
+	} else if (strcasecmp(sched, "SMT") == 0) {
+		cpu = sched_topology(TOPO_SMT, 
+				     childno, benchproc, nbenchprocs);
+	} else if (strcasecmp(sched, "NODES") == 0) {
+		cpu = sched_topology(TOPO_NODES, 
+				     childno, benchproc, nbenchprocs);
+	} else if (strcasecmp(sched, "NODE_FILL") == 0) {
+		cpu = sched_topology(TOPO_NODE_FILL, 
+				     childno, benchproc, nbenchprocs);
+	} else if (strcasecmp(sched, "ISOLATED") == 0) {
+		/*
+		 * assign each benchmark process and each child process
+		 * to its own isolated processor, as listed by the
+		 * kernel in /sys/devices/system/cpu/isolated (or 
+		 * nohz_full).  These are usually outside our affinity
+		 * mask, so they are pinned by id rather than through
+		 * sched_pin().
+		 */
+		cpu = sched_isolated(childno * (nbenchprocs + 1) + benchproc);
+		if (cpu >= 0) {
+			if (sched_pin_id(cpu) < 0)
+				return -1;
+			if (sched_bind_node(sched_node(cpu)) < 0)
+				return -1;
+			return sched_realtime_worker();
+		}
+		/* no isolated processors: one processor each */
+		cpu = childno * (nbenchprocs + 1) + benchproc;
 	} else {
 		/* default action: do nothing */
-		return 0;
+		return sched_realtime_worker();
 	}
 
-	return sched_pin(cpu % sched_ncpus());
+	cpu %= sched_ncpus();
+	if (sched_pin(cpu) < 0)
+		return -1;
+
+	/* and allocate memory from the processor's own node */
+	if (sched_bind_memory(cpu) < 0)
+		return -1;
+	return sched_realtime_worker();
 }
 
 /*
  * Use to get sequentially created processes "far" away from
  * each other in an SMP.
  *
- * XXX: probably doesn't work for NCPUS not a power of two.
+ * With NCPUS not a power of two, the bit-reversed numbers which
+ * are not CPUs are skipped, so the first NCPUS processes still get
+ * distinct CPUs.
  */
 int
 reverse_bits(int cpu)
 {
-	int	i;
+	int	i, j, n;
 	int	nbits;
-	int	max = sched_ncpus() - 1;
-	int	cpu_reverse = 0;
+	int	ncpus = sched_ncpus();
+	int	max = ncpus - 1;
+	int	cpu_reverse;
 
 	for (i = max>>1, nbits = 1; i > 0; i >>= 1, nbits++)
 	  ;
-	/* now reverse the bits */
-	for (i = 0; i < nbits; i++) {
-		if (cpu & (1<<i))
-			cpu_reverse |= (1<<(nbits-i-1));
+	cpu %= ncpus;
+	for (j = 0, n = 0; j < (1 << nbits); ++j) {
+		/* reverse the bits */
+		for (i = 0, cpu_reverse = 0; i < nbits; i++) {
+			if (j & (1<<i))
+				cpu_reverse |= (1<<(nbits-i-1));
+		}
+		if (cpu_reverse < ncpus && n++ == cpu)
+			break;
 	}
 	return cpu_reverse;
 }
@@ -169,6 +277,21 @@ sched_ncpus()
 #endif
 }
 
+/*
+ * Return the CPU the caller is running on, or -1 if unknown
+ */
+int
+sched_cpu()
+{
+#if defined(HAVE_SCHED_GETCPU)
+	extern int sched_getcpu(void);
+
+	return sched_getcpu();
+#else
+	return -1;
+#endif
+}
+
 /*
  * Pin the current process to the given CPU
  *
@@ -212,7 +335,7 @@ sched_pin(int cpu)
 		for (i = 0; i < sz * 8 * sizeof(unsigned long); ++i) {
 			int	word = i / (8 * sizeof(unsigned long));
 			int	bit = i % (8 * sizeof(unsigned long));
-			if (cpumask[word] & (1 << bit)) ncpus++;
+			if (cpumask[word] & (1UL << bit)) ncpus++;
 		}
 	}
 	cpu %= ncpus;
@@ -221,9 +344,9 @@ sched_pin(int cpu)
 	for (i = 0, j = 0; i < sz * 8 * sizeof(unsigned long); ++i) {
 		int	word = i / (8 * sizeof(unsigned long));
 		int	bit = i % (8 * sizeof(unsigned long));
-		if (cpumask[word] & (1 << bit)) {
+		if (cpumask[word] & (1UL << bit)) {
 			if (j >= cpu) {
-				mask[word] |= (1 << bit);
+				mask[word] |= (1UL << bit);
 				break;
 			}
 			j++;
@@ -238,3 +361,798 @@ sched_pin(int cpu)
 #endif
 	return retval;
 }
+
+/*
+ * The processors we may run on, in the order in which sched_pin()
+ * numbers them, and where they are in the machine: NUMA node,
+ * package (socket), core and SMT thread within the core.  On Linux
+ * these come from /sys/devices/system/cpu/cpu<N>/topology and
+ * /sys/devices/system/node/node<M>/cpulist; elsewhere each
+ * processor is a core of its own on node 0.
+ */
+#define	SCHED_NODE	0
+#define	SCHED_PACKAGE	1
+#define	SCHED_CORE	2
+#define	SCHED_THREAD	3
+#define	SCHED_ID	4
+#define	SCHED_FIELDS	5
+#define	SCHED_MAXCPUS	4096
+
+typedef struct {
+	int	f[SCHED_FIELDS];
+} sched_cpu_t;
+
+static sched_cpu_t*	sched_cpus = NULL;
+static int		sched_n = 0;
+static int		sched_nnodes = 1;
+
+/* how each policy orders the processors, see sched_topology() */
+static int	sched_keys[][SCHED_FIELDS] = {
+	/* TOPO_CORES */	{ SCHED_NODE, SCHED_PACKAGE, SCHED_CORE, -1 },
+	/* TOPO_SMT */		{ SCHED_NODE, SCHED_PACKAGE, SCHED_CORE, 
+				  SCHED_THREAD, -1 },
+	/* TOPO_NODES */	{ SCHED_NODE, SCHED_THREAD, SCHED_PACKAGE, 
+				  SCHED_CORE, -1 },
+	/* TOPO_NODE_FILL */	{ SCHED_NODE, SCHED_THREAD, SCHED_PACKAGE, 
+				  SCHED_CORE, -1 }
+};
+static int*	sched_key;
+
+static int
+sched_read(char* path, char* buf, int len)
+{
+	int	fd, n;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return 0;
+	n = read(fd, buf, len - 1);
+	close(fd);
+	if (n <= 0)
+		return 0;
+	buf[n] = 0;
+	return 1;
+}
+
+static int
+sched_read_int(char* path, int def)
+{
+	char	buf[64];
+
+	if (!sched_read(path, buf, sizeof(buf)))
+		return def;
+	return atoi(buf);
+}
+
+/* is cpu in a list such as "0-3,8-11"? */
+static int
+sched_cpulist(char* s, int cpu)
+{
+	int	lo, hi;
+
+	while (*s && isdigit(*s)) {
+		lo = hi = strtol(s, &s, 10);
+		if (*s == '-')
+			hi = strtol(s + 1, &s, 10);
+		if (lo <= cpu && cpu <= hi)
+			return 1;
+		if (*s == ',') s++;
+	}
+	return 0;
+}
+
+static void
+sched_load_topology()
+{
+	int		i, j, node, *nodes;
+	int		ids[SCHED_MAXCPUS];
+	char		path[256];
+	char		buf[4096];
+	DIR*		dir;
+	struct dirent*	d;
+	sched_cpu_t*	c;
+#if defined(HAVE_SCHED_SETAFFINITY)
+	unsigned long	mask[SCHED_MAXCPUS / (8 * sizeof(unsigned long))];
+#endif
+
+	sched_n = 0;
+#if defined(HAVE_SCHED_SETAFFINITY)
+	if (sched_getaffinity(0, sizeof(mask), mask) == 0) {
+		for (i = 0; i < SCHED_MAXCPUS; ++i) {
+			int	word = i / (8 * sizeof(unsigned long));
+			int	bit = i % (8 * sizeof(unsigned long));
+			if (mask[word] & (1UL << bit)) ids[sched_n++] = i;
+		}
+	}
+#endif
+	if (sched_n == 0) {
+		sched_n = sched_ncpus();
+		if (sched_n > SCHED_MAXCPUS) sched_n = SCHED_MAXCPUS;
+		for (i = 0; i < sched_n; ++i) ids[i] = i;
+	}
+
+	sched_cpus = (sched_cpu_t*)calloc(sched_n, sizeof(sched_cpu_t));
+	nodes = (int*)calloc(sched_n, sizeof(int));
+	if (!sched_cpus || !nodes) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < sched_n; ++i) {
+		c = &sched_cpus[i];
+		c->f[SCHED_ID] = ids[i];
+		sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", ids[i]);
+		c->f[SCHED_PACKAGE] = sched_read_int(path, 0);
+		sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/core_id", ids[i]);
+		c->f[SCHED_CORE] = sched_read_int(path, ids[i]);
+		c->f[SCHED_NODE] = 0;
+	}
+
+	if ((dir = opendir("/sys/devices/system/node")) != NULL) {
+		while ((d = readdir(dir)) != NULL) {
+			if (sscanf(d->d_name, "node%d", &node) != 1)
+				continue;
+			sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+			if (!sched_read(path, buf, sizeof(buf)))
+				continue;
+			for (i = 0; i < sched_n; ++i) {
+				if (sched_cpulist(buf, sched_cpus[i].f[SCHED_ID]))
+					sched_cpus[i].f[SCHED_NODE] = node;
+			}
+		}
+		closedir(dir);
+	}
+
+	/* number the SMT siblings of each core, and count the nodes */
+	sched_nnodes = 0;
+	for (i = 0; i < sched_n; ++i) {
+		c = &sched_cpus[i];
+		for (j = 0; j < i; ++j) {
+			if (sched_cpus[j].f[SCHED_PACKAGE] == c->f[SCHED_PACKAGE]
+			    && sched_cpus[j].f[SCHED_CORE] == c->f[SCHED_CORE])
+				c->f[SCHED_THREAD]++;
+		}
+		for (j = 0; j < sched_nnodes; ++j) {
+			if (nodes[j] == c->f[SCHED_NODE]) break;
+		}
+		if (j == sched_nnodes)
+			nodes[sched_nnodes++] = c->f[SCHED_NODE];
+	}
+	free(nodes);
+#ifdef _DEBUG
+	for (i = 0; i < sched_n; ++i) {
+		c = &sched_cpus[i];
+		fprintf(stderr, "sched_load_topology: %d: cpu%d node=%d package=%d core=%d thread=%d\n", i, c->f[SCHED_ID], c->f[SCHED_NODE], c->f[SCHED_PACKAGE], c->f[SCHED_CORE], c->f[SCHED_THREAD]);
+	}
+#endif /* _DEBUG */
+}
+
+static int
+sched_compare(const void* a, const void* b)
+{
+	int	i;
+	int*	x = sched_cpus[*(int*)a].f;
+	int*	y = sched_cpus[*(int*)b].f;
+
+	for (i = 0; sched_key[i] >= 0; ++i) {
+		if (x[sched_key[i]] != y[sched_key[i]])
+			return (x[sched_key[i]] - y[sched_key[i]]);
+	}
+	return (x[SCHED_ID] - y[SCHED_ID]);
+}
+
+/*
+ * Topology-aware placement: returns the processor (as numbered by
+ * sched_pin()) for this process under the given policy.
+ *
+ * TOPO_CORES puts each process on its own physical core, using
+ *	only the first SMT thread of each core.
+ * TOPO_SMT fills all the SMT threads of a core before moving on
+ *	to the next core.
+ * TOPO_NODES puts benchmark process childno on NUMA node
+ *	childno % nodes, with any child processes on the same node,
+ *	filling each node as TOPO_NODE_FILL does.
+ * TOPO_NODE_FILL uses every core of a node, then their SMT
+ *	siblings, before moving on to the next node.
+ *
+ * Processes wrap around when there are more than processors.
+ */
+int
+sched_topology(int policy, int childno, int benchproc, int nbenchprocs)
+{
+	int		i, n, first, slot;
+	static int*	orders[TOPO_NODE_FILL + 1];
+	static int	norders[TOPO_NODE_FILL + 1];
+
+	if (!sched_cpus)
+		sched_load_topology();
+	if (!orders[policy]) {
+		orders[policy] = (int*)malloc(sched_n * sizeof(int));
+		if (!orders[policy]) {
+			perror("malloc");
+			exit(1);
+		}
+		for (i = 0, n = 0; i < sched_n; ++i) {
+			if (policy == TOPO_CORES 
+			    && sched_cpus[i].f[SCHED_THREAD] != 0)
+				continue;
+			orders[policy][n++] = i;
+		}
+		sched_key = sched_keys[policy];
+		qsort(orders[policy], n, sizeof(int), sched_compare);
+		norders[policy] = n;
+	}
+
+	slot = childno * (nbenchprocs + 1) + benchproc;
+	if (policy != TOPO_NODES)
+		return orders[policy][slot % norders[policy]];
+
+	/* find the node's processors, which are together in the order */
+	slot = (childno / sched_nnodes) * (nbenchprocs + 1) + benchproc;
+	for (i = 0, n = -1, first = 0; i < norders[policy]; ++i) {
+		if (i == 0 || sched_cpus[orders[policy][i]].f[SCHED_NODE]
+			   != sched_cpus[orders[policy][i-1]].f[SCHED_NODE]) {
+			if (n == childno % sched_nnodes) break;
+			first = i;
+			n++;
+		}
+	}
+	return orders[policy][first + slot % (i - first)];
+}
+
+/*
+ * Bind the memory this process allocates from now on to the node of
+ * processor cpu (as numbered by sched_pin()), so that memory placement
+ * follows the process placement.  Nothing to do with a single node.
+ */
+int
+sched_bind_memory(int cpu)
+{
+	if (!sched_cpus)
+		sched_load_topology();
+	if (sched_nnodes <= 1)
+		return 0;
+	return sched_bind_node(sched_cpus[cpu % sched_n].f[SCHED_NODE]);
+}
+
+/*
+ * The NUMA nodes, in order: those with memory (from has_memory) when
+ * memory is set, else those with processors we may run on.  A machine
+ * without NUMA is node 0.
+ */
+int
+sched_nodes(int* nodes, int max, int memory)
+{
+	int		i, n = 0, node;
+	char		buf[4096];
+	DIR*		dir;
+	struct dirent*	d;
+
+	if (!sched_cpus)
+		sched_load_topology();
+	if (memory && !sched_read("/sys/devices/system/node/has_memory", 
+				  buf, sizeof(buf)))
+		memory = 0;
+	if ((dir = opendir("/sys/devices/system/node")) != NULL) {
+		while ((d = readdir(dir)) != NULL && n < max) {
+			if (sscanf(d->d_name, "node%d", &node) != 1)
+				continue;
+			if (memory ? !sched_cpulist(buf, node) 
+				   : sched_node_cpu(node) < 0)
+				continue;
+			for (i = n++; i > 0 && nodes[i-1] > node; --i)
+				nodes[i] = nodes[i-1];
+			nodes[i] = node;
+		}
+		closedir(dir);
+	}
+	if (n == 0 && max > 0)
+		nodes[n++] = 0;
+	return n;
+}
+
+/*
+ * A processor on node, as numbered by sched_pin(), preferring the
+ * first SMT thread of a core, or -1 if we may run on none of them.
+ */
+int
+sched_node_cpu(int node)
+{
+	int	i, cpu = -1;
+
+	if (!sched_cpus)
+		sched_load_topology();
+	for (i = 0; i < sched_n; ++i) {
+		if (sched_cpus[i].f[SCHED_NODE] != node)
+			continue;
+		if (sched_cpus[i].f[SCHED_THREAD] == 0)
+			return i;
+		if (cpu < 0)
+			cpu = i;
+	}
+	return cpu;
+}
+
+/*
+ * All the processors on node we may run on, as numbered by sched_pin(),
+ * up to max of them.  Returns how many.
+ */
+int
+sched_node_cpus(int node, int* cpus, int max)
+{
+	int	i, n = 0;
+
+	if (!sched_cpus)
+		sched_load_topology();
+	for (i = 0; i < sched_n && n < max; ++i) {
+		if (sched_cpus[i].f[SCHED_NODE] == node)
+			cpus[n++] = i;
+	}
+	return n;
+}
+
+/*
+ * Move the pages of [addr, addr + len) to node, and keep them there.
+ * Returns -1 if some could not be moved.
+ */
+int
+sched_mbind(void* addr, size_t len, int node)
+{
+#if defined(HAVE_SET_MEMPOLICY) && defined(SYS_mbind)
+	unsigned long	mask[16];
+	unsigned long	start = (unsigned long)addr & ~(getpagesize() - 1UL);
+
+	if (node < 0 || node >= 8 * sizeof(mask) - 1)
+		return -1;
+	bzero(mask, sizeof(mask));
+	mask[node / (8 * sizeof(unsigned long))] = 
+		1UL << (node % (8 * sizeof(unsigned long)));
+	len += (unsigned long)addr - start;
+	if (syscall(SYS_mbind, start, len, MPOL_BIND, mask, 8 * sizeof(mask),
+		    MPOL_MF_STRICT | MPOL_MF_MOVE) < 0) {
+		/* a kernel without NUMA has just the one node */
+		if (errno == ENOSYS && node == 0)
+			return 0;
+		perror("mbind");
+		return -1;
+	}
+	return 0;
+#else
+	return (node == 0 ? 0 : -1);
+#endif /* HAVE_SET_MEMPOLICY */
+}
+
+/* the NUMA node of processor id, or -1 if there is only one node */
+static int
+sched_node(int id)
+{
+	int		node, result = -1, nnodes = 0;
+	char		path[256];
+	char		buf[4096];
+	DIR*		dir;
+	struct dirent*	d;
+
+	if ((dir = opendir("/sys/devices/system/node")) == NULL)
+		return -1;
+	while ((d = readdir(dir)) != NULL) {
+		if (sscanf(d->d_name, "node%d", &node) != 1)
+			continue;
+		nnodes++;
+		sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+		if (sched_read(path, buf, sizeof(buf)) && sched_cpulist(buf, id))
+			result = node;
+	}
+	closedir(dir);
+	return (nnodes > 1 ? result : -1);
+}
+
+static int
+sched_bind_node(int node)
+{
+#if defined(HAVE_SET_MEMPOLICY)
+	unsigned long	mask[16];
+
+	if (node < 0)
+		return 0;
+	if (node >= 8 * sizeof(mask) - 1)
+		return -1;
+	bzero(mask, sizeof(mask));
+	mask[node / (8 * sizeof(unsigned long))] = 
+		1UL << (node % (8 * sizeof(unsigned long)));
+	if (syscall(SYS_set_mempolicy, MPOL_BIND, mask, 8 * sizeof(mask)) < 0) {
+		perror("set_mempolicy");
+		return -1;
+	}
+#ifdef _DEBUG
+	fprintf(stderr, "sched_bind_node(%d): pid=%d\n", node, (int)getpid());
+#endif /* _DEBUG */
+#endif /* HAVE_SET_MEMPOLICY */
+	return 0;
+}
+
+/*
+ * The processors the kernel keeps free of other work, from
+ * /sys/devices/system/cpu/isolated (isolcpus=) or, failing that,
+ * /sys/devices/system/cpu/nohz_full (nohz_full=).
+ */
+static int	sched_isolated_ids[SCHED_MAXCPUS];
+static int	sched_nisolated = -1;
+static char	sched_isolated_list[256];
+static char*	sched_isolated_from = "none";
+
+static void
+sched_load_isolated()
+{
+	int	lo, hi;
+	char	*s, buf[4096];
+
+	sched_nisolated = 0;
+	if (sched_read("/sys/devices/system/cpu/isolated", buf, sizeof(buf))
+	    && isdigit(buf[0])) {
+		sched_isolated_from = "isolated";
+	} else if (sched_read("/sys/devices/system/cpu/nohz_full", 
+			      buf, sizeof(buf)) && isdigit(buf[0])) {
+		sched_isolated_from = "nohz_full";
+	} else {
+		return;
+	}
+	strncpy(sched_isolated_list, buf, sizeof(sched_isolated_list) - 1);
+	if ((s = strchr(sched_isolated_list, '\n')) != NULL) *s = 0;
+
+	for (s = buf; *s && isdigit(*s); ) {
+		lo = hi = strtol(s, &s, 10);
+		if (*s == '-')
+			hi = strtol(s + 1, &s, 10);
+		for (; lo <= hi && sched_nisolated < SCHED_MAXCPUS; ++lo)
+			sched_isolated_ids[sched_nisolated++] = lo;
+		if (*s == ',') s++;
+	}
+}
+
+/* the isolated processor id for slot, or -1 if there are none */
+static int
+sched_isolated(int slot)
+{
+	if (sched_nisolated < 0)
+		sched_load_isolated();
+	if (sched_nisolated == 0)
+		return -1;
+	return sched_isolated_ids[slot % sched_nisolated];
+}
+
+/*
+ * Pin the current process to processor id, whether or not it is 
+ * in our affinity mask.
+ */
+static int
+sched_pin_id(int id)
+{
+#if defined(HAVE_SCHED_SETAFFINITY)
+	int		retval;
+	unsigned long	mask[SCHED_MAXCPUS / (8 * sizeof(unsigned long))];
+
+	bzero(mask, sizeof(mask));
+	mask[id / (8 * sizeof(unsigned long))] = 
+		1UL << (id % (8 * sizeof(unsigned long)));
+	retval = sched_setaffinity(0, sizeof(mask), mask);
+	if (retval < 0) perror("sched_setaffinity:");
+#ifdef _DEBUG
+	fprintf(stderr, "sched_pin_id(%d): pid=%d, returning %d\n", id, (int)getpid(), retval);
+#endif /* _DEBUG */
+	return retval;
+#else
+	return sched_pin(id);
+#endif
+}
+
+/*
+ * Real-time isolation mode, set by LMBENCH_REALTIME:
+ *
+ * FIFO runs the workers under SCHED_FIFO, one priority below the
+ *	maximum.  benchmp() itself runs at the maximum, so that it 
+ *	preempts workers spinning on its processor while they wait
+ *	for it to start or stop a measurement.
+ * DEADLINE runs each worker under SCHED_DEADLINE with a 9.5ms
+ *	budget every 10ms, falling back to SCHED_FIFO where the
+ *	kernel refuses (e.g. for a worker pinned to a processor 
+ *	that is not a scheduling domain of its own).
+ *
+ * Either way the workers lock their memory after initialize()
+ * (see sched_lock_memory()), and unless LMBENCH_SCHED says 
+ * otherwise are placed on the isolated processors.  Where the
+ * policy is not permitted the run continues at normal priority.
+ */
+static int	sched_rt_applied = RT_NONE;
+static int	sched_rt_shared = 0;
+static int	*sched_rt_got = NULL;	/* workers under each RT_*, shared */
+static char	sched_rt_rest[448];
+static char	sched_rt_mode[512];
+
+static char*
+sched_rt_name(int policy)
+{
+	if (policy == RT_FIFO && sched_rt_shared)
+		return "rr";
+	return policy == RT_DEADLINE ? "deadline" :
+	       policy == RT_FIFO ? "fifo" : "none";
+}
+
+/* "realtime=<policy> [requested=<policy>] [workers=...] <rest>" */
+static char*
+sched_rt_describe(char* got, char* workers)
+{
+	char	*requested = sched_rt_name(sched_realtime_policy());
+
+	sprintf(sched_rt_mode, "realtime=%s ", got);
+	if (strcmp(got, requested))
+		sprintf(sched_rt_mode + strlen(sched_rt_mode), 
+			"requested=%s ", requested);
+	if (workers)
+		sprintf(sched_rt_mode + strlen(sched_rt_mode), 
+			"workers=%s ", workers);
+	strcat(sched_rt_mode, sched_rt_rest);
+	return sched_rt_mode;
+}
+
+int
+sched_realtime_policy()
+{
+	static int	policy = -1;
+	char*		s;
+
+	if (policy < 0) {
+		policy = RT_NONE;
+		s = getenv("LMBENCH_REALTIME");
+		if (s && (!strcasecmp(s, "FIFO") || !strcmp(s, "1")))
+			policy = RT_FIFO;
+		if (s && !strcasecmp(s, "DEADLINE"))
+			policy = RT_DEADLINE;
+	}
+	return policy;
+}
+
+/*
+ * SCHED_FIFO at priority below the maximum; returns the priority, 
+ * or -1 if not permitted.  With reset, children we fork start out
+ * under the normal policy again.  Workers sharing a processor use
+ * SCHED_RR instead: under SCHED_FIFO one spinning in warmup would 
+ * keep the others from ever getting ready.
+ */
+static int
+sched_fifo(int below, int reset)
+{
+#if defined(_POSIX_PRIORITY_SCHEDULING) && defined(SCHED_FIFO)
+	int			policy = SCHED_FIFO;
+	struct sched_param	p;
+
+#ifdef SCHED_RR
+	if (below && sched_rt_shared) policy = SCHED_RR;
+#endif
+#ifdef SCHED_RESET_ON_FORK
+	if (reset) policy |= SCHED_RESET_ON_FORK;
+#endif
+	bzero(&p, sizeof(p));
+	p.sched_priority = sched_get_priority_max(SCHED_FIFO) - below;
+	if (sched_setscheduler(0, policy, &p) < 0)
+		return -1;
+	return p.sched_priority;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static int
+sched_deadline()
+{
+#if defined(__linux__) && defined(SYS_sched_setattr)
+	struct {
+		unsigned int	size;
+		unsigned int	policy;
+		uint64		flags;
+		int		nice;
+		unsigned int	priority;
+		uint64		runtime;
+		uint64		deadline;
+		uint64		period;
+	} attr;
+
+	bzero(&attr, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.policy = 6;	/* SCHED_DEADLINE */
+	attr.flags = 1;		/* SCHED_FLAG_RESET_ON_FORK */
+	attr.runtime = 9500000;
+	attr.deadline = attr.period = 10000000;
+	return syscall(SYS_sched_setattr, 0, &attr, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* the governors of the processors we will run on, e.g. "performance" */
+static void
+sched_governor(char* governors, int len)
+{
+	int	i, n, id;
+	char	*s, path[256], buf[64];
+
+	if (sched_nisolated < 0)
+		sched_load_isolated();
+	if (!sched_cpus)
+		sched_load_topology();
+	governors[0] = 0;
+	n = sched_nisolated > 0 ? sched_nisolated : sched_n;
+	for (i = 0; i < n; ++i) {
+		id = sched_nisolated > 0 ? sched_isolated_ids[i]
+					 : sched_cpus[i].f[SCHED_ID];
+		sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", id);
+		if (!sched_read(path, buf, sizeof(buf)))
+			continue;
+		if ((s = strchr(buf, '\n')) != NULL) *s = 0;
+		if (strstr(governors, buf) 
+		    || strlen(governors) + strlen(buf) + 2 > len)
+			continue;
+		if (governors[0]) strcat(governors, ",");
+		strcat(governors, buf);
+	}
+	if (!governors[0])
+		strcpy(governors, "unknown");
+}
+
+/*
+ * Called by benchmp() before it creates any workers: puts this 
+ * process under the real-time policy, checks that the workers may 
+ * have it, checks the processors' frequency governors, and returns
+ * a description of the run mode for the results, or NULL when
+ * LMBENCH_REALTIME is not set.
+ */
+char*
+sched_realtime(int parallel)
+{
+	int		prio = -1;
+	char		governors[128];
+	char		mlock[64];
+	static char	*result = NULL;
+#if defined(_POSIX_MEMLOCK) && defined(RLIMIT_MEMLOCK)
+	struct rlimit	rl;
+#endif
+
+	if (sched_realtime_policy() == RT_NONE)
+		return NULL;
+	if (sched_nisolated < 0)
+		sched_load_isolated();
+	sched_rt_shared = (parallel > (sched_nisolated > 0 ? sched_nisolated 
+							  : sched_ncpus()));
+	if (!sched_rt_got) {
+		sched_rt_got = (int*)mmap(NULL, 3 * sizeof(int), 
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, 
+			-1, 0);
+		if (sched_rt_got == (int*)MAP_FAILED)
+			sched_rt_got = NULL;
+	}
+	if (sched_rt_got)
+		bzero(sched_rt_got, 3 * sizeof(int));
+	if (result)
+		return (result = sched_rt_describe(
+				 sched_rt_name(sched_rt_applied), NULL));
+
+	/* see whether the workers' policy is permitted, on ourselves */
+	if (sched_realtime_policy() == RT_DEADLINE) {
+		if (sched_deadline() == 0) {
+			sched_rt_applied = RT_DEADLINE;
+		} else {
+			fprintf(stderr, "realtime: SCHED_DEADLINE: %s, trying SCHED_FIFO\n", strerror(errno));
+		}
+	}
+	if (sched_fifo(0, 1) >= 0) {
+		if (sched_rt_applied == RT_NONE) {
+			sched_rt_applied = RT_FIFO;
+			prio = sched_get_priority_max(SCHED_FIFO) - 1;
+		}
+	} else if (sched_rt_applied == RT_NONE) {
+		fprintf(stderr, "realtime: SCHED_FIFO: %s, running at normal priority\n", strerror(errno));
+	}
+
+	sched_governor(governors, sizeof(governors));
+	if (strcmp(governors, "performance") && strcmp(governors, "unknown"))
+		fprintf(stderr, "realtime: CPU frequency governor is %s, not performance\n", governors);
+	if (sched_nisolated == 0)
+		fprintf(stderr, "realtime: no isolated CPUs (isolcpus= or nohz_full=)\n");
+
+	strcpy(mlock, "unknown");
+#if defined(_POSIX_MEMLOCK) && defined(RLIMIT_MEMLOCK)
+	if (geteuid() == 0 || (getrlimit(RLIMIT_MEMLOCK, &rl) == 0 
+			       && rl.rlim_cur == RLIM_INFINITY)) {
+		strcpy(mlock, "unlimited");
+	} else if (getrlimit(RLIMIT_MEMLOCK, &rl) == 0) {
+		sprintf(mlock, "%lluK", (unsigned long long)rl.rlim_cur / 1024);
+	}
+#endif
+
+	sched_rt_rest[0] = 0;
+	if (prio >= 0)
+		sprintf(sched_rt_rest, "priority=%d ", prio);
+	sprintf(sched_rt_rest + strlen(sched_rt_rest), 
+		"cpus=%s%s%s governor=%s mlock=%s",
+		sched_isolated_from, sched_nisolated > 0 ? ":" : "",
+		sched_isolated_list, governors, mlock);
+	result = sched_rt_describe(sched_rt_name(sched_rt_applied), NULL);
+	fprintf(stderr, "realtime: %s\n", result);
+	return (result);
+}
+
+/*
+ * Called by benchmp() once its workers are done: the run mode again,
+ * with the policy the workers actually got, which may fall short of
+ * the one sched_realtime() found for itself (a pinned worker is
+ * usually refused SCHED_DEADLINE), and how many got each.  Warns the
+ * first time any worker fell short.
+ */
+char*
+sched_realtime_end()
+{
+	int		i, n = 0, kinds = 0, got = RT_NONE;
+	char		workers[64];
+	static int	warned = 0;
+
+	if (sched_realtime_policy() == RT_NONE || !sched_rt_got)
+		return NULL;
+	for (i = RT_NONE; i <= RT_DEADLINE; ++i) {
+		if (!sched_rt_got[i]) continue;
+		n += sched_rt_got[i];
+		kinds++;
+		got = i;
+	}
+	if (n == 0)
+		return sched_rt_describe(sched_rt_name(sched_rt_applied), NULL);
+	sprintf(workers, "deadline:%d,%s:%d,none:%d", 
+		sched_rt_got[RT_DEADLINE], sched_rt_name(RT_FIFO),
+		sched_rt_got[RT_FIFO], sched_rt_got[RT_NONE]);
+	if (n > sched_rt_got[sched_rt_applied] && !warned++) {
+		fprintf(stderr, "realtime: %d of %d workers fell back to a lesser policy (%s)\n",
+			n - sched_rt_got[sched_rt_applied], n, workers);
+	}
+	return sched_rt_describe(kinds > 1 ? "mixed" : sched_rt_name(got), 
+				 workers);
+}
+
+/*
+ * Each worker, once placed, takes the real-time policy: it does not
+ * survive fork(), so that other processes the benchmark forks run
+ * under the normal policy unless they ask with handle_scheduler().
+ * What it got is counted for sched_realtime_end().
+ */
+static int
+sched_realtime_worker()
+{
+	int	got = RT_NONE;
+
+	if (sched_rt_applied == RT_NONE)
+		return 0;
+	if (sched_rt_applied == RT_DEADLINE && sched_deadline() == 0)
+		got = RT_DEADLINE;
+	else if (sched_fifo(1, 1) >= 0)
+		got = RT_FIFO;
+	if (sched_rt_got)
+		__sync_fetch_and_add(&sched_rt_got[got], 1);
+	return 0;
+}
+
+/*
+ * Lock the worker's memory, including the buffers initialize() has
+ * just set up, so that no page faults land in the measurements.
+ */
+int
+sched_lock_memory()
+{
+	static int	warned = 0;
+
+	if (sched_realtime_policy() == RT_NONE)
+		return 0;
+#if defined(_POSIX_MEMLOCK)
+	if (mlockall(MCL_CURRENT) == 0)
+		return 0;
+	if (!warned++)
+		perror("realtime: mlockall");
+#endif
+	return -1;
+}
@@ -28,22 +28,30 @@
 #define	MB	(1000*1000.0)
 #define	KB	(1000.0)
 
-static struct timeval 	start_tv, stop_tv;
 FILE			*ftiming;
 static volatile uint64	use_result_dummy;
-static		uint64	iterations;
+static LMBENCH_TLS	uint64	iterations;
 static		void	init_timing(void);
 
 #if defined(hpux) || defined(__hpux)
 #include <sys/mman.h>
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#ifdef HAVE_FUTEX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
 #ifdef	RUSAGE
 #include <sys/resource.h>
 #define	SECS(tv)	(tv.tv_sec + tv.tv_usec / 1000000.0)
 #define	mine(f)		(int)(ru_stop.f - ru_start.f)
 
-static struct rusage ru_start, ru_stop;
+static LMBENCH_TLS struct rusage ru_start, ru_stop;
 
 void
 rusage(void)
@@ -131,7 +139,8 @@ benchmp_child(benchmp_f initialize,
 	      iter_t iterations,
 	      int repetitions,
 	      int enough,
-	      void* cookie
+	      void* cookie,
+	      void* ctl
 	      );
 void
 benchmp_parent(int response, 
@@ -149,6 +158,566 @@ benchmp_parent(int response,
 int
 sizeof_result(int repetitions);
 
+/*
+ * The benchmp control block.
+ *
+ * The parent and its workers run a simple protocol: each worker
+ * says it is 'ready', the parent says 'start', each worker says it
+ * is 'done', the parent asks for 'results', and finally tells the
+ * workers to 'exit'.  Originally this was done with a byte at a
+ * time over four pipes, with the parent polling them with select()
+ * and collecting each child's results in turn.  At large -P that
+ * makes for a lot of start skew and a long serial harvest.
+ *
+ * Instead the signals are counters in a shared anonymous mapping,
+ * followed by one result_t slot per worker.  Waiters sleep on the
+ * counters with futex(2) where available, so all of the workers are
+ * released from the start barrier by a single wakeup, and they all
+ * copy their results into their slots at once, which the parent
+ * then reads directly.  If the mapping cannot be made, benchmp falls
+ * back to the pipes.
+ *
+ * The same control block drives the thread execution mode: with
+ * LMBENCH_THREADS set, benchmp runs its workers as threads in this
+ * process instead of forking children.  Only benchmarks which have
+ * registered their cookie size with benchmp_thread_cookie() run as
+ * threads, since each worker needs its own copy of the cookie.
+ * Anything the benchmark itself keeps in static storage must be
+ * LMBENCH_TLS as well.
+ */
+typedef enum { sig_ready, sig_start, sig_done, sig_results, 
+	       sig_reported, sig_exit, sig_abort, sig_max } benchmp_signal;
+
+#if defined(HAVE_ATOMIC) && (defined(MAP_ANONYMOUS) || defined(MAP_ANON))
+#define	BENCHMP_CTL
+#ifndef MAP_ANONYMOUS
+#define	MAP_ANONYMOUS	MAP_ANON
+#endif
+
+/* keep the counters and each result slot on their own cache lines */
+#define	CTL_ALIGN	128
+
+typedef struct {
+	volatile int	count[sig_max];
+	int		threads;	/* workers are threads */
+	int		warmup;		/* parent's warmup period */
+	size_t		h_offset;	/* of the histogram in a slot, or 0 */
+	size_t		p_offset;	/* of the perf counters, or 0 */
+	size_t		n_offset;	/* of the noise counts, or 0 */
+	size_t		r_size;		/* bytes per result slot */
+	size_t		size;		/* of the whole mapping */
+} benchmp_ctl;
+
+#define	benchmp_ctl_slot(ctl, i)					\
+	((result_t*)((char*)(ctl) + CTL_ALIGN + (i) * (ctl)->r_size))
+#define	benchmp_ctl_hist(ctl, i)					\
+	((histogram_t*)((char*)benchmp_ctl_slot(ctl, i) + (ctl)->h_offset))
+#define	benchmp_ctl_perf(ctl, i)					\
+	((perf_t*)((char*)benchmp_ctl_slot(ctl, i) + (ctl)->p_offset))
+#define	benchmp_ctl_noise(ctl, i)					\
+	((noise_t*)((char*)benchmp_ctl_slot(ctl, i) + (ctl)->n_offset))
+
+static benchmp_ctl* benchmp_ctl_alloc(int parallel, int repetitions, 
+				      int warmup, int threads);
+static void	benchmp_ctl_free(benchmp_ctl* ctl);
+static int	benchmp_ctl_parent(benchmp_ctl* ctl, int parallel,
+				   int warmup, int repetitions);
+#endif /* BENCHMP_CTL */
+
+#if defined(HAVE_PTHREAD) && defined(BENCHMP_CTL)
+#define	BENCHMP_THREADS
+
+typedef struct {
+	benchmp_f	initialize;
+	benchmp_f	benchmark;
+	benchmp_f	cleanup;
+	int		childid;
+	int		enough;
+	iter_t		iterations;
+	iter_t		n;
+	int		parallel;
+	int		repetitions;
+	void*		cookie;
+	benchmp_ctl*	ctl;
+	uint64		spawn;		/* see benchmp_spawn_ns */
+} benchmp_thread_arg;
+
+static int
+benchmp_threads(benchmp_f initialize, 
+		benchmp_f benchmark,
+		benchmp_f cleanup,
+		int enough, 
+		int parallel,
+		iter_t iterations,
+		int warmup,
+		int repetitions,
+		void* cookie);
+#endif /* BENCHMP_THREADS */
+
+static size_t	benchmp_cookie_size = 0;
+
+void
+benchmp_thread_cookie(size_t size)
+{
+	benchmp_cookie_size = size;
+}
+
+static int
+benchmp_use_threads(void* cookie)
+{
+	static int	warned = 0;
+	char		*s = getenv("LMBENCH_THREADS");
+
+	if (!s || !*s || !strcmp(s, "0") || !strcasecmp(s, "NO"))
+		return 0;
+#ifdef BENCHMP_THREADS
+	if (!cookie || benchmp_cookie_size)
+		return 1;
+#endif
+	if (!warned) {
+		fprintf(stderr, "LMBENCH_THREADS: %s, using processes\n",
+#ifdef BENCHMP_THREADS
+			"benchmark has no thread support"
+#else
+			"no pthread support"
+#endif
+			);
+		warned = 1;
+	}
+	return 0;
+}
+
+/*
+ * With LMBENCH_CI set to a relative precision, such as 0.01, benchmp
+ * calls which leave the number of repetitions up to benchmp keep
+ * taking samples until the 95% confidence interval of the median,
+ * estimated with the bootstrap, is within that fraction of the
+ * median.  Each worker decides for itself, after at least CI_MIN
+ * samples, and gives up after LMBENCH_CI_MAX samples or once
+ * LMBENCH_CI_BUDGET seconds have passed.  Quiet benchmarks finish
+ * early, and noisy ones get more samples than TRIES.
+ */
+#define	CI_MIN		5
+
+static double	benchmp_ci_target = 0.;	/* of the running benchmp */
+static uint64	benchmp_ci_budget = 0;	/* nanoseconds */
+
+/* returns the most samples to take, or 0 if LMBENCH_CI is not set */
+static int
+benchmp_ci(void)
+{
+	static int	max = -1;
+	static double	target, budget;
+	char		*s;
+
+	if (max < 0) {
+		max = 0;
+		s = getenv("LMBENCH_CI");
+		if (s && (target = atof(s)) > 0.) {
+			max = 100;
+			if ((s = getenv("LMBENCH_CI_MAX")) && atoi(s) > 0)
+				max = atoi(s);
+			if (max < CI_MIN) max = CI_MIN;
+			budget = 10.;
+			if ((s = getenv("LMBENCH_CI_BUDGET")) && atof(s) > 0.)
+				budget = atof(s);
+		}
+	}
+	benchmp_ci_target = max ? target : 0.;
+	benchmp_ci_budget = (uint64)(budget * 1000000000.);
+	return (max);
+}
+
+/*
+ * Parallelism sweeps: with -P 1..8, -P pow2 (1, 2, 4, ... up to the
+ * number of processors) or -P pow2..N, the benchmark's benchmp calls
+ * run once for each level of parallelism in turn, and report the
+ * median latency per worker, the throughput of all the workers and
+ * the scaling efficiency (throughput relative to the single worker
+ * throughput times the parallelism) for each.  The iteration count
+ * is calibrated once, by the first level, rather than again by the
+ * baseline run of each parallel level.  The results left behind
+ * are those of the last level, the one the benchmark was told.
+ */
+#define	SWEEP_MAX	64
+
+static int	sweep_levels[SWEEP_MAX];
+static int	sweep_n = 0;
+static int	sweep_active = 0;
+static iter_t	sweep_iterations = 0;	/* calibrated by the first level */
+static double	sweep_base = 0.;	/* ns per iteration with one worker */
+
+int
+benchmp_parallel(char* s)
+{
+	int	lo, hi, p;
+	char	*e;
+
+	sweep_n = 0;
+	if (!strncmp(s, "pow2", 4)) {
+		hi = sched_ncpus();
+		if (!strncmp(s + 4, "..", 2)) {
+			hi = atoi(s + 6);
+		} else if (s[4]) {
+			return (0);
+		}
+		if (hi <= 0) return (0);
+		for (p = 1; p < hi && sweep_n < SWEEP_MAX - 1; p *= 2)
+			sweep_levels[sweep_n++] = p;
+		sweep_levels[sweep_n++] = hi;
+	} else if ((e = strstr(s, "..")) != NULL) {
+		lo = atoi(s);
+		hi = atoi(e + 2);
+		if (lo <= 0 || hi < lo || hi - lo >= SWEEP_MAX) return (0);
+		for (p = lo; p <= hi; ++p)
+			sweep_levels[sweep_n++] = p;
+	} else {
+		return (atoi(s));
+	}
+	p = sweep_levels[sweep_n - 1];
+	if (sweep_n == 1) sweep_n = 0;
+	return (p);
+}
+
+/* iterations per worker for a parallel run, from the baseline results */
+static iter_t
+benchmp_baseline(int enough)
+{
+	iter_t	iterations = get_n();
+
+	/* calculate iterations for 1sec runtime */
+	if (enough < SHORT) {
+		double tmp = (double)SHORT * (double)get_n();
+		tmp /= (double)gettime();
+		iterations = (iter_t)tmp + 1;
+	}
+	return (iterations);
+}
+
+static void
+benchmp_sweep(benchmp_f initialize, 
+	      benchmp_f benchmark,
+	      benchmp_f cleanup,
+	      int enough, 
+	      int warmup,
+	      int repetitions,
+	      void* cookie)
+{
+	int	i, p;
+	double	t, throughput, efficiency;
+	char	params[64];
+
+	sweep_active = 1;
+	sweep_iterations = 0;
+	sweep_base = 0.;
+	for (i = 0; i < sweep_n; ++i) {
+		p = sweep_levels[i];
+		benchmp(initialize, benchmark, cleanup, 
+			enough, p, warmup, repetitions, cookie);
+		if (gettime() == 0) break;
+
+		t = (double)gettime_ns() / (double)get_n();
+		if (p == 1) {
+			sweep_base = t;
+			if (!sweep_iterations)
+				sweep_iterations = benchmp_baseline(enough);
+		}
+		throughput = p * 1000000000. / t;
+		efficiency = sweep_base > 0. ? sweep_base / t : 0.;
+		fprintf(stderr, "sweep: parallel=%d latency=%.4f ns "
+			"throughput=%.6g/s efficiency=%.3f\n",
+			p, t, throughput, efficiency);
+		sprintf(params, "parallel=%d", p);
+		record("sweep", params, throughput, "iterations/s");
+		record("sweep latency", params, t, "ns/iteration");
+		record("sweep efficiency", params, efficiency, "ratio");
+	}
+	sweep_active = 0;
+}
+
+/*
+ * Fresh processes: with LMBENCH_FRESH=N, each benchmp call is run N
+ * times over, each time in newly forked workers which initialize
+ * (allocate and touch their memory, create their processes) again,
+ * so each run gets a different physical page layout.  All the
+ * samples are pooled into the results, and the spread within each
+ * process is reported next to the spread of the process medians:
+ * if the second is much larger, differences between results are
+ * likely placement luck rather than anything real.  The iteration
+ * count is calibrated by the first run only.
+ */
+static int	fresh_active = 0;
+static iter_t	fresh_iterations = 0;	/* calibrated by the first run */
+
+/*
+ * Summaries which benchmp adds to a benchmark's own results, such as
+ * the fresh and fairness statistics, are always recorded, but only
+ * printed with LMBENCH_VERBOSE set: the scripts keep stderr in the
+ * results files, where they would land in the middle of data sets.
+ */
+static int
+benchmp_verbose(void)
+{
+	static int	verbose = -1;
+	char		*s;
+
+	if (verbose < 0)
+		verbose = (s = getenv("LMBENCH_VERBOSE")) && *s && atoi(s) != 0;
+	return (verbose);
+}
+
+static int
+benchmp_fresh(void)
+{
+	static int	n = -1;
+	char		*s;
+
+	if (n < 0) {
+		n = 0;
+		if ((s = getenv("LMBENCH_FRESH")) != NULL && atoi(s) > 1)
+			n = atoi(s);
+	}
+	return (n);
+}
+
+/* ns per iteration of each sample; r is sorted, so v is too */
+static void
+benchmp_fresh_stats(result_t* r, double* median, double* var)
+{
+	int	i;
+	double	t, sum = 0., sum2 = 0.;
+
+	*median = *var = 0.;
+	if (r->N <= 0) return;
+	for (i = 0; i < r->N; ++i) {
+		t = r->v[i].u / (double)r->v[i].n;
+		sum += t;
+		sum2 += t * t;
+	}
+	*median = r->v[r->N/2].u / (double)r->v[r->N/2].n;
+	if (r->N % 2 == 0) {
+		*median += r->v[r->N/2-1].u / (double)r->v[r->N/2-1].n;
+		*median /= 2.;
+	}
+	if (r->N > 1 && sum2 > sum * sum / r->N)
+		*var = (sum2 - sum * sum / r->N) / (r->N - 1);
+}
+
+static void
+benchmp_fresh_run(benchmp_f initialize, 
+		  benchmp_f benchmark,
+		  benchmp_f cleanup,
+		  int enough, 
+		  int parallel,
+		  int warmup,
+		  int repetitions,
+		  void* cookie)
+{
+	int		i, j, k, n, runs = benchmp_fresh();
+	double		median, var, within = 0., sum = 0., sum2 = 0.;
+	double		across = 0.;
+	char		params[128];
+	result_t	*r, *all;
+	histogram_t	*h = NULL;
+	perf_t		*p = NULL;
+	noise_t		*z = NULL;
+
+	/* room for every sample of every run */
+	if ((n = repetitions) < 0 && (n = benchmp_ci()) <= 0)
+		n = TRIES;
+	all = (result_t*)malloc(sizeof_result(runs * n * parallel));
+	if (!all) {
+		benchmp(initialize, benchmark, cleanup, 
+			enough, parallel, warmup, repetitions, cookie);
+		return;
+	}
+	insertinit(all);
+
+	fresh_active = 1;
+	fresh_iterations = 0;
+	for (i = 0, k = 0; i < runs; ++i) {
+		benchmp(initialize, benchmark, cleanup, 
+			enough, parallel, warmup, repetitions, cookie);
+		if (gettime() == 0) break;
+		if (parallel == 1 && !fresh_iterations)
+			fresh_iterations = get_n();
+
+		r = get_results();
+		for (j = 0; j < r->N; ++j)
+			insertsort(r->v[j].u, r->v[j].n, all);
+		benchmp_fresh_stats(r, &median, &var);
+		within += var;
+		sum += median;
+		sum2 += median * median;
+		k++;
+		if (get_histogram()) {
+			if (!h && (h = (histogram_t*)malloc(sizeof(*h))))
+				hist_init(h);
+			if (h) hist_merge(h, get_histogram());
+		}
+		if (get_perf()) {
+			if (!p && (p = (perf_t*)malloc(sizeof(*p))))
+				perf_init(p);
+			if (p) perf_merge(p, get_perf());
+		}
+		if (get_noise()) {
+			if (!z && (z = (noise_t*)malloc(sizeof(*z))))
+				noise_init(z);
+			if (z) noise_merge(z, get_noise());
+		}
+	}
+	fresh_active = 0;
+	fresh_iterations = 0;
+	if (k == 0) {
+		free(all);
+		if (h) free(h);
+		if (p) free(p);
+		if (z) free(z);
+		return;
+	}
+
+	set_results(all);
+	if (h) set_histogram(h);
+	if (p) set_perf(p);
+	if (z) set_noise(z);
+
+	/* pooled variance within the processes, and across them */
+	within /= k;
+	if (k > 1 && sum2 > sum * sum / k)
+		across = (sum2 - sum * sum / k) / (k - 1);
+	benchmp_fresh_stats(all, &median, &var);
+	if (benchmp_verbose()) {
+		fprintf(stderr, "fresh: %d processes median=%.4f ns/iteration "
+			"within-process stddev=%.4f (%.2f%%) "
+			"across-process stddev=%.4f (%.2f%%)\n",
+			k, median, sqrt(within), 
+			median > 0. ? 100. * sqrt(within) / median : 0.,
+			sqrt(across), 
+			median > 0. ? 100. * sqrt(across) / median : 0.);
+	}
+	/* per benchmp iteration, which the benchmark may divide further */
+	sprintf(params, "processes=%d", k);
+	record("fresh", params, median, "ns/iteration");
+	record("fresh within-process stddev", params, sqrt(within), 
+	       "ns/iteration");
+	record("fresh across-process stddev", params, sqrt(across), 
+	       "ns/iteration");
+}
+
+/*
+ * LMBENCH_TRACE timeline, see lib_trace.c.  benchmp_spawn_ns is when
+ * the parent forked the worker, or created its thread.
+ */
+static LMBENCH_TLS uint64	benchmp_spawn_ns = 0;
+
+static void
+benchmp_trace(int run, uint64 begin, int parallel, int repetitions)
+{
+	char	args[128];
+
+	if (run <= 0) return;
+	sprintf(args, "\"run\":%d,\"parallel\":%d,\"repetitions\":%d",
+		run, parallel, repetitions);
+	trace_event(-1, "benchmp", begin, now_ns(), args);
+}
+
+/*
+ * Fairness of parallel runs.  The parent merges every worker's 
+ * samples into one set of results, which hides a worker that was
+ * starved by the scheduler or stuck on a slow NUMA node.  So as
+ * it merges them it also keeps each worker's median, and for -P
+ * runs benchmp reports the spread of the medians and Jain's 
+ * fairness index of the workers' rates (1/median):
+ *
+ *	J = (sum x)^2 / (n * sum x^2)
+ *
+ * which is 1 when all the workers did equally well and 1/n when 
+ * one of them did all the work.
+ */
+static double*	benchmp_medians = NULL;
+static int	benchmp_nmedians = 0;
+
+static void
+benchmp_worker_median(int i, int parallel, result_t* r)
+{
+	int	N = r->N;
+
+	if (i == 0) {
+		benchmp_nmedians = 0;
+		benchmp_medians = (double*)realloc(benchmp_medians, 
+						   parallel * sizeof(double));
+	}
+	if (!benchmp_medians) return;
+	/* sorted from largest to smallest */
+	benchmp_medians[i] = 0.;
+	if (N > 0)
+		benchmp_medians[i] = r->v[N/2].u / (double)r->v[N/2].n;
+	if (N > 0 && N % 2 == 0)
+		benchmp_medians[i] = (benchmp_medians[i] 
+			+ r->v[N/2-1].u / (double)r->v[N/2-1].n) / 2.;
+	benchmp_nmedians = i + 1;
+}
+
+static void
+benchmp_fairness(int parallel)
+{
+	int	i, n = 0;
+	double	min = 0., max = 0., x, sum = 0., sum2 = 0., jain;
+	char	params[64];
+
+	if (parallel < 2 || benchmp_nmedians != parallel) return;
+	for (i = 0; i < parallel; ++i) {
+		if (benchmp_medians[i] <= 0.) continue;
+		if (n == 0 || benchmp_medians[i] < min) min = benchmp_medians[i];
+		if (n == 0 || benchmp_medians[i] > max) max = benchmp_medians[i];
+		x = 1. / benchmp_medians[i];
+		sum += x;
+		sum2 += x * x;
+		n++;
+	}
+	if (n < 2) return;
+	jain = sum * sum / (n * sum2);
+
+	if (benchmp_verbose()) {
+		fprintf(stderr, "fairness: %d workers min=%.4f max=%.4f ns "
+			"spread=%.1f%% jain=%.4f\nfairness: medians (ns)",
+			parallel, min, max, 100. * (max - min) / min, jain);
+		for (i = 0; i < parallel; ++i)
+			fprintf(stderr, " %d=%.4f", i, benchmp_medians[i]);
+		fprintf(stderr, "\n");
+	}
+	sprintf(params, "workers=%d", parallel);
+	record("fairness", params, jain, "index");
+	record("fairness spread", params, (max - min) / min, "ratio");
+	for (i = 0; i < parallel; ++i) {
+		sprintf(params, "workers=%d worker=%d", parallel, i);
+		record("worker median", params, benchmp_medians[i], 
+		       "ns/iteration");
+	}
+}
+
+/*
+ * Histogram mode: after each timing interval which produces a
+ * result, the worker runs the same number of operations again one
+ * at a time (up to the timing interval), recording each one in a
+ * latency histogram.  The histograms are merged by the parent and
+ * are available through get_histogram().  This adds tail latencies
+ * (p99, max, ...) to the median, at the cost of about twice the
+ * run time.
+ */
+static int
+benchmp_histogram(void)
+{
+	static int	enabled = -1;
+	char		*s;
+
+	if (enabled < 0) {
+		s = getenv("LMBENCH_HISTOGRAM");
+		enabled = (s && *s && strcmp(s, "0") && strcasecmp(s, "NO"));
+	}
+	return (enabled);
+}
+
 void 
 benchmp(benchmp_f initialize, 
 	benchmp_f benchmark,
@@ -161,11 +730,17 @@ benchmp(benchmp_f initialize,
 {
 	iter_t		iterations = 1;
 	long		i;
+	int		ci = 0;
+	int		run;
+	uint64		begin = 0;
+	static int	calls = 0;
+	int		call = calls++;
 	pid_t		*pids = NULL;
 	int		response[2];
 	int		start_signal[2];
 	int		result_signal[2];
 	int		exit_signal[2];
+	void*		ctl = NULL;
 
 #ifdef _DEBUG
 	fprintf(stderr, "benchmp(%p, %p, %p, %d, %d, %d, %d, %p): entering\n", initialize, benchmark, cleanup, enough, parallel, warmup, repetitions, cookie);
@@ -175,38 +750,107 @@ benchmp(benchmp_f initialize,
 	fprintf(stderr, "\tenough=%d\n", enough);
 #endif
 
+	if (sweep_n && !sweep_active && parallel == sweep_levels[sweep_n-1]) {
+		benchmp_sweep(initialize, benchmark, cleanup,
+			      enough, warmup, repetitions, cookie);
+		return;
+	}
+	if (benchmp_fresh() && !fresh_active) {
+		benchmp_fresh_run(initialize, benchmark, cleanup,
+				  enough, parallel, warmup, repetitions, 
+				  cookie);
+		return;
+	}
+	if ((run = trace_run()) > 0)
+		begin = now_ns();
+
+	if (repetitions < 0 && (ci = benchmp_ci()) > 0)
+		repetitions = ci;
 	if (repetitions < 0)
 		repetitions = (1 < parallel || 1000000 <= enough ? 1 : TRIES);
 
 	/* initialize results */
 	settime(0);
 	save_n(1);
+	benchmp_nmedians = 0;
+	if (get_histogram()) {
+		free(get_histogram());
+		set_histogram(NULL);
+	}
+	if (get_perf()) {
+		free(get_perf());
+		set_perf(NULL);
+	}
+	if (get_noise()) {
+		free(get_noise());
+		set_noise(NULL);
+	}
+
+	if (parallel == 1)
+		iterations = get_iterations("benchmp", call, enough, 1);
 
-	if (parallel > 1) {
+	if (fresh_active && fresh_iterations) {
+		/* reuse the first fresh run's calibration */
+		iterations = fresh_iterations;
+	} else if (parallel > 1 && sweep_active && sweep_iterations) {
+		/* reuse the sweep's baseline */
+		iterations = sweep_iterations;
+	} else if (parallel > 1) {
 		/* Compute the baseline performance */
 		benchmp(initialize, benchmark, cleanup, 
-			enough, 1, warmup, repetitions, cookie);
+			enough, 1, warmup, ci ? -1 : repetitions, cookie);
 
 		/* if we can't even do a single job, then give up */
 		if (gettime() == 0)
 			return;
 
-		/* calculate iterations for 1sec runtime */
-		iterations = get_n();
-		if (enough < SHORT) {
-			double tmp = (double)SHORT * (double)get_n();
-			tmp /= (double)gettime();
-			iterations = (iter_t)tmp + 1;
+		iterations = benchmp_baseline(enough);
+		if (sweep_active) {
+			sweep_iterations = iterations;
+			sweep_base = (double)gettime_ns() / (double)get_n();
 		}
+		if (fresh_active)
+			fresh_iterations = iterations;
 		settime(0);
 		save_n(1);
 	}
+	record_benchmp(enough, parallel, warmup, repetitions);
+	record_mode(sched_realtime(parallel));
+	mem_pages_begin();
+	if (ci) {
+		benchmp_ci();
+	} else {
+		benchmp_ci_target = 0.;
+	}
+
+#ifdef BENCHMP_THREADS
+	/* threads would not get fresh address spaces */
+	if (!fresh_active && benchmp_use_threads(cookie)
+	    && benchmp_threads(initialize, benchmark, cleanup, enough, 
+			       parallel, iterations, warmup, repetitions,
+			       cookie)) {
+		if (parallel == 1 && gettime() > 0)
+			save_iterations("benchmp", call, enough, get_n());
+		record_mode(sched_realtime_end());
+		benchmp_trace(run, begin, parallel, repetitions);
+		benchmp_fairness(parallel);
+		print_noise();
+		if (ci) record_repetitions(get_results()->N / parallel);
+		record_mode_add(mem_pages_end());
+		return;
+	}
+#endif
+
+#ifdef BENCHMP_CTL
+	ctl = benchmp_ctl_alloc(parallel, repetitions, warmup, 0);
+#endif
 
-	/* Create the necessary pipes for control */
-	if (pipe(response) < 0
-	    || pipe(start_signal) < 0
-	    || pipe(result_signal) < 0
-	    || pipe(exit_signal) < 0) {
+	/* Otherwise create the necessary pipes for control */
+	if (!ctl
+	    && (pipe(response) < 0
+		|| pipe(start_signal) < 0
+		|| pipe(result_signal) < 0
+		|| pipe(exit_signal) < 0)) {
 #ifdef _DEBUG
 		fprintf(stderr, "BENCHMP: Could not create control pipes\n");
 #endif /* _DEBUG */
@@ -228,6 +872,7 @@ benchmp(benchmp_f initialize,
 #ifdef _DEBUG
 		fprintf(stderr, "benchmp(%p, %p, %p, %d, %d, %d, %d, %p): creating child %d\n", initialize, benchmark, cleanup, enough, parallel, warmup, repetitions, cookie, i);
 #endif
+		benchmp_spawn_ns = now_ns();
 		switch(pids[i] = fork()) {
 		case -1:
 			/* could not open enough children! */
@@ -237,10 +882,12 @@ benchmp(benchmp_f initialize,
 			goto error_exit;
 		case 0:
 			/* If child */
-			close(response[0]);
-			close(start_signal[1]);
-			close(result_signal[1]);
-			close(exit_signal[1]);
+			if (!ctl) {
+				close(response[0]);
+				close(start_signal[1]);
+				close(result_signal[1]);
+				close(exit_signal[1]);
+			}
 			handle_scheduler(i, 0, 0);
 			benchmp_child(initialize, 
 				      benchmark, 
@@ -254,13 +901,22 @@ benchmp(benchmp_f initialize,
 				      iterations,
 				      parallel,
 				      repetitions,
-				      cookie
+				      cookie,
+				      ctl
 				);
 			exit(0);
 		default:
 			break;
 		}
 	}
+#ifdef BENCHMP_CTL
+	if (ctl) {
+		if (!benchmp_ctl_parent((benchmp_ctl*)ctl, parallel, 
+					warmup, repetitions))
+			goto error_exit;
+		goto cleanup_exit;
+	}
+#endif
 	close(response[1]);
 	close(start_signal[0]);
 	close(result_signal[0]);
@@ -316,6 +972,18 @@ cleanup_exit:
 	}
 
 	if (pids) free(pids);
+#ifdef BENCHMP_CTL
+	if (ctl) benchmp_ctl_free((benchmp_ctl*)ctl);
+#endif
+	if (parallel == 1 && gettime() > 0)
+		save_iterations("benchmp", call, enough, get_n());
+	record_mode(sched_realtime_end());
+	benchmp_trace(run, begin, parallel, repetitions);
+	benchmp_fairness(parallel);
+	print_noise();
+	/* the samples each worker took, not LMBENCH_CI_MAX */
+	if (ci) record_repetitions(get_results()->N / parallel);
+	record_mode_add(mem_pages_end());
 #ifdef _DEBUG
 	fprintf(stderr, "benchmp(0x%x, 0x%x, 0x%x, %d, %d, 0x%x): exiting\n", (unsigned int)initialize, (unsigned int)benchmark, (unsigned int)cleanup, enough, parallel, (unsigned int)cookie);
 #endif
@@ -336,8 +1004,14 @@ benchmp_parent(	int response,
 {
 	int		i, j;
 	int		bytes_read;
+	int		h_size = 0;
+	int		p_size = 0;
+	int		n_size = 0;
 	result_t*	results = NULL;
 	result_t*	merged_results = NULL;
+	histogram_t*	merged_hist = NULL;
+	perf_t*		merged_perf = NULL;
+	noise_t*	merged_noise = NULL;
 	char*		signals = NULL;
 	unsigned char*	buf;
 	fd_set		fds_read, fds_error;
@@ -350,7 +1024,30 @@ benchmp_parent(	int response,
 		goto error_exit;
 	}
 
-	results = (result_t*)malloc(sizeof_result(repetitions));
+	/* 
+	 * each child's histogram and counters follow its results
+	 * down the pipe
+	 */
+	if (benchmp_histogram()) {
+		h_size = sizeof(histogram_t);
+		merged_hist = (histogram_t*)malloc(h_size);
+		if (!merged_hist) return;
+		hist_init(merged_hist);
+	}
+	if (perf_enabled()) {
+		p_size = sizeof(perf_t);
+		merged_perf = (perf_t*)malloc(p_size);
+		if (!merged_perf) return;
+		perf_init(merged_perf);
+	}
+	if (noise_enabled()) {
+		n_size = sizeof(noise_t);
+		merged_noise = (noise_t*)malloc(n_size);
+		if (!merged_noise) return;
+		noise_init(merged_noise);
+	}
+	results = (result_t*)malloc(sizeof_result(repetitions) 
+				    + h_size + p_size + n_size);
 	merged_results = (result_t*)malloc(sizeof_result(parallel * repetitions));
 	signals = (char*)malloc(parallel * sizeof(char));
 	if (!results || !merged_results || !signals) return;
@@ -436,7 +1133,7 @@ benchmp_parent(	int response,
 	/* collect results */
 	insertinit(merged_results);
 	for (i = 0; i < parallel; ++i) {
-		int n = sizeof_result(repetitions);
+		int n = sizeof_result(repetitions) + h_size + p_size + n_size;
 		buf = (unsigned char*)results;
 
 		FD_ZERO(&fds_read);
@@ -478,6 +1175,17 @@ benchmp_parent(	int response,
 			insertsort(results->v[j].u, 
 				   results->v[j].n, merged_results);
 		}
+		benchmp_worker_median(i, parallel, results);
+		if (merged_hist)
+			hist_merge(merged_hist, (histogram_t*)
+				   ((char*)results + sizeof_result(repetitions)));
+		if (merged_perf)
+			perf_merge(merged_perf, (perf_t*)((char*)results 
+				   + sizeof_result(repetitions) + h_size));
+		if (merged_noise)
+			noise_merge(merged_noise, (noise_t*)((char*)results 
+				    + sizeof_result(repetitions) 
+				    + h_size + p_size));
 	}
 
 	/* we allow children to die now, without it causing an error */
@@ -488,6 +1196,9 @@ benchmp_parent(	int response,
 
 	/* Compute median time; iterations is constant! */
 	set_results(merged_results);
+	set_histogram(merged_hist);
+	set_perf(merged_perf);
+	set_noise(merged_noise);
 
 	goto cleanup_exit;
 error_exit:
@@ -500,6 +1211,9 @@ error_exit:
 		waitpid(pids[i], NULL, 0);
 	}
 	free(merged_results);
+	if (merged_hist) free(merged_hist);
+	if (merged_perf) free(merged_perf);
+	if (merged_noise) free(merged_noise);
 	insertinit(get_results());
 cleanup_exit:
 	close(response);
@@ -511,6 +1225,361 @@ cleanup_exit:
 	if (signals) free(signals);
 }
 
+#ifdef BENCHMP_CTL
+static benchmp_ctl*
+benchmp_ctl_alloc(int parallel, int repetitions, int warmup, int threads)
+{
+	size_t		h_offset = 0, p_offset = 0, n_offset = 0, r_size, size;
+	benchmp_ctl*	ctl;
+
+	r_size = sizeof_result(repetitions);
+	if (benchmp_histogram()) {
+		h_offset = (r_size + 7) & ~(size_t)7;
+		r_size = h_offset + sizeof(histogram_t);
+	}
+	if (perf_enabled()) {
+		p_offset = (r_size + 7) & ~(size_t)7;
+		r_size = p_offset + sizeof(perf_t);
+	}
+	if (noise_enabled()) {
+		n_offset = (r_size + 7) & ~(size_t)7;
+		r_size = n_offset + sizeof(noise_t);
+	}
+	r_size = (r_size + CTL_ALIGN - 1) & ~((size_t)CTL_ALIGN - 1);
+	size = CTL_ALIGN + parallel * r_size;
+
+	/* the mapping starts out zeroed, so all the counters are clear */
+	ctl = (benchmp_ctl*)mmap(0, size, PROT_READ|PROT_WRITE, 
+				 MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if ((void*)ctl == MAP_FAILED) {
+#ifdef _DEBUG
+		fprintf(stderr, "BENCHMP: could not map control block\n");
+#endif /* _DEBUG */
+		return NULL;
+	}
+	ctl->threads = threads;
+	ctl->warmup = warmup;
+	ctl->h_offset = h_offset;
+	ctl->p_offset = p_offset;
+	ctl->n_offset = n_offset;
+	ctl->r_size = r_size;
+	ctl->size = size;
+	return ctl;
+}
+
+static void
+benchmp_ctl_free(benchmp_ctl* ctl)
+{
+	munmap((void*)ctl, ctl->size);
+}
+
+static void
+benchmp_ctl_wake(volatile int* addr)
+{
+#ifdef HAVE_FUTEX
+	syscall(SYS_futex, addr, FUTEX_WAKE, 0x7fffffff, NULL, NULL, 0);
+#endif
+}
+
+static void
+benchmp_ctl_post(benchmp_ctl* ctl, benchmp_signal sig, int n)
+{
+	int	i;
+
+	__sync_fetch_and_add(&ctl->count[sig], n);
+	if (sig != sig_abort) {
+		benchmp_ctl_wake(&ctl->count[sig]);
+		return;
+	}
+	/* an abort has to wake everybody, whatever they wait on */
+	for (i = 0; i < sig_max; ++i)
+		benchmp_ctl_wake(&ctl->count[i]);
+}
+
+/*
+ * Wait for up to a second for count[sig] to reach n.  Returns 1
+ * when it has, -1 on abort, and 0 if the caller should check for
+ * trouble (a dead parent or child, a signal) and try again.
+ */
+static int
+benchmp_ctl_wait(benchmp_ctl* ctl, benchmp_signal sig, int n)
+{
+	int		v = ctl->count[sig];
+#ifdef HAVE_FUTEX
+	struct timespec	ts;
+#else
+	struct timeval	timeout;
+#endif
+
+	if (v < n && !ctl->count[sig_abort]) {
+#ifdef HAVE_FUTEX
+		ts.tv_sec = 1;
+		ts.tv_nsec = 0;
+		syscall(SYS_futex, &ctl->count[sig], FUTEX_WAIT, v, &ts, NULL, 0);
+#else
+		timeout.tv_sec = 0;
+		timeout.tv_usec = 100;
+		select(0, NULL, NULL, NULL, &timeout);
+#endif
+	}
+	if (ctl->count[sig_abort])
+		return -1;
+	if (ctl->count[sig] < n)
+		return 0;
+	/* make sure we see whatever was written before the post */
+	__sync_synchronize();
+	return 1;
+}
+
+/*
+ * Parent side: wait for n workers to raise sig, waking up once a
+ * second to check on the children, just as the select() loops do.
+ */
+static int
+benchmp_ctl_collect(benchmp_ctl* ctl, benchmp_signal sig, int n)
+{
+	int	r;
+
+	while ((r = benchmp_ctl_wait(ctl, sig, n)) == 0) {
+		if ((!ctl->threads && benchmp_sigchld_received)
+		    || benchmp_sigterm_received)
+			return 0;
+	}
+	return (r > 0);
+}
+
+static int
+benchmp_ctl_parent(benchmp_ctl* ctl, int parallel, 
+		   int warmup, int repetitions)
+{
+	int		i, j;
+	result_t*	slot;
+	result_t*	merged_results;
+	histogram_t*	merged_hist = NULL;
+	perf_t*		merged_perf = NULL;
+	noise_t*	merged_noise = NULL;
+
+	merged_results = (result_t*)malloc(sizeof_result(parallel * repetitions));
+	if (!merged_results) goto error_exit;
+	if (ctl->h_offset) {
+		merged_hist = (histogram_t*)malloc(sizeof(histogram_t));
+		if (!merged_hist) goto error_exit;
+		hist_init(merged_hist);
+	}
+	if (ctl->p_offset) {
+		merged_perf = (perf_t*)malloc(sizeof(perf_t));
+		if (!merged_perf) goto error_exit;
+		perf_init(merged_perf);
+	}
+	if (ctl->n_offset) {
+		merged_noise = (noise_t*)malloc(sizeof(noise_t));
+		if (!merged_noise) goto error_exit;
+		noise_init(merged_noise);
+	}
+
+	/* Collect 'ready' signals */
+	if (!benchmp_ctl_collect(ctl, sig_ready, parallel)) {
+#ifdef _DEBUG
+		fprintf(stderr, "benchmp_ctl_parent: ready, benchmp_sigchld_received=%d\n", benchmp_sigchld_received);
+#endif
+		goto error_exit;
+	}
+
+	/* let the children run for warmup microseconds */
+	if (warmup > 0) {
+		struct timeval delay;
+		delay.tv_sec = warmup / 1000000;
+		delay.tv_usec = warmup % 1000000;
+
+		select(0, NULL, NULL, NULL, &delay);
+	}
+
+	/* send 'start' signal, which releases everyone at once */
+	benchmp_ctl_post(ctl, sig_start, parallel);
+
+	/* Collect 'done' signals */
+	if (!benchmp_ctl_collect(ctl, sig_done, parallel)) {
+#ifdef _DEBUG
+		fprintf(stderr, "benchmp_ctl_parent: done, benchmp_sigchld_received=%d\n", benchmp_sigchld_received);
+#endif
+		goto error_exit;
+	}
+
+	/* collect results, which all the children report at once */
+	benchmp_ctl_post(ctl, sig_results, parallel);
+	if (!benchmp_ctl_collect(ctl, sig_reported, parallel)) {
+#ifdef _DEBUG
+		fprintf(stderr, "benchmp_ctl_parent: results, benchmp_sigchld_received=%d\n", benchmp_sigchld_received);
+#endif
+		goto error_exit;
+	}
+	insertinit(merged_results);
+	for (i = 0; i < parallel; ++i) {
+		slot = benchmp_ctl_slot(ctl, i);
+		for (j = 0; j < slot->N; ++j) {
+			insertsort(slot->v[j].u, slot->v[j].n, merged_results);
+		}
+		benchmp_worker_median(i, parallel, slot);
+		if (merged_hist)
+			hist_merge(merged_hist, benchmp_ctl_hist(ctl, i));
+		if (merged_perf)
+			perf_merge(merged_perf, benchmp_ctl_perf(ctl, i));
+		if (merged_noise)
+			noise_merge(merged_noise, benchmp_ctl_noise(ctl, i));
+	}
+
+	/* we allow children to die now, without it causing an error */
+	if (!ctl->threads)
+		signal(SIGCHLD, SIG_DFL);
+
+	/* send 'exit' signals */
+	benchmp_ctl_post(ctl, sig_exit, parallel);
+
+	/* Compute median time; iterations is constant! */
+	set_results(merged_results);
+	set_histogram(merged_hist);
+	set_perf(merged_perf);
+	set_noise(merged_noise);
+	return 1;
+
+error_exit:
+#ifdef _DEBUG
+	fprintf(stderr, "benchmp_ctl_parent: error_exit!\n");
+#endif
+	benchmp_ctl_post(ctl, sig_abort, 1);
+	if (merged_results) free(merged_results);
+	if (merged_hist) free(merged_hist);
+	if (merged_perf) free(merged_perf);
+	if (merged_noise) free(merged_noise);
+	insertinit(get_results());
+	return 0;
+}
+#endif /* BENCHMP_CTL */
+
+#ifdef BENCHMP_THREADS
+static pthread_mutex_t	benchmp_sched_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void*
+benchmp_thread(void* _arg)
+{
+	benchmp_thread_arg* arg = (benchmp_thread_arg*)_arg;
+
+	/* handle_scheduler keeps its CPU list in static storage */
+	pthread_mutex_lock(&benchmp_sched_lock);
+	handle_scheduler(arg->childid, 0, 0);
+	pthread_mutex_unlock(&benchmp_sched_lock);
+
+	save_n(arg->n);
+	benchmp_spawn_ns = arg->spawn;
+	benchmp_child(arg->initialize,
+		      arg->benchmark,
+		      arg->cleanup,
+		      arg->childid,
+		      -1, -1, -1, -1,
+		      arg->enough,
+		      arg->iterations,
+		      arg->parallel,
+		      arg->repetitions,
+		      arg->cookie,
+		      arg->ctl
+		);
+
+	/* benchmp_child only returns if it could not get started */
+	benchmp_ctl_post(arg->ctl, sig_abort, 1);
+	return NULL;
+}
+
+static int
+benchmp_threads(benchmp_f initialize, 
+		benchmp_f benchmark,
+		benchmp_f cleanup,
+		int enough, 
+		int parallel,
+		iter_t iterations,
+		int warmup,
+		int repetitions,
+		void* cookie)
+{
+	int		i;
+	benchmp_ctl*	ctl;
+	pthread_t*	threads;
+	benchmp_thread_arg* args;
+
+	ctl = benchmp_ctl_alloc(parallel, repetitions, warmup, 1);
+	threads = (pthread_t*)malloc(parallel * sizeof(pthread_t));
+	args = (benchmp_thread_arg*)calloc(parallel, sizeof(benchmp_thread_arg));
+	if (!ctl || !threads || !args) {
+		if (ctl) benchmp_ctl_free(ctl);
+		if (threads) free(threads);
+		if (args) free(args);
+		return 0;
+	}
+
+	/* 
+	 * The overheads are computed lazily into static storage;
+	 * do it once here rather than racing in every worker.
+	 */
+	t_overhead();
+	l_overhead();
+
+	benchmp_sigchld_received = 0;
+	benchmp_sigterm_received = 0;
+	benchmp_sigterm_handler = signal(SIGTERM, benchmp_sigterm);
+
+	for (i = 0; i < parallel; ++i) {
+		args[i].initialize = initialize;
+		args[i].benchmark = benchmark;
+		args[i].cleanup = cleanup;
+		args[i].childid = i;
+		args[i].enough = enough;
+		args[i].iterations = iterations;
+		args[i].n = get_n();
+		args[i].parallel = parallel;
+		args[i].repetitions = repetitions;
+		args[i].ctl = ctl;
+		args[i].spawn = now_ns();
+		if (cookie) {
+			args[i].cookie = malloc(benchmp_cookie_size);
+			if (!args[i].cookie)
+				break;
+			bcopy(cookie, args[i].cookie, benchmp_cookie_size);
+		}
+#ifdef _DEBUG
+		fprintf(stderr, "benchmp_threads: creating thread %d\n", i);
+#endif
+		if (pthread_create(&threads[i], NULL, benchmp_thread, &args[i])) {
+#ifdef _DEBUG
+			fprintf(stderr, "BENCHMP: pthread_create() failed!\n");
+#endif /* _DEBUG */
+			if (args[i].cookie) free(args[i].cookie);
+			break;
+		}
+	}
+	if (i < parallel) {
+		benchmp_ctl_post(ctl, sig_abort, 1);
+		insertinit(get_results());
+	} else {
+		benchmp_ctl_parent(ctl, parallel, warmup, repetitions);
+	}
+
+	/*
+	 * Unlike processes, threads cannot be killed, so a worker stuck
+	 * in its benchmark will hang us here.  Once asked to abort, the
+	 * workers clean up at the next interval boundary.
+	 */
+	while (i-- > 0) {
+		pthread_join(threads[i], NULL);
+		if (args[i].cookie) free(args[i].cookie);
+	}
+	signal(SIGTERM, benchmp_sigterm_handler);
+
+	benchmp_ctl_free(ctl);
+	free(args);
+	free(threads);
+	return 1;
+}
+#endif /* BENCHMP_THREADS */
+
 
 typedef enum { warmup, timing_interval, cooldown } benchmp_state;
 
@@ -534,9 +1603,212 @@ typedef struct {
 	long		i;
 	int		r_size;
 	result_t*	r;
+	histogram_t*	h;
+	iter_t		h_left;		/* single operations still to time */
+	uint64		h_ns;
+	perf_t*		p;
+	int		p_running;	/* counting this interval */
+	noise_t*	n;		/* LMBENCH_NOISE, see lib_noise.c */
+	int		n_running;	/* checking this interval */
+	int		n_retaken;	/* this repetition was retaken */
+	uint64		ci_start;	/* see benchmp_ci() */
+	int		trace;		/* LMBENCH_TRACE, see lib_trace.c */
+	uint64		t_start;	/* of the traced phase */
+	int		t_cpu;		/* where the traced phase started */
+	void*		ctl;
 } benchmp_child_state;
 
-static benchmp_child_state _benchmp_child_state;
+static LMBENCH_TLS benchmp_child_state _benchmp_child_state;
+
+/* start a traced phase of this worker */
+static void
+benchmp_child_phase(benchmp_child_state* state)
+{
+	if (!state->trace) return;
+	state->t_start = now_ns();
+	state->t_cpu = sched_cpu();
+}
+
+/* and finish it, n is the iteration count of timing intervals */
+static void
+benchmp_child_trace(benchmp_child_state* state, char* name, 
+		    uint64 start, uint64 end, iter_t n)
+{
+	int	len;
+	char	args[128];
+
+	if (!state->trace) return;
+	len = sprintf(args, "\"cpu\":%d,\"cpu_start\":%d", 
+		      sched_cpu(), state->t_cpu);
+	if (n)
+		sprintf(args + len, ",\"n\":%llu", (unsigned long long)n);
+	trace_event(state->childid, name, start, end, args);
+}
+
+/*
+ * Worker side of the control protocol: either a counter in the
+ * shared control block, or a byte on one of the pipes.
+ */
+static int
+benchmp_child_threaded(benchmp_child_state* state)
+{
+#ifdef BENCHMP_CTL
+	if (state->ctl)
+		return ((benchmp_ctl*)state->ctl)->threads;
+#endif
+	return 0;
+}
+
+static void
+benchmp_child_post(benchmp_child_state* state, benchmp_signal sig)
+{
+	char	c = 0;
+
+#ifdef BENCHMP_CTL
+	if (state->ctl) {
+		benchmp_ctl_post((benchmp_ctl*)state->ctl, sig, 1);
+		return;
+	}
+#endif
+	write(state->response, &c, sizeof(char));
+}
+
+static int
+benchmp_child_poll(benchmp_child_state* state, benchmp_signal sig, int fd)
+{
+	char		c;
+	fd_set		fds;
+	struct timeval	timeout;
+
+#ifdef BENCHMP_CTL
+	/* no system call needed, just look */
+	if (state->ctl)
+		return (((benchmp_ctl*)state->ctl)->count[sig] > 0);
+#endif
+	if (fd < 0)
+		return 0;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 0;
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	select(fd+1, &fds, NULL, NULL, &timeout);
+	if (!FD_ISSET(fd, &fds))
+		return 0;
+	read(fd, &c, sizeof(char));
+	return 1;
+}
+
+static void
+benchmp_child_wait(benchmp_child_state* state, benchmp_signal sig, int fd)
+{
+	char	c;
+
+#ifdef BENCHMP_CTL
+	if (state->ctl) {
+		/* give up if we are aborted or orphaned */
+		while (!benchmp_ctl_wait((benchmp_ctl*)state->ctl, sig, 1)) {
+			if (!benchmp_child_threaded(state) && getppid() == 1)
+				break;
+		}
+		return;
+	}
+#endif
+	read(fd, &c, sizeof(char));
+}
+
+static void
+benchmp_child_report(benchmp_child_state* state)
+{
+#ifdef BENCHMP_CTL
+	if (state->ctl) {
+		benchmp_ctl* ctl = (benchmp_ctl*)state->ctl;
+
+		bcopy((void*)get_results(), 
+		      (void*)benchmp_ctl_slot(ctl, state->childid),
+		      state->r_size);
+		if (state->h)
+			bcopy((void*)state->h, 
+			      (void*)benchmp_ctl_hist(ctl, state->childid),
+			      sizeof(histogram_t));
+		if (state->p)
+			bcopy((void*)state->p, 
+			      (void*)benchmp_ctl_perf(ctl, state->childid),
+			      sizeof(perf_t));
+		if (state->n)
+			bcopy((void*)state->n, 
+			      (void*)benchmp_ctl_noise(ctl, state->childid),
+			      sizeof(noise_t));
+		benchmp_child_post(state, sig_reported);
+		return;
+	}
+#endif
+	write(state->response, (void*)get_results(), state->r_size);
+	if (state->h)
+		write(state->response, (void*)state->h, sizeof(histogram_t));
+	if (state->p)
+		write(state->response, (void*)state->p, sizeof(perf_t));
+	if (state->n)
+		write(state->response, (void*)state->n, sizeof(noise_t));
+}
+
+static void
+benchmp_child_cleanup(benchmp_child_state* state, iter_t iterations)
+{
+	if (!state->cleanup)
+		return;
+	if (!benchmp_child_threaded(state) && benchmp_sigchld_handler == SIG_DFL)
+		signal(SIGCHLD, SIG_DFL);
+	(*state->cleanup)(iterations, state->cookie);
+}
+
+/*
+ * Has this worker taken enough samples?
+ */
+static int
+benchmp_child_done(benchmp_child_state* state)
+{
+	int		i, done;
+	double		median, se;
+	double*		values;
+	result_t*	r = get_results();
+
+	if (state->i >= state->repetitions) return (1);
+	if (benchmp_ci_target <= 0.) return (0);
+	if (now_ns() - state->ci_start > benchmp_ci_budget) return (1);
+	if (r->N < CI_MIN) return (0);
+
+	values = (double*)malloc(r->N * sizeof(double));
+	if (!values) return (1);
+	for (i = 0; i < r->N; ++i)
+		values[i] = r->v[i].u / (double)r->v[i].n;
+	se = double_bootstrap_stderr(values, r->N, double_median);
+	median = double_median(values, r->N);
+	done = (1.96 * se <= benchmp_ci_target * median);
+	free(values);
+#ifdef _DEBUG
+	fprintf(stderr, "benchmp_child_done: N=%d median=%g se=%g\n", 
+		r->N, median, se);
+#endif
+	return (done);
+}
+
+static void
+benchmp_child_exit(benchmp_child_state* state)
+{
+#ifdef BENCHMP_THREADS
+	if (benchmp_child_threaded(state)) {
+		free(state->r);
+		if (state->h) free(state->h);
+		if (state->p) {
+			perf_close();
+			free(state->p);
+		}
+		if (state->n) free(state->n);
+		pthread_exit(NULL);
+	}
+#endif
+	exit(0);
+}
 
 int
 benchmp_childid()
@@ -590,7 +1862,8 @@ benchmp_child(benchmp_f initialize,
 	        iter_t iterations,
 		int parallel, 
 	        int repetitions,
-		void* cookie
+		void* cookie,
+		void* ctl
 		)
 {
 	iter_t		iterations_batch = (parallel > 1) ? get_n() : 1;
@@ -614,10 +1887,55 @@ benchmp_child(benchmp_f initialize,
 	_benchmp_child_state.i = 0;
 	_benchmp_child_state.r_size = sizeof_result(repetitions);
 	_benchmp_child_state.r = (result_t*)malloc(_benchmp_child_state.r_size);
+	_benchmp_child_state.h = NULL;
+	_benchmp_child_state.h_left = 0;
+	_benchmp_child_state.p = NULL;
+	_benchmp_child_state.p_running = 0;
+	_benchmp_child_state.n = NULL;
+	_benchmp_child_state.n_running = 0;
+	_benchmp_child_state.n_retaken = 0;
+	_benchmp_child_state.ci_start = now_ns();
+	_benchmp_child_state.trace = trace_enabled();
+	_benchmp_child_state.t_cpu = -1;
+	_benchmp_child_state.ctl = ctl;
+
+	if (_benchmp_child_state.trace) {
+		trace_worker(childid);
+		benchmp_child_trace(&_benchmp_child_state, "fork",
+				    benchmp_spawn_ns, now_ns(), 0);
+	}
 
 	if (!_benchmp_child_state.r) return;
 	insertinit(_benchmp_child_state.r);
 	set_results(_benchmp_child_state.r);
+	if (benchmp_histogram()) {
+		_benchmp_child_state.h = (histogram_t*)malloc(sizeof(histogram_t));
+		if (!_benchmp_child_state.h) return;
+		hist_init(_benchmp_child_state.h);
+	}
+	set_histogram(_benchmp_child_state.h);
+	if (perf_enabled()) {
+		_benchmp_child_state.p = (perf_t*)malloc(sizeof(perf_t));
+		if (!_benchmp_child_state.p) return;
+		perf_init(_benchmp_child_state.p);
+	}
+	set_perf(_benchmp_child_state.p);
+	if (noise_enabled()) {
+		_benchmp_child_state.n = (noise_t*)malloc(sizeof(noise_t));
+		if (!_benchmp_child_state.n) return;
+		noise_init(_benchmp_child_state.n);
+	}
+	set_noise(_benchmp_child_state.n);
+
+	/* signal dispositions are per-process, leave them to the parent */
+	if (benchmp_child_threaded(&_benchmp_child_state)) {
+		benchmp_child_phase(&_benchmp_child_state);
+		if (initialize)
+			(*initialize)(0, cookie);
+		benchmp_child_trace(&_benchmp_child_state, "initialize",
+				    _benchmp_child_state.t_start, now_ns(), 0);
+		goto start;
+	}
 
 	if (benchmp_sigchld_handler != SIG_DFL) {
 		signal(SIGCHLD, benchmp_sigchld_handler);
@@ -625,8 +1943,11 @@ benchmp_child(benchmp_f initialize,
 		signal(SIGCHLD, benchmp_child_sigchld);
 	}
 
+	benchmp_child_phase(&_benchmp_child_state);
 	if (initialize)
 		(*initialize)(0, cookie);
+	benchmp_child_trace(&_benchmp_child_state, "initialize",
+			    _benchmp_child_state.t_start, now_ns(), 0);
 	
 	if (benchmp_sigterm_handler != SIG_DFL) {
 		signal(SIGTERM, benchmp_sigterm_handler);
@@ -636,8 +1957,17 @@ benchmp_child(benchmp_f initialize,
 	if (benchmp_sigterm_received)
 		benchmp_child_sigterm(SIGTERM);
 
+start:
+	/* LMBENCH_REALTIME: keep the buffers resident */
+	sched_lock_memory();
+
+	/* open after initialize(), the counters start disabled */
+	if (_benchmp_child_state.p)
+		perf_open();
+
 	/* start experiments, collecting results */
 	insertinit(_benchmp_child_state.r);
+	benchmp_child_phase(&_benchmp_child_state);
 
 	while (1) {
 		(*benchmark)(benchmp_interval(&_benchmp_child_state), cookie);
@@ -647,68 +1977,130 @@ benchmp_child(benchmp_f initialize,
 iter_t
 benchmp_interval(void* _state)
 {
-	char		c;
 	iter_t		iterations;
 	double		result;
-	fd_set		fds;
-	struct timeval	timeout;
+	int		noisy = 0;
+	uint64		t_begin = 0, t_end = 0;
 	benchmp_child_state* state = (benchmp_child_state*)_state;
 
 	iterations = (state->state == timing_interval ? state->iterations : state->iterations_batch);
+	if (state->h_left)
+		iterations = 1;
 
 	if (state->need_warmup) {
 		/* remove spurious compilation warning */
 		result = state->enough;
 	} else {
-		result = stop(0,0);
-		if (state->cleanup) {
-			if (benchmp_sigchld_handler == SIG_DFL)
-				signal(SIGCHLD, SIG_DFL);
-			(*state->cleanup)(iterations, state->cookie);
+		stop(0,0);
+		if (state->p_running)
+			perf_stop();
+		if (state->n_running)
+			noisy = noise_end(gettime_ns());
+		if (state->trace) {
+			t_end = now_ns();
+			t_begin = t_end - gettime_ns();
 		}
-		save_n(state->iterations);
-		result -= t_overhead() + get_n() * l_overhead();
-		settime(result >= 0. ? (uint64)result : 0.);
+		benchmp_child_cleanup(state, iterations);
+		save_n(state->h_left ? 1 : state->iterations);
+		result = gettime_ns();
+		result -= t_overhead() + 1000. * get_n() * l_overhead();
+		settime_ns(result >= 0. ? (uint64)result : 0);
 	}
 
 	/* if the parent died, then give up */
-	if (getppid() == 1 && state->cleanup) {
-		if (benchmp_sigchld_handler == SIG_DFL)
-			signal(SIGCHLD, SIG_DFL);
-		(*state->cleanup)(0, state->cookie);
+	if (!benchmp_child_threaded(state) && getppid() == 1 && state->cleanup) {
+		benchmp_child_cleanup(state, 0);
 		exit(0);
 	}
 
-	timeout.tv_sec = 0;
-	timeout.tv_usec = 0;
-	FD_ZERO(&fds);
+	/* likewise if the parent gave up on us */
+	if (benchmp_child_poll(state, sig_abort, -1)) {
+		benchmp_child_cleanup(state, 0);
+		benchmp_child_exit(state);
+	}
+
+	/* one operation of a histogram run, see benchmp_histogram() */
+	if (state->h_left) {
+		hist_insert(gettime_ns(), state->h);
+		state->h_ns += gettime_ns();
+		if (--state->h_left > 0 
+		    && state->h_ns < 1000 * (uint64)state->enough) {
+			iterations = 1;
+			goto next;
+		}
+		state->h_left = 0;
+		benchmp_child_trace(state, "histogram", 
+				    state->t_start, now_ns(), 0);
+		iterations = state->iterations;
+		if (benchmp_child_done(state)) {
+			state->state = cooldown;
+			/* send 'done' */
+			benchmp_child_post(state, sig_done);
+			benchmp_child_phase(state);
+			iterations = state->iterations_batch;
+		}
+		goto next;
+	}
 
 	switch (state->state) {
 	case warmup:
 		iterations = state->iterations_batch;
-		FD_SET(state->start_signal, &fds);
-		select(state->start_signal+1, &fds, NULL,
-		       NULL, &timeout);
-		if (FD_ISSET(state->start_signal, &fds)) {
-			state->state = timing_interval;
-			read(state->start_signal, &c, sizeof(char));
-			iterations = state->iterations;
-		}
 		if (state->need_warmup) {
 			state->need_warmup = 0;
 			/* send 'ready' */
-			write(state->response, &c, sizeof(char));
+			benchmp_child_post(state, sig_ready);
+#ifdef BENCHMP_CTL
+			/*
+			 * Without a warmup period there is nothing to do
+			 * until everyone is ready, so wait at the barrier
+			 * and start together with the other workers.
+			 */
+			if (state->ctl && !((benchmp_ctl*)state->ctl)->warmup)
+				benchmp_child_wait(state, sig_start, -1);
+#endif
+		}
+		if (benchmp_child_poll(state, sig_start, state->start_signal)) {
+			benchmp_child_trace(state, "warmup", 
+					    state->t_start, now_ns(), 0);
+			state->state = timing_interval;
+			iterations = state->iterations;
 		}
 		break;
 	case timing_interval:
 		iterations = state->iterations;
 		if (state->parallel > 1 || result > 0.95 * state->enough) {
-			insertsort(gettime(), get_n(), get_results());
-			state->i++;
-			/* we completed all the experiments, return results */
-			if (state->i >= state->repetitions) {
-				state->state = cooldown;
+			benchmp_child_trace(state, "repetition", 
+					    t_begin, t_end, get_n());
+			/* LMBENCH_NOISE=discard: take a disturbed one again */
+			if (state->n_running && noisy 
+			    && noise_enabled() == NOISE_DISCARD
+			    && !state->n_retaken) {
+				noise_save(state->n, noisy, 1);
+				state->n_retaken = 1;
+			} else {
+				if (state->n_running)
+					noise_save(state->n, noisy, 0);
+				insertsort(gettime_ns(), get_n(), get_results());
+				if (state->p_running)
+					perf_save(state->p, get_n());
+				state->i++;
+				state->n_retaken = 0;
+				if (state->h) {
+					/* time the same work again, an op at a time */
+					state->h_left = iterations;
+					state->h_ns = 0;
+					iterations = 1;
+					benchmp_child_phase(state);
+					break;
+				}
+				/* we completed all the experiments, return results */
+				if (benchmp_child_done(state)) {
+					state->state = cooldown;
+				}
 			}
+		} else {
+			benchmp_child_trace(state, "calibrate", 
+					    t_begin, t_end, get_n());
 		}
 		if (state->parallel == 1 
 		    && (result < 0.99 * state->enough || result > 1.2 * state->enough)) {
@@ -727,37 +2119,48 @@ benchmp_interval(void* _state)
 		state->iterations = iterations;
 		if (state->state == cooldown) {
 			/* send 'done' */
-			write(state->response, (void*)&c, sizeof(char));
+			benchmp_child_post(state, sig_done);
+			benchmp_child_phase(state);
 			iterations = state->iterations_batch;
 		}
 		break;
 	case cooldown:
 		iterations = state->iterations_batch;
-		FD_SET(state->result_signal, &fds);
-		select(state->result_signal+1, &fds, NULL, NULL, &timeout);
-		if (FD_ISSET(state->result_signal, &fds)) {
+		if (benchmp_child_poll(state, sig_results, state->result_signal)) {
 			/* 
 			 * At this point all children have stopped their
 			 * measurement loops, so we can block waiting for
 			 * the parent to tell us to send our results back.
 			 * From this point on, we will do no more "work".
 			 */
-			read(state->result_signal, (void*)&c, sizeof(char));
-			write(state->response, (void*)get_results(), state->r_size);
-			if (state->cleanup) {
-				if (benchmp_sigchld_handler == SIG_DFL)
-					signal(SIGCHLD, SIG_DFL);
-				(*state->cleanup)(0, state->cookie);
-			}
+			benchmp_child_trace(state, "cooldown", 
+					    state->t_start, now_ns(), 0);
+			benchmp_child_phase(state);
+			benchmp_child_report(state);
+			benchmp_child_cleanup(state, 0);
+			benchmp_child_trace(state, "cleanup", 
+					    state->t_start, now_ns(), 0);
 
 			/* Now wait for signal to exit */
-			read(state->exit_signal, (void*)&c, sizeof(char));
-			exit(0);
+			benchmp_child_wait(state, sig_exit, state->exit_signal);
+			benchmp_child_exit(state);
 		}
 	};
+next:
 	if (state->initialize) {
 		(*state->initialize)(iterations, state->cookie);
 	}
+	/* count only the measured intervals, not warmup or histograms */
+	state->n_running = (state->n && state->state == timing_interval
+			    && !state->h_left);
+	if (state->n_running)
+		noise_begin();
+	state->p_running = (state->p && state->state == timing_interval
+			    && !state->h_left);
+	if (state->p_running)
+		perf_start();
+	if (state->trace && state->state == timing_interval && !state->h_left)
+		state->t_cpu = sched_cpu();
 	start(0);
 	return (iterations);
 }
@@ -772,19 +2175,232 @@ timing(FILE *out)
 	ftiming = out;
 }
 
+/*
+ * Clock backends.
+ *
+ * All of the interval timing (start/stop/settime/gettime and the
+ * result_t samples) is carried in nanoseconds.  The clock which
+ * produces those nanoseconds is selected with LMBENCH_CLOCK:
+ *
+ *	gettimeofday	the historical microsecond clock
+ *	monotonic	clock_gettime(CLOCK_MONOTONIC_RAW) (the default)
+ *	tsc		a free-running cycle counter (invariant TSC on
+ *			x86, cntvct_el0 on arm64, rdtime on riscv),
+ *			calibrated once against the monotonic clock
+ *
+ * If the requested clock is not available we fall back to the
+ * next best one.
+ */
+typedef enum { clock_gtod, clock_monotonic, clock_cycles } lmbench_clock;
+
+static	uint64	clock_init(void);
+static	uint64	(*clock_fn)(void) = clock_init;
+static	lmbench_clock	clock_type = clock_gtod;
+static LMBENCH_TLS uint64	start_ns, stop_ns;
+
+static uint64
+clock_gtod_ns(void)
+{
+	struct timeval	t;
+	uint64		ns;
+
+	(void) gettimeofday(&t, (struct timezone *) 0);
+	ns = t.tv_sec;
+	ns *= 1000000;
+	ns += t.tv_usec;
+	return (ns * 1000);
+}
+
+#ifdef HAVE_CLOCK_GETTIME
+#ifdef CLOCK_MONOTONIC_RAW
+#define	LMBENCH_CLOCK_ID	CLOCK_MONOTONIC_RAW
+#else
+#define	LMBENCH_CLOCK_ID	CLOCK_MONOTONIC
+#endif
+
+static uint64
+clock_monotonic_ns(void)
+{
+	struct timespec	t;
+	uint64		ns;
+
+	(void) clock_gettime(LMBENCH_CLOCK_ID, &t);
+	ns = t.tv_sec;
+	ns *= 1000000000;
+	ns += t.tv_nsec;
+	return (ns);
+}
+#endif /* HAVE_CLOCK_GETTIME */
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__) \
+			  || defined(__aarch64__) || defined(__riscv))
+#define	HAVE_CYCLE_COUNTER
+static	uint64	cycles_base;
+static	double	ns_per_cycle;
+
+static uint64
+read_cycles(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	unsigned int	lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return (((uint64)hi << 32) | lo);
+#elif defined(__aarch64__)
+	uint64	c;
+
+	__asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r" (c));
+	return (c);
+#else /* __riscv */
+	unsigned long	c;
+
+	__asm__ __volatile__("rdtime %0" : "=r" (c));
+	return ((uint64)c);
+#endif
+}
+
+/*
+ * The cycle counter is only usable if it ticks at a constant rate
+ * regardless of frequency scaling and sleep states.  The arm64
+ * generic timer and riscv time CSR always do; on x86 we need the
+ * invariant TSC bit (CPUID 0x80000007, EDX bit 8).
+ */
+static int
+cycles_invariant(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	unsigned int	a, b, c, d;
+
+	__asm__ __volatile__("cpuid"
+			     : "=a" (a), "=b" (b), "=c" (c), "=d" (d)
+			     : "a" (0x80000000));
+	if (a < 0x80000007) return (0);
+	__asm__ __volatile__("cpuid"
+			     : "=a" (a), "=b" (b), "=c" (c), "=d" (d)
+			     : "a" (0x80000007));
+	return ((d >> 8) & 1);
+#else
+	return (1);
+#endif
+}
+
+static uint64
+clock_cycles_ns(void)
+{
+	return ((uint64)((double)(read_cycles() - cycles_base) * ns_per_cycle));
+}
+
+/*
+ * Calibrate the cycle counter against the reference clock by
+ * spinning for 10 milliseconds.  This is done once per process.
+ */
+static int
+cycles_calibrate(uint64 (*ref)(void))
+{
+	uint64	t0, t1, c0, c1;
+
+	if (getenv("LMBENCH_NS_PER_CYCLE")) {
+		ns_per_cycle = atof(getenv("LMBENCH_NS_PER_CYCLE"));
+		cycles_base = read_cycles();
+		return (ns_per_cycle > 0.);
+	}
+	t0 = (*ref)();
+	c0 = read_cycles();
+	do {
+		t1 = (*ref)();
+	} while (t1 - t0 < 10000000);
+	c1 = read_cycles();
+	if (c1 <= c0) return (0);
+
+	ns_per_cycle = (double)(t1 - t0) / (double)(c1 - c0);
+	cycles_base = c0;
+	return (1);
+}
+#endif /* cycle counter */
+
+static uint64
+clock_init(void)
+{
+	char	*name = getenv("LMBENCH_CLOCK");
+
+	clock_fn = clock_gtod_ns;
+	clock_type = clock_gtod;
+	if (name && strcasecmp(name, "gettimeofday") == 0)
+		return ((*clock_fn)());
+#ifdef HAVE_CLOCK_GETTIME
+	clock_fn = clock_monotonic_ns;
+	clock_type = clock_monotonic;
+#endif
+#ifdef HAVE_CYCLE_COUNTER
+	if (name && strcasecmp(name, "tsc") == 0) {
+		if (cycles_invariant() && cycles_calibrate(clock_fn)) {
+			clock_fn = clock_cycles_ns;
+			clock_type = clock_cycles;
+		} else {
+			fprintf(stderr, "LMBENCH_CLOCK=tsc: no invariant cycle counter, using %s\n", timing_clock());
+		}
+	}
+#endif
+	return ((*clock_fn)());
+}
+
+/*
+ * Return the name of the clock used for timing intervals.
+ */
+char*
+timing_clock(void)
+{
+	if (clock_fn == clock_init) (void) clock_init();
+
+	switch (clock_type) {
+	case clock_monotonic:	return ("monotonic");
+	case clock_cycles:	return ("tsc");
+	default:		return ("gettimeofday");
+	}
+}
+
+/*
+ * Nanoseconds per cycle of the cycle counter, or 0 if the cycle
+ * counter is not the timing clock.
+ */
+double
+timing_ns_per_cycle(void)
+{
+#ifdef HAVE_CYCLE_COUNTER
+	if (clock_fn == clock_init) (void) clock_init();
+	if (clock_type == clock_cycles)
+		return (ns_per_cycle);
+#endif
+	return (0.);
+}
+
+/*
+ * Return a timestamp in nanoseconds from the timing clock.
+ * Only differences between timestamps are meaningful.
+ */
+uint64
+now_ns(void)
+{
+	return ((*clock_fn)());
+}
+
 /*
  * Start timing now.
+ *
+ * Callers that pass their own timeval always get gettimeofday;
+ * the internal interval (tv == NULL) uses the timing clock.
  */
 void
 start(struct timeval *tv)
 {
-	if (tv == NULL) {
-		tv = &start_tv;
-	}
 #ifdef	RUSAGE
 	getrusage(RUSAGE_SELF, &ru_start);
 #endif
-	(void) gettimeofday(tv, (struct timezone *) 0);
+	if (tv != NULL) {
+		(void) gettimeofday(tv, (struct timezone *) 0);
+		return;
+	}
+	start_ns = now_ns();
 }
 
 /*
@@ -793,73 +2409,52 @@ start(struct timeval *tv)
 uint64
 stop(struct timeval *begin, struct timeval *end)
 {
-	if (end == NULL) {
-		end = &stop_tv;
+	if (begin != NULL && end != NULL) {
+		(void) gettimeofday(end, (struct timezone *) 0);
+#ifdef	RUSAGE
+		getrusage(RUSAGE_SELF, &ru_stop);
+#endif
+		return (tvdelta(begin, end));
 	}
-	(void) gettimeofday(end, (struct timezone *) 0);
+	stop_ns = now_ns();
 #ifdef	RUSAGE
 	getrusage(RUSAGE_SELF, &ru_stop);
 #endif
-
-	if (begin == NULL) {
-		begin = &start_tv;
-	}
-	return (tvdelta(begin, end));
+	if (end != NULL)
+		(void) gettimeofday(end, (struct timezone *) 0);
+	return (gettime_ns() / 1000);
 }
 
 uint64
 now(void)
 {
-	struct timeval t;
-	uint64	m;
-
-	(void) gettimeofday(&t, (struct timezone *) 0);
-	m = t.tv_sec;
-	m *= 1000000;
-	m += t.tv_usec;
-	return (m);
+	return (now_ns() / 1000);
 }
 
 double
 Now(void)
 {
-	struct timeval t;
-
-	(void) gettimeofday(&t, (struct timezone *) 0);
-	return (t.tv_sec * 1000000.0 + t.tv_usec);
+	return (now_ns() / 1000.0);
 }
 
 uint64
 delta(void)
 {
-	static struct timeval last;
-	struct timeval t;
-	struct timeval diff;
-	uint64	m;
+	static uint64 last;
+	uint64	t = now_ns();
+	uint64	m = 0;
 
-	(void) gettimeofday(&t, (struct timezone *) 0);
-	if (last.tv_usec) {
-		tvsub(&diff, &t, &last);
-		last = t;
-		m = diff.tv_sec;
-		m *= 1000000;
-		m += diff.tv_usec;
-		return (m);
-	} else {
-		last = t;
-		return (0);
+	if (last) {
+		m = (t - last) / 1000;
 	}
+	last = t;
+	return (m);
 }
 
 double
 Delta(void)
 {
-	struct timeval t;
-	struct timeval diff;
-
-	(void) gettimeofday(&t, (struct timezone *) 0);
-	tvsub(&diff, &t, &start_tv);
-	return (diff.tv_sec + diff.tv_usec / 1000000.0);
+	return ((now_ns() - start_ns) / 1000000000.0);
 }
 
 void
@@ -880,25 +2475,34 @@ get_n(void)
 void
 settime(uint64 usecs)
 {
-	bzero((void*)&start_tv, sizeof(start_tv));
-	stop_tv.tv_sec = usecs / 1000000;
-	stop_tv.tv_usec = usecs % 1000000;
+	settime_ns(usecs * 1000);
+}
+
+/*
+ * Make the time spend be nsecs.
+ */
+void
+settime_ns(uint64 nsecs)
+{
+	start_ns = 0;
+	stop_ns = nsecs;
 }
 
 void
 bandwidth(uint64 bytes, uint64 times, int verbose)
 {
-	struct timeval tdiff;
 	double  mb, secs;
 
-	tvsub(&tdiff, &stop_tv, &start_tv);
-	secs = tdiff.tv_sec;
-	secs *= 1000000;
-	secs += tdiff.tv_usec;
-	secs /= 1000000;
+	secs = timespent();
 	secs /= times;
 	mb = bytes / MB;
 	if (!ftiming) ftiming = stderr;
+	if (record_format()) {
+		char	params[64];
+
+		sprintf(params, "size=%.6f", mb);
+		record("bandwidth", params, mb/secs, "MB/sec");
+	}
 	if (verbose) {
 		(void) fprintf(ftiming,
 		    "%.4f MB in %.4f secs, %.4f MB/sec\n",
@@ -920,41 +2524,43 @@ bandwidth(uint64 bytes, uint64 times, int verbose)
 void
 kb(uint64 bytes)
 {
-	struct timeval td;
 	double  s, bs;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	s = td.tv_sec + td.tv_usec / 1000000.0;
+	s = timespent();
 	bs = bytes / nz(s);
 	if (s == 0.0) return;
 	if (!ftiming) ftiming = stderr;
 	(void) fprintf(ftiming, "%.0f KB/sec\n", bs / KB);
+	record("bandwidth", NULL, bs / KB, "KB/sec");
 }
 
 void
 mb(uint64 bytes)
 {
-	struct timeval td;
 	double  s, bs;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	s = td.tv_sec + td.tv_usec / 1000000.0;
+	s = timespent();
 	bs = bytes / nz(s);
 	if (s == 0.0) return;
 	if (!ftiming) ftiming = stderr;
 	(void) fprintf(ftiming, "%.2f MB/sec\n", bs / MB);
+	record("bandwidth", NULL, bs / MB, "MB/sec");
 }
 
 void
 latency(uint64 xfers, uint64 size)
 {
-	struct timeval td;
 	double  s;
 
 	if (!ftiming) ftiming = stderr;
-	tvsub(&td, &stop_tv, &start_tv);
-	s = td.tv_sec + td.tv_usec / 1000000.0;
+	s = timespent();
 	if (s == 0.0) return;
+	if (record_format()) {
+		char	params[64];
+
+		sprintf(params, "xfers=%d size=%d", (int)xfers, (int)size);
+		record("latency", params, s * 1000 / xfers, "milliseconds");
+	}
 	if (xfers > 1) {
 		fprintf(ftiming, "%d %dKB xfers in %.2f secs, ",
 		    (int) xfers, (int) (size / KB), s);
@@ -978,44 +2584,40 @@ latency(uint64 xfers, uint64 size)
 void
 context(uint64 xfers)
 {
-	struct timeval td;
 	double  s;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	s = td.tv_sec + td.tv_usec / 1000000.0;
+	s = timespent();
 	if (s == 0.0) return;
 	if (!ftiming) ftiming = stderr;
 	fprintf(ftiming,
 	    "%d context switches in %.2f secs, %.0f microsec/switch\n",
 	    (int)xfers, s, s * 1000000 / xfers);
+	record("context switch", NULL, s * 1000000 / xfers, "microseconds");
 }
 
 void
 nano(char *s, uint64 n)
 {
-	struct timeval td;
-	double  micro;
+	double  nsecs;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	micro = td.tv_sec * 1000000 + td.tv_usec;
-	micro *= 1000;
-	if (micro == 0.0) return;
+	nsecs = gettime_ns();
+	if (nsecs == 0.0) return;
 	if (!ftiming) ftiming = stderr;
-	fprintf(ftiming, "%s: %.2f nanoseconds\n", s, micro / n);
+	fprintf(ftiming, "%s: %.2f nanoseconds\n", s, nsecs / n);
+	record(s, NULL, nsecs / n, "nanoseconds");
 }
 
 void
 micro(char *s, uint64 n)
 {
-	struct timeval td;
 	double	micro;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	micro = td.tv_sec * 1000000 + td.tv_usec;
+	micro = gettime_ns() / 1000.;
 	micro /= n;
 	if (micro == 0.0) return;
 	if (!ftiming) ftiming = stderr;
 	fprintf(ftiming, "%s: %.4f microseconds\n", s, micro);
+	record(s, NULL, micro, "microseconds");
 #if 0
 	if (micro >= 100) {
 		fprintf(ftiming, "%s: %.1f microseconds\n", s, micro);
@@ -1030,11 +2632,9 @@ micro(char *s, uint64 n)
 void
 micromb(uint64 sz, uint64 n)
 {
-	struct timeval td;
 	double	mb, micro;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	micro = td.tv_sec * 1000000 + td.tv_usec;
+	micro = gettime_ns() / 1000.;
 	micro /= n;
 	mb = sz;
 	mb /= MB;
@@ -1045,35 +2645,39 @@ micromb(uint64 sz, uint64 n)
 	} else {
 		fprintf(ftiming, "%.6f %.3f\n", mb, micro);
 	}
+	if (record_format()) {
+		char	params[64];
+
+		sprintf(params, "size=%.6f", mb);
+		record("latency", params, micro, "microseconds");
+	}
 }
 
 void
 milli(char *s, uint64 n)
 {
-	struct timeval td;
 	uint64 milli;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	milli = td.tv_sec * 1000 + td.tv_usec / 1000;
+	milli = gettime_ns() / 1000000;
 	milli /= n;
 	if (milli == 0.0) return;
 	if (!ftiming) ftiming = stderr;
 	fprintf(ftiming, "%s: %d milliseconds\n", s, (int)milli);
+	record(s, NULL, (double)milli, "milliseconds");
 }
 
 void
 ptime(uint64 n)
 {
-	struct timeval td;
 	double  s;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	s = td.tv_sec + td.tv_usec / 1000000.0;
+	s = timespent();
 	if (s == 0.0) return;
 	if (!ftiming) ftiming = stderr;
 	fprintf(ftiming,
 	    "%d in %.2f secs, %.0f microseconds each\n",
 	    (int)n, s, s * 1000000 / n);
+	record("time", NULL, s * 1000000 / n, "microseconds");
 }
 
 uint64
@@ -1107,19 +2711,25 @@ tvsub(struct timeval * tdiff, struct timeval * t1, struct timeval * t0)
 	}
 }
 
+uint64
+gettime_ns(void)
+{
+	/* time shouldn't go backwards!!! */
+	if (stop_ns < start_ns)
+		return (0);
+	return (stop_ns - start_ns);
+}
+
 uint64
 gettime(void)
 {
-	return (tvdelta(&start_tv, &stop_tv));
+	return (gettime_ns() / 1000);
 }
 
 double
 timespent(void)
 {
-	struct timeval td;
-
-	tvsub(&td, &stop_tv, &start_tv);
-	return (td.tv_sec + td.tv_usec / 1000000.0);
+	return (gettime_ns() / 1000000000.0);
 }
 
 static	char	p64buf[10][20];
@@ -1242,7 +2852,7 @@ insertsort(uint64 u, uint64 n, result_t *r)
 }
 
 static result_t  _results;
-static result_t* results = &_results;
+static LMBENCH_TLS result_t* results = &_results;
 
 result_t*
 get_results()
@@ -1257,6 +2867,96 @@ set_results(result_t *r)
 	save_median();
 }
 
+static LMBENCH_TLS histogram_t* histogram = NULL;
+
+histogram_t*
+get_histogram()
+{
+	return (histogram);
+}
+
+void
+set_histogram(histogram_t *h)
+{
+	histogram = h;
+}
+
+void
+hist_init(histogram_t *h)
+{
+	bzero((void*)h, sizeof(*h));
+}
+
+static int
+hist_index(uint64 ns)
+{
+	int	e;
+
+	if (ns < HIST_SUB)
+		return ((int)ns);
+	for (e = HIST_SUB_BITS; (ns >> (e + 1)) != 0; ++e)
+		;
+	if (e > HIST_MAX_BITS)
+		return (HIST_BUCKETS - 1);
+	return ((e - HIST_SUB_BITS + 1) * HIST_SUB 
+		+ (int)((ns >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1)));
+}
+
+/* the middle of the range of values which land in bucket i */
+static uint64
+hist_value(int i)
+{
+	int	g = i / HIST_SUB;
+
+	if (g == 0)
+		return ((uint64)i);
+	return (((uint64)(HIST_SUB + i % HIST_SUB) << (g - 1))
+		+ (((uint64)1 << (g - 1)) >> 1));
+}
+
+void
+hist_insert(uint64 ns, histogram_t *h)
+{
+	if (h->count == 0 || ns < h->min) h->min = ns;
+	if (ns > h->max) h->max = ns;
+	h->bucket[hist_index(ns)]++;
+	h->count++;
+}
+
+void
+hist_merge(histogram_t *dst, histogram_t *src)
+{
+	int	i;
+
+	if (src->count == 0) return;
+	if (dst->count == 0 || src->min < dst->min) dst->min = src->min;
+	if (src->max > dst->max) dst->max = src->max;
+	for (i = 0; i < HIST_BUCKETS; ++i)
+		dst->bucket[i] += src->bucket[i];
+	dst->count += src->count;
+}
+
+/* p is a fraction, e.g. 0.999 for the 99.9th percentile */
+uint64
+hist_percentile(histogram_t *h, double p)
+{
+	int	i;
+	uint64	v, sum = 0;
+	uint64	rank = (uint64)(p * h->count + 0.999999);
+
+	if (h->count == 0) return (0);
+	if (rank < 1) rank = 1;
+	if (rank >= h->count) return (h->max);
+	for (i = 0; i < HIST_BUCKETS; ++i) {
+		sum += h->bucket[i];
+		if (sum >= rank) break;
+	}
+	v = hist_value(i);
+	if (v < h->min) v = h->min;
+	if (v > h->max) v = h->max;
+	return (v);
+}
+
 void
 save_minimum()
 {
@@ -1265,7 +2965,7 @@ save_minimum()
 		settime(0);
 	} else {
 		save_n(results->v[results->N - 1].n);
-		settime(results->v[results->N - 1].u);
+		settime_ns(results->v[results->N - 1].u);
 	}
 }
 
@@ -1288,7 +2988,7 @@ save_median()
 #ifdef _DEBUG
 	fprintf(stderr, "save_median: N=%d, n=%lu, u=%lu\n", results->N, (unsigned long)n, (unsigned long)u);
 #endif /* _DEBUG */
-	save_n(n); settime(u);
+	save_n(n); settime_ns(u);
 }
 
 /*
@@ -1326,17 +3026,19 @@ l_overhead(void)
 	initialized = 1;
 	if (getenv("LOOP_O")) {
 		overhead = atof(getenv("LOOP_O"));
+	} else if (cache_get("l_overhead", &overhead)) {
+		/* calibrated by an earlier run */
 	} else {
-		r_save = get_results(); N_save = get_n(); u_save = gettime(); 
+		r_save = get_results(); N_save = get_n(); u_save = gettime_ns(); 
 		insertinit(&one);
 		insertinit(&two);
 		for (i = 0; i < TRIES; ++i) {
 			use_pointer((void*)one_op(p));
-			if (gettime() > t_overhead())
-				insertsort(gettime() - t_overhead(), get_n(), &one);
+			if (gettime_ns() > t_overhead())
+				insertsort(gettime_ns() - t_overhead(), get_n(), &one);
 			use_pointer((void *)two_op(p));
-			if (gettime() > t_overhead())
-				insertsort(gettime() - t_overhead(), get_n(), &two);
+			if (gettime_ns() > t_overhead())
+				insertsort(gettime_ns() - t_overhead(), get_n(), &two);
 		}
 		/*
 		 * u1 = (n1 * (overhead + work))
@@ -1345,21 +3047,22 @@ l_overhead(void)
 		 */
 		set_results(&one); 
 		save_minimum();
-		overhead = 2. * gettime() / (double)get_n();
+		overhead = 2. * gettime_ns() / (1000. * (double)get_n());
 		
 		set_results(&two); 
 		save_minimum();
-		overhead -= gettime() / (double)get_n();
+		overhead -= gettime_ns() / (1000. * (double)get_n());
 		
 		if (overhead < 0.) overhead = 0.;	/* Gag */
 
-		set_results(r_save); save_n(N_save); settime(u_save); 
+		set_results(r_save); save_n(N_save); settime_ns(u_save); 
+		cache_put("l_overhead", overhead);
 	}
 	return (overhead);
 }
 
 /*
- * Figure out the timing overhead.  This has to track bench.h
+ * Figure out the timing overhead, in nanoseconds.  This has to track bench.h
  */
 uint64
 t_overhead(void)
@@ -1367,31 +3070,38 @@ t_overhead(void)
 	uint64		N_save, u_save;
 	static int	initialized = 0;
 	static uint64	overhead = 0;
-	struct timeval	tv;
+	double		cached;
+	char		*s;
 	result_t	*r_save;
 
 	init_timing();
 	if (initialized) return (overhead);
 
 	initialized = 1;
-	if (getenv("TIMING_O")) {
-		overhead = atof(getenv("TIMING_O"));
+	if ((s = getenv("TIMING_O_NS")) != NULL && *s) {
+		overhead = atof(s);
+	} else if ((s = getenv("TIMING_O")) != NULL && *s) {
+		/* the old name, in microseconds, from older CONFIG files */
+		overhead = 1000. * atof(s);
+	} else if (cache_get("t_overhead_ns", &cached)) {
+		overhead = (uint64)cached;
 	} else if (get_enough(0) <= 50000) {
 		/* it is not in the noise, so compute it */
 		int		i;
 		result_t	r;
 
-		r_save = get_results(); N_save = get_n(); u_save = gettime(); 
+		r_save = get_results(); N_save = get_n(); u_save = gettime_ns(); 
 		insertinit(&r);
 		for (i = 0; i < TRIES; ++i) {
-			BENCH_INNER(gettimeofday(&tv, 0), 0);
-			insertsort(gettime(), get_n(), &r);
+			BENCH_INNER(now_ns(), 0);
+			insertsort(gettime_ns(), get_n(), &r);
 		}
 		set_results(&r);
 		save_minimum();
-		overhead = gettime() / get_n();
+		overhead = gettime_ns() / get_n();
 
-		set_results(r_save); save_n(N_save); settime(u_save); 
+		set_results(r_save); save_n(N_save); settime_ns(u_save); 
+		cache_put("t_overhead_ns", (double)overhead);
 	}
 	return (overhead);
 }
@@ -1411,6 +3121,48 @@ get_enough(int e)
 	return (long_enough > e ? long_enough : e);
 }
 
+/*
+ * With LMBENCH_CACHE, the iteration counts that timing loops converge
+ * on are saved too, keyed by the loop (file and line, or which call
+ * of benchmp), enough and the command line, so that the next run can
+ * start from them rather than from one iteration.
+ */
+static char*
+iterations_key(char* file, int line, int enough)
+{
+	static char	key[1200];
+
+	snprintf(key, sizeof(key), "iterations %s:%d enough=%d %s",
+		 file, line, enough, record_cmdline());
+	return (key);
+}
+
+iter_t
+get_iterations(char* file, int line, int enough, iter_t n)
+{
+	double	cached;
+
+	if (cache_enabled()
+	    && cache_get(iterations_key(file, line, enough), &cached)
+	    && cached >= 1.)
+		return ((iter_t)cached);
+	return (n);
+}
+
+void
+save_iterations(char* file, int line, int enough, iter_t n)
+{
+	double	cached;
+	char	*key;
+
+	if (!cache_enabled()) return;
+	key = iterations_key(file, line, enough);
+	/* do not rewrite the cache for the usual jitter */
+	if (cache_get(key, &cached) && 0.9 * cached <= n && n <= 1.1 * cached)
+		return;
+	cache_put(key, (double)n);
+}
+
 
 static void
 init_timing(void)
@@ -1439,38 +3191,38 @@ enough_duration(register long N, register TYPE ** p)
 static uint64
 duration(long N)
 {
-	uint64	usecs;
 	TYPE   *x = (TYPE *)&x;
 	TYPE  **p = (TYPE **)&x;
 
 	start(0);
 	p = enough_duration(N, p);
-	usecs = stop(0, 0);
+	stop(0, 0);
 	use_pointer((void *)p);
-	return (usecs);
+	return (gettime_ns());
 }
 
 /*
- * find the minimum time that work "N" takes in "tries" tests
+ * find the minimum time (in nanoseconds) that work "N" takes 
+ * in "tries" tests
  */
 static uint64
 time_N(iter_t N)
 {
 	int     i;
-	uint64	usecs;
+	uint64	nsecs;
 	result_t r, *r_save;
 
 	r_save = get_results();
 	insertinit(&r);
 	for (i = 1; i < TRIES; ++i) {
-		usecs = duration(N);
-		insertsort(usecs, N, &r);
+		nsecs = duration(N);
+		insertsort(nsecs, N, &r);
 	}
 	set_results(&r);
 	save_minimum();
-	usecs = gettime();
+	nsecs = gettime_ns();
 	set_results(r_save);
-	return (usecs);
+	return (nsecs);
 }
 
 /*
@@ -1481,23 +3233,24 @@ find_N(int enough)
 {
 	int		tries;
 	static iter_t	N = 10000;
-	static uint64	usecs = 0;
+	static uint64	nsecs = 0;
+	double		nenough = 1000. * enough;
 
-	if (!usecs) usecs = time_N(N);
+	if (!nsecs) nsecs = time_N(N);
 
 	for (tries = 0; tries < 10; ++tries) {
-		if (0.98 * enough < usecs && usecs < 1.02 * enough)
+		if (0.98 * nenough < nsecs && nsecs < 1.02 * nenough)
 			return (N);
-		if (usecs < 1000)
+		if (nsecs < 1000000)
 			N *= 10;
 		else {
 			double  n = N;
 
-			n /= usecs;
-			n *= enough;
+			n /= nsecs;
+			n *= nenough;
 			N = n + 1;
 		}
-		usecs = time_N(N);
+		nsecs = time_N(N);
 	}
 	return (0);
 }
@@ -1511,7 +3264,7 @@ test_time(int enough)
 {
 	int     i;
 	iter_t	N;
-	uint64	usecs, expected, baseline, diff;
+	uint64	nsecs, expected, baseline, diff;
 
 	if ((N = find_N(enough)) == 0)
 		return (0);
@@ -1519,9 +3272,9 @@ test_time(int enough)
 	baseline = time_N(N);
 
 	for (i = 0; i < sizeof(test_points) / sizeof(double); ++i) {
-		usecs = time_N((int)((double) N * test_points[i]));
+		nsecs = time_N((int)((double) N * test_points[i]));
 		expected = (uint64)((double)baseline * test_points[i]);
-		diff = expected > usecs ? expected - usecs : usecs - expected;
+		diff = expected > nsecs ? expected - nsecs : nsecs - expected;
 		if (diff / (double)expected > 0.0025)
 			return (0);
 	}
@@ -1530,20 +3283,57 @@ test_time(int enough)
 
 
 /*
- * We want to find the smallest timing interval that has accurate timing
+ * The enough saved by an earlier run, if the work that took enough
+ * then still does, or 0.  This is much cheaper than test_time().
  */
-static int     possibilities[] = { 5000, 10000, 50000, 100000 };
+static int
+cached_enough()
+{
+	int	i;
+	double	enough, N;
+	uint64	nsecs, min = 0;
+
+	if (!cache_get("enough", &enough) || !cache_get("enough_N", &N)
+	    || enough <= 0. || N < 1.)
+		return (0);
+	for (i = 0; i < 3; ++i) {
+		nsecs = duration((long)N);
+		if (i == 0 || nsecs < min) min = nsecs;
+	}
+	if (min < 0.95 * 1000. * enough || 1.05 * 1000. * enough < min) {
+#ifdef _DEBUG
+		fprintf(stderr, "cached_enough: %d took %lluns\n", 
+			(int)enough, (unsigned long long)min);
+#endif
+		return (0);
+	}
+	return ((int)enough);
+}
+
+/*
+ * We want to find the smallest timing interval that has accurate timing.
+ * The shortest intervals are only worth trying with a nanosecond clock.
+ */
+static int     possibilities[] = { 1000, 2000, 5000, 10000, 50000, 100000 };
 static int
 compute_enough()
 {
-	int     i;
+	int     i = 0;
 
 	if (getenv("ENOUGH")) {
 		return (atoi(getenv("ENOUGH")));
 	}
-	for (i = 0; i < sizeof(possibilities) / sizeof(int); ++i) {
-		if (test_time(possibilities[i]))
+	if ((i = cached_enough()) > 0)
+		return (i);
+	i = 0;
+	if (strcmp(timing_clock(), "gettimeofday") == 0)
+		i = 2;
+	for (; i < sizeof(possibilities) / sizeof(int); ++i) {
+		if (test_time(possibilities[i])) {
+			cache_put("enough", (double)possibilities[i]);
+			cache_put("enough_N", (double)find_N(possibilities[i]));
 			return (possibilities[i]);
+		}
 	}
 
 	/* 
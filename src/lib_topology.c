@@ -0,0 +1,285 @@
+/*
+ * lib_topology.c - cache and page geometry from the system
+ *
+ * line, cache, tlb and par_mem find the cache line size and the cache
+ * geometry by timing alone, which is slow.  Most systems will tell us:
+ * Linux describes the caches of each processor in
+ * /sys/devices/system/cpu/cpu<N>/cache/index<M> and the huge page sizes
+ * in /sys/kernel/mm/hugepages, and on x86 the same cache parameters
+ * are available from CPUID (leaf 4 on Intel, 0x8000001D on AMD).
+ * The benchmarks use these as priors, to skip or narrow their
+ * searches, and to cross-check what they measure.
+ *
+ * Everything is optional: with no information the functions report
+ * no caches, a line size of 0 and only the base page size.
+ */
+#include "bench.h"
+
+#include <dirent.h>
+
+/* #define _DEBUG */
+
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__)
+#define	TOPOLOGY_CPUID
+#endif
+
+static topology_cache_t	topology[TOPOLOGY_MAXCACHES];
+static int		ntopology = -1;
+
+static int
+topology_read(char* path, char* buf, int len)
+{
+	int	fd, n;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return 0;
+	n = read(fd, buf, len - 1);
+	close(fd);
+	if (n <= 0)
+		return 0;
+	while (n > 0 && isspace(buf[n-1])) --n;
+	buf[n] = 0;
+	return 1;
+}
+
+/* count the processors in a list such as "0-3,8-11" */
+static int
+topology_count(char* s)
+{
+	int	lo, hi, n = 0;
+
+	while (*s && isdigit(*s)) {
+		lo = hi = strtol(s, &s, 10);
+		if (*s == '-')
+			hi = strtol(s + 1, &s, 10);
+		n += hi - lo + 1;
+		if (*s == ',') s++;
+	}
+	return n;
+}
+
+/* sizes such as "48K" are in binary units */
+static size_t
+topology_size(char* s)
+{
+	size_t	n = strtoul(s, &s, 10);
+
+	switch (*s) {
+	case 'K':	n <<= 10;	break;
+	case 'M':	n <<= 20;	break;
+	case 'G':	n <<= 30;	break;
+	}
+	return (n);
+}
+
+static int
+topology_sysfs(int cpu)
+{
+	int			i, n;
+	char			path[128], *file;
+	char			buf[1024];
+	topology_cache_t*	c;
+
+	for (i = 0, n = 0; n < TOPOLOGY_MAXCACHES; ++i) {
+		sprintf(path, "/sys/devices/system/cpu/cpu%d/cache/index%d/", cpu, i);
+		file = path + strlen(path);
+		strcpy(file, "type");
+		if (!topology_read(path, buf, sizeof(buf)))
+			break;
+		c = &topology[n];
+		bzero((void*)c, sizeof(*c));
+		if (!strcmp(buf, "Data")) c->type = TOPOLOGY_DATA;
+		else if (!strcmp(buf, "Instruction")) c->type = TOPOLOGY_INSTRUCTION;
+		else if (!strcmp(buf, "Unified")) c->type = TOPOLOGY_UNIFIED;
+		else continue;
+		strcpy(file, "level");
+		if (topology_read(path, buf, sizeof(buf)))
+			c->level = atoi(buf);
+		strcpy(file, "size");
+		if (topology_read(path, buf, sizeof(buf)))
+			c->size = topology_size(buf);
+		strcpy(file, "coherency_line_size");
+		if (topology_read(path, buf, sizeof(buf)))
+			c->line = atoi(buf);
+		strcpy(file, "ways_of_associativity");
+		if (topology_read(path, buf, sizeof(buf)))
+			c->ways = atoi(buf);
+		strcpy(file, "number_of_sets");
+		if (topology_read(path, buf, sizeof(buf)))
+			c->sets = atoi(buf);
+		strcpy(file, "shared_cpu_list");
+		if (topology_read(path, buf, sizeof(buf)))
+			c->shared = topology_count(buf);
+		if (c->level > 0 && c->size > 0)
+			n++;
+	}
+	return n;
+}
+
+#ifdef TOPOLOGY_CPUID
+static void
+topology_cpuid_regs(unsigned int leaf, unsigned int sub, unsigned int r[4])
+{
+	__asm__ __volatile__ ("cpuid"
+			      : "=a" (r[0]), "=b" (r[1]), "=c" (r[2]), "=d" (r[3])
+			      : "a" (leaf), "c" (sub));
+}
+
+/*
+ * Intel's deterministic cache parameters (leaf 4) and AMD's cache
+ * topology (leaf 0x8000001D) have the same layout.
+ */
+static int
+topology_cpuid()
+{
+	int			i, n;
+	unsigned int		r[4], leaf = 0;
+	char			vendor[13];
+	topology_cache_t*	c;
+
+	topology_cpuid_regs(0, 0, r);
+	bcopy((void*)&r[1], vendor, 4);
+	bcopy((void*)&r[3], vendor + 4, 4);
+	bcopy((void*)&r[2], vendor + 8, 4);
+	vendor[12] = 0;
+	if (!strcmp(vendor, "GenuineIntel") && r[0] >= 4) {
+		leaf = 4;
+	} else if (!strcmp(vendor, "AuthenticAMD") 
+		   || !strcmp(vendor, "HygonGenuine")) {
+		topology_cpuid_regs(0x80000000, 0, r);
+		if (r[0] >= 0x8000001D) {
+			topology_cpuid_regs(0x80000001, 0, r);
+			/* TopologyExtensions */
+			if (r[2] & (1 << 22)) leaf = 0x8000001D;
+		}
+	}
+	if (!leaf) return 0;
+
+	for (i = 0, n = 0; n < TOPOLOGY_MAXCACHES && i < 16; ++i) {
+		topology_cpuid_regs(leaf, i, r);
+		if ((r[0] & 0x1f) == 0)
+			break;
+		c = &topology[n++];
+		bzero((void*)c, sizeof(*c));
+		c->type = r[0] & 0x1f;	/* 1, 2, 3 as TOPOLOGY_* */
+		c->level = (r[0] >> 5) & 0x7;
+		c->shared = ((r[0] >> 14) & 0xfff) + 1;
+		c->line = (r[1] & 0xfff) + 1;
+		c->ways = ((r[1] >> 22) & 0x3ff) + 1;
+		c->sets = r[2] + 1;
+		c->size = (size_t)c->ways * (((r[1] >> 12) & 0x3ff) + 1)
+			* c->line * c->sets;
+		/* fully associative */
+		if (r[0] & (1 << 9)) c->ways = 0;
+	}
+	return n;
+}
+#endif /* TOPOLOGY_CPUID */
+
+static int
+topology_compare(const void* a, const void* b)
+{
+	topology_cache_t*	x = (topology_cache_t*)a;
+	topology_cache_t*	y = (topology_cache_t*)b;
+
+	if (x->level != y->level)
+		return (x->level - y->level);
+	return (x->type - y->type);
+}
+
+static void
+topology_load()
+{
+	int	cpu;
+#ifdef _DEBUG
+	int	i;
+#endif
+
+	if (ntopology >= 0) return;
+	ntopology = 0;
+
+	/* the caches of the processor we are running on */
+	if ((cpu = sched_cpu()) < 0)
+		cpu = 0;
+	ntopology = topology_sysfs(cpu);
+#ifdef TOPOLOGY_CPUID
+	if (ntopology == 0)
+		ntopology = topology_cpuid();
+#endif
+	qsort(topology, ntopology, sizeof(topology_cache_t), topology_compare);
+#ifdef _DEBUG
+	for (i = 0; i < ntopology; ++i) {
+		fprintf(stderr, "topology: L%d type=%d size=%lu line=%lu ways=%d sets=%d shared=%d\n", topology[i].level, topology[i].type, (unsigned long)topology[i].size, (unsigned long)topology[i].line, topology[i].ways, topology[i].sets, topology[i].shared);
+	}
+#endif /* _DEBUG */
+}
+
+/*
+ * The data and unified caches, from the smallest (L1) up,
+ * returning how many there are.
+ */
+int
+topology_caches(topology_cache_t* caches, int max)
+{
+	int	i, n;
+
+	topology_load();
+	for (i = 0, n = 0; i < ntopology && n < max; ++i) {
+		if (topology[i].type == TOPOLOGY_INSTRUCTION)
+			continue;
+		caches[n++] = topology[i];
+	}
+	return (n);
+}
+
+/* the data or unified cache at a level, or NULL */
+topology_cache_t*
+topology_cache(int level)
+{
+	int	i;
+
+	topology_load();
+	for (i = 0; i < ntopology; ++i) {
+		if (topology[i].level == level 
+		    && topology[i].type != TOPOLOGY_INSTRUCTION)
+			return (&topology[i]);
+	}
+	return (NULL);
+}
+
+/* the L1 data cache line size, or 0 if unknown */
+size_t
+topology_line(void)
+{
+	topology_cache_t*	c = topology_cache(1);
+
+	return (c ? c->line : 0);
+}
+
+/*
+ * The page sizes: the base page size first, then any huge page
+ * sizes, smallest first.  Returns how many there are.
+ */
+int
+topology_pagesizes(size_t* sizes, int max)
+{
+	int		i, n = 0;
+	unsigned long	kb;
+	DIR*		dir;
+	struct dirent*	d;
+
+	if (max <= 0) return (0);
+	sizes[n++] = getpagesize();
+	if ((dir = opendir("/sys/kernel/mm/hugepages")) == NULL)
+		return (n);
+	while ((d = readdir(dir)) != NULL && n < max) {
+		if (sscanf(d->d_name, "hugepages-%lukB", &kb) != 1)
+			continue;
+		/* insertion sort */
+		for (i = n++; i > 1 && sizes[i-1] > kb * 1024; --i)
+			sizes[i] = sizes[i-1];
+		sizes[i] = kb * 1024;
+	}
+	closedir(dir);
+	return (n);
+}
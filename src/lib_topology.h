@@ -0,0 +1,28 @@
+#ifndef _LIB_TOPOLOGY_H
+#define _LIB_TOPOLOGY_H
+
+/*
+ * Cache and page geometry reported by the system.  See lib_topology.c.
+ */
+#define	TOPOLOGY_DATA		1
+#define	TOPOLOGY_INSTRUCTION	2
+#define	TOPOLOGY_UNIFIED	3
+
+#define	TOPOLOGY_MAXCACHES	8
+
+typedef struct {
+	int	level;		/* 1, 2, 3, ... */
+	int	type;		/* TOPOLOGY_DATA, ... */
+	size_t	size;		/* bytes */
+	size_t	line;		/* bytes */
+	int	ways;		/* 0 if unknown */
+	int	sets;		/* 0 if unknown */
+	int	shared;		/* processors sharing it, 0 if unknown */
+} topology_cache_t;
+
+int	topology_caches(topology_cache_t* caches, int max);
+topology_cache_t* topology_cache(int level);
+size_t	topology_line(void);
+int	topology_pagesizes(size_t* sizes, int max);
+
+#endif /* _LIB_TOPOLOGY_H */
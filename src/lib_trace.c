@@ -0,0 +1,131 @@
+/*
+ * lib_trace.c - timeline of benchmp runs
+ *
+ * When LMBENCH_TRACE names a file, benchmp appends an event to it,
+ * in the Chrome trace-event JSON format (chrome://tracing, Perfetto),
+ * for every phase of every worker: its fork (or thread creation),
+ * initialize, warmup, each timing interval, histogram run, cooldown
+ * and cleanup, with the CPU it ran on.  Each benchmark process is a
+ * trace "process", named by its command line; the parent's benchmp
+ * calls are on track 0 and worker i is on track i+1.  This shows
+ * which worker of a parallel run started late, was descheduled or
+ * migrated.
+ *
+ * Workers write their own events, each with a single write(2) to
+ * the file opened O_APPEND, so they may be forked processes or
+ * threads.  The file is a JSON array without the closing ']', which
+ * the trace viewers accept, so that runs may keep appending to it.
+ */
+#include "bench.h"
+
+/* #define _DEBUG */
+
+static int	trace_fd = -2;
+static int	trace_pid = 0;		/* of the benchmark process */
+static int	trace_runs = 0;
+
+int
+trace_enabled(void)
+{
+	char		*s;
+	struct stat	sbuf;
+
+	if (trace_fd == -2) {
+		trace_fd = -1;
+		s = getenv("LMBENCH_TRACE");
+		if (s && *s) {
+			trace_fd = open(s, O_WRONLY|O_CREAT|O_APPEND, 0666);
+			if (trace_fd < 0)
+				perror(s);
+			else if (fstat(trace_fd, &sbuf) == 0 && sbuf.st_size == 0)
+				write(trace_fd, "[\n", 2);
+		}
+	}
+	return (trace_fd >= 0);
+}
+
+static void
+trace_write(char* buf, int len)
+{
+	if (len <= 0) return;
+	if (len > 1023) len = 1023;
+	write(trace_fd, buf, len);
+}
+
+/*
+ * Start a benchmp run in the calling process; returns its number.
+ * The first run also names the trace process.
+ */
+int
+trace_run(void)
+{
+	int	i, len;
+	char	buf[1024];
+	char	*s, *e;
+
+	if (!trace_enabled()) return (0);
+	if (trace_pid != getpid()) {
+		/* a benchmark forked by lmbench_mc, say, starts afresh */
+		trace_pid = getpid();
+		trace_runs = 0;
+		len = sprintf(buf, "{\"name\":\"process_name\",\"ph\":\"M\","
+			      "\"pid\":%d,\"args\":{\"name\":\"", trace_pid);
+		s = record_cmdline();
+		e = buf + sizeof(buf) - 16;
+		for (i = len; *s && buf + i < e; ++s) {
+			if (*s == '"' || *s == '\\') buf[i++] = '\\';
+			buf[i++] = (*s < ' ') ? ' ' : *s;
+		}
+		len = i + sprintf(buf + i, "\"}},\n");
+		trace_write(buf, len);
+		trace_worker(-1);
+	}
+	return (++trace_runs);
+}
+
+/* name the track of worker child, or of the parent if child < 0 */
+void
+trace_worker(int child)
+{
+	int	len;
+	char	buf[256];
+
+	if (!trace_enabled()) return;
+	if (child < 0) {
+		len = sprintf(buf, "{\"name\":\"thread_name\",\"ph\":\"M\","
+			      "\"pid\":%d,\"tid\":0,"
+			      "\"args\":{\"name\":\"benchmp\"}},\n",
+			      trace_pid);
+	} else {
+		len = sprintf(buf, "{\"name\":\"thread_name\",\"ph\":\"M\","
+			      "\"pid\":%d,\"tid\":%d,"
+			      "\"args\":{\"name\":\"worker %d\"}},\n",
+			      trace_pid, child + 1, child);
+	}
+	trace_write(buf, len);
+}
+
+/*
+ * Write a complete event from start to end (nanoseconds, now_ns())
+ * on the track of worker child, or of the parent if child < 0.
+ * args, if not NULL, are JSON members such as "\"cpu\":3".
+ */
+void
+trace_event(int child, char* name, uint64 start, uint64 end, char* args)
+{
+	int	len;
+	char	buf[1024];
+
+	if (!trace_enabled()) return;
+	if (end < start) end = start;
+	len = snprintf(buf, sizeof(buf), 
+		       "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+		       "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"os_pid\":%d%s%s}},\n",
+		       name, trace_pid, child + 1, 
+		       start / 1000., (end - start) / 1000.,
+		       (int)getpid(), args ? "," : "", args ? args : "");
+#ifdef _DEBUG
+	fprintf(stderr, "%s", buf);
+#endif
+	trace_write(buf, len);
+}
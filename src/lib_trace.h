@@ -0,0 +1,14 @@
+#ifndef _LIB_TRACE_H
+#define _LIB_TRACE_H
+
+/*
+ * Timeline of benchmp's workers in Chrome trace-event format,
+ * enabled with LMBENCH_TRACE.  See lib_trace.c.
+ */
+int	trace_enabled(void);
+int	trace_run(void);
+void	trace_worker(int child);
+void	trace_event(int child, char* name, uint64 start, uint64 end, 
+		    char* args);
+
+#endif /* _LIB_TRACE_H */
@@ -1,7 +1,10 @@
 /*
  * line.c - guess the cache line size
  *
- * usage: line
+ * usage: line [-m] [-v] [-W <warmup>] [-N <repetitions>] [-M len[K|M]]
+ *
+ * The line size the system reports (see lib_topology.c) is used
+ * unless there is none or -m asks for it to be measured.
  *
  * Copyright (c) 2000 Carl Staelin.
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
@@ -26,18 +29,23 @@ main(int ac, char **av)
 {
 	int	l;
 	int	verbose = 0;
+	int	measure = 0;
+	size_t	known = topology_line();
 	int	warmup = 0;
 	int	repetitions = (1000000 <= get_enough(0) ? 1 : TRIES);
 	int	c;
 	size_t	maxlen = 64 * 1024 * 1024;
 	struct mem_state state;
-	char   *usage = "[-v] [-W <warmup>] [-N <repetitions>][-M len[K|M]]\n";
+	char   *usage = "[-m] [-v] [-W <warmup>] [-N <repetitions>][-M len[K|M]]\n";
 
 	state.line = sizeof(char*);
 	state.pagesize = getpagesize();
 
-	while (( c = getopt(ac, av, "avM:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "amvM:W:N:")) != EOF) {
 		switch(c) {
+		case 'm':
+			measure = 1;
+			break;
 		case 'v':
 			verbose = 1;
 			break;
@@ -56,12 +64,22 @@ main(int ac, char **av)
 		}
 	}
 
-	if ((l = line_find(maxlen, warmup, repetitions, &state)) > 0) {
+	if (known > 0 && !measure) {
+		l = known;
+	} else {
+		l = line_find(maxlen, warmup, repetitions, &state);
+	}
+	if (l > 0) {
 		if (verbose) {
-			printf("cache line size: %d bytes\n", l);
+			printf("cache line size: %d bytes", l);
+			if (known > 0 && known != l)
+				printf(" (the system reports %lu)", 
+				       (unsigned long)known);
+			printf("\n");
 		} else {
 			printf("%d\n", l);
 		}
+		record("cache line size", NULL, (double)l, "bytes");
 	}
 
 	return (0);
@@ -0,0 +1,462 @@
+/*
+ * lmbench_mc.c - all the benchmarks in one binary
+ *
+ * usage: lmbench_mc benchmark [args ...]
+ *	  lmbench_mc -f suite
+ *	  lmbench_mc -m seconds [-b cpu%] [-n rounds] [-o output] -f suite
+ *	  lmbench_mc -l
+ *
+ * Like busybox, lmbench_mc runs the benchmark named by its first
+ * argument, or by the name it was invoked under, so it may be linked
+ * to bw_mem, lat_pipe and so on.  The Makefile compiles each
+ * benchmark with its main() renamed to <benchmark>_main and every
+ * other global symbol made local, so they link together.
+ *
+ * With -f, lmbench_mc reads a suite from the file (or - for stdin),
+ * one benchmark command line per line, with '#' comments.  Timing is
+ * calibrated once (see init_timing()) and each line then runs in a
+ * child forked from the calibrated process, so the children skip
+ * compute_enough(), t_overhead() and l_overhead() as well as the
+ * exec, while each benchmark still gets its own globals, getopt()
+ * state and exit().
+ *
+ * With -m, lmbench_mc monitors the host: it runs the suite every so
+ * many seconds, forever or for -n rounds, writing each result as a
+ * timestamped record (LMBENCH_RECORD, json unless set otherwise) to
+ * the file or unix:<path> socket given by -o (LMBENCH_RECORD_FILE).
+ * The suite should be a few cheap benchmarks, e.g. lat_syscall null,
+ * a short lat_mem_rd, bw_mem rd, lat_ctx 2 and lat_pipe, with a small
+ * ENOUGH.  The CPU the suite may use is capped
+ * at -b percent of one processor (default 1%), twice over: a round
+ * that used more than its share delays the next one until the
+ * average is back within the budget, and each benchmark is killed if
+ * it alone uses a round's share (or a second).  A benchmark runs in a
+ * process group of its own, and it is the CPU time of the whole group
+ * (its benchmp workers and their helpers too) which is watched, and
+ * the whole group which is killed, then or when the benchmark exits,
+ * so nothing it started is left behind.
+ *
+ * Distributed under the FSF GPL with additional restriction that
+ * results may published only if
+ * (1) the benchmark is unmodified, and
+ * (2) the version in the sccsid below is included in the report.
+ */
+char	*id = "$Id$\n";
+
+#include "bench.h"
+
+#include <dirent.h>
+
+#define	MC_MAXARGS	256
+
+/*
+ * Keep this in step with MC_BENCHMARKS in the Makefile.
+ */
+#define	MC_LIST(X)							\
+	X(bw_file_rd) X(bw_mem) X(bw_mmap_rd) X(bw_pipe) X(bw_tcp)	\
+	X(bw_unix) X(disk) X(enough) X(lat_connect) X(lat_ctx)		\
+	X(lat_fcntl) X(lat_fifo) X(lat_fs) X(lat_http) X(lat_mem_rd)	\
+	X(lat_mmap) X(lat_ops) X(lat_pagefault) X(lat_pipe) X(lat_proc)	\
+	X(lat_rpc) X(lat_select) X(lat_sem) X(lat_sig) X(lat_syscall)	\
+	X(lat_tcp) X(lat_udp) X(lat_unix) X(lat_unix_connect) X(line)	\
+	X(lmdd) X(lmhttp) X(loop_o) X(memsize) X(mhz) X(par_mem)	\
+	X(par_ops) X(stream) X(timing_o) X(tlb)
+
+#define	MC_DECLARE(name)	int name##_main(int ac, char **av);
+#define	MC_ENTRY(name)		{ #name, name##_main },
+
+MC_LIST(MC_DECLARE)
+
+typedef int (*mc_main)(int ac, char **av);
+
+static struct {
+	char	*name;
+	mc_main	main;
+} mc_benchmarks[] = {
+	MC_LIST(MC_ENTRY)
+	{ NULL, NULL }
+};
+
+mc_main	mc_lookup(char *name);
+char**	mc_load(FILE *f, int *n);
+int	mc_suite(char **lines, int n, char *file, int cpu);
+int	mc_monitor(int ac, char **av);
+int	mc_run(int ac, char **av);
+static void	mc_sleep(double seconds);
+
+int
+main(int ac, char **av)
+{
+	int	i;
+	char	*name;
+	FILE	*f;
+	mc_main	m;
+	int	n;
+	char	**lines;
+	char	*usage = "benchmark [args ...] | -f <suite> | -l\n"
+		"\t| -m <seconds> [-b <cpu%>] [-n <rounds>] [-o <file|unix:path>] -f <suite>\n";
+
+	/* invoked through a link named after a benchmark? */
+	name = strrchr(av[0], '/');
+	name = name ? name + 1 : av[0];
+	if ((m = mc_lookup(name)) != NULL)
+		return ((*m)(ac, av));
+
+	if (ac < 2)
+		lmbench_usage(ac, av, usage);
+
+	if (!strcmp(av[1], "-l")) {
+		for (i = 0; mc_benchmarks[i].name; ++i)
+			printf("%s\n", mc_benchmarks[i].name);
+		return (0);
+	}
+
+	if (!strcmp(av[1], "-f")) {
+		if (ac != 3) lmbench_usage(ac, av, usage);
+		if (!strcmp(av[2], "-")) {
+			f = stdin;
+		} else if (!(f = fopen(av[2], "r"))) {
+			perror(av[2]);
+			return (1);
+		}
+		lines = mc_load(f, &n);
+		if (f != stdin) fclose(f);
+		if (!lines) return (1);
+
+		/* calibrate once, every child inherits it */
+		get_enough(0);
+		return (mc_suite(lines, n, av[2], 0));
+	}
+
+	if (!strcmp(av[1], "-m")) {
+		if ((i = mc_monitor(ac, av)) < 0)
+			lmbench_usage(ac, av, usage);
+		return (i);
+	}
+
+	if (!mc_lookup(av[1])) {
+		fprintf(stderr, "lmbench_mc: unknown benchmark %s\n", av[1]);
+		lmbench_usage(ac, av, usage);
+	}
+	return (mc_run(ac - 1, av + 1));
+}
+
+mc_main
+mc_lookup(char *name)
+{
+	int	i;
+
+	for (i = 0; mc_benchmarks[i].name; ++i) {
+		if (!strcmp(name, mc_benchmarks[i].name))
+			return (mc_benchmarks[i].main);
+	}
+	return (NULL);
+}
+
+/*
+ * run one benchmark in this process, as if it had been exec'ed
+ */
+int
+mc_run(int ac, char **av)
+{
+	mc_main	m = mc_lookup(av[0]);
+
+	if (!m) {
+		fprintf(stderr, "lmbench_mc: unknown benchmark %s\n", av[0]);
+		return (1);
+	}
+	optind = 0;	/* reset getopt() */
+	record_args(ac, av);
+	return ((*m)(ac, av));
+}
+
+/*
+ * Read the whole suite first: a child's exit() may reposition
+ * the shared file offset under our stdio buffer.
+ */
+char**
+mc_load(FILE *f, int *n)
+{
+	int	max = 64;
+	char	buf[4096];
+	char	**lines;
+
+	*n = 0;
+	lines = (char**)malloc(max * sizeof(char*));
+	while (lines && fgets(buf, sizeof(buf), f)) {
+		if (*n == max) {
+			max *= 2;
+			lines = (char**)realloc(lines, max * sizeof(char*));
+			if (!lines) break;
+		}
+		if (!(lines[(*n)++] = strdup(buf))) {
+			lines = NULL;
+			break;
+		}
+	}
+	if (!lines) perror("malloc");
+	return (lines);
+}
+
+static pid_t	mc_group = 0;	/* of the benchmark running now */
+
+/*
+ * CPU seconds used by the live processes of process group pgid, and
+ * by the children they have reaped, from /proc (Linux); -1 if /proc
+ * cannot tell.
+ */
+static double
+mc_group_cpu(pid_t pgid)
+{
+	DIR	*d;
+	FILE	*f;
+	struct dirent	*e;
+	char	*s, path[64], buf[1024];
+	long	pgrp;
+	unsigned long long	utime, stime, cutime, cstime, ticks = 0;
+	static long	hz = 0;
+
+	if (!hz && (hz = sysconf(_SC_CLK_TCK)) <= 0) hz = 100;
+	if (!(d = opendir("/proc"))) return (-1.);
+	while ((e = readdir(d)) != NULL) {
+		if (e->d_name[0] < '0' || e->d_name[0] > '9') continue;
+		sprintf(path, "/proc/%.32s/stat", e->d_name);
+		if (!(f = fopen(path, "r"))) continue;
+		s = fgets(buf, sizeof(buf), f);
+		fclose(f);
+		/* the command name may hold anything, even ") " */
+		if (!s || !(s = strrchr(buf, ')'))) continue;
+		if (sscanf(s + 2, "%*c %*d %ld %*d %*d %*d %*u %*u %*u %*u %*u"
+			   " %llu %llu %llu %llu", &pgrp,
+			   &utime, &stime, &cutime, &cstime) != 5
+		    || pgrp != pgid)
+			continue;
+		ticks += utime + stime + cutime + cstime;
+	}
+	closedir(d);
+	return (ticks / (double)hz);
+}
+
+/* don't leave the benchmark running when we are stopped */
+static void
+mc_signal(int sig)
+{
+	if (mc_group > 0)
+		kill(-mc_group, SIGKILL);
+	signal(sig, SIG_DFL);
+	kill(getpid(), sig);
+}
+
+/*
+ * Run each line of the suite in a child of this, calibrated, process.
+ * A positive cpu kills a child's process group once the group has used
+ * that many seconds of CPU time.  A child which exits with a non-zero
+ * status or is killed by a signal is a failure.
+ */
+int
+mc_suite(char **lines, int n, char *file, int cpu)
+{
+	int	ac, i, status, over, failed = 0;
+	char	buf[4096];
+	char	*av[MC_MAXARGS + 1];
+	char	*s;
+	pid_t	pid;
+
+	for (i = 0; i < n; ++i) {
+		/* the suite may run again, so parse a copy */
+		strcpy(buf, lines[i]);
+		if ((s = strchr(buf, '#')) != NULL) *s = 0;
+		for (ac = 0, s = strtok(buf, " \t\n");
+		     s && ac < MC_MAXARGS; s = strtok(NULL, " \t\n"))
+			av[ac++] = s;
+		av[ac] = NULL;
+		if (ac == 0) continue;
+
+		if (!mc_lookup(av[0])) {
+			fprintf(stderr, "%s:%d: unknown benchmark %s\n",
+				file, i + 1, av[0]);
+			failed = 1;
+			continue;
+		}
+
+		fflush(stdout);
+		fflush(stderr);
+		switch (pid = fork()) {
+		case -1:
+			perror("fork");
+			return (1);
+		case 0:
+			setpgid(0, 0);
+			signal(SIGINT, SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+			exit(mc_run(ac, av));
+			/* NOTREACHED */
+		default:
+			/* either may run first */
+			setpgid(pid, pid);
+			mc_group = pid;
+			signal(SIGINT, mc_signal);
+			signal(SIGTERM, mc_signal);
+			break;
+		}
+
+		/* watch the group's CPU time while it runs */
+		over = 0;
+		for (;;) {
+			if (cpu <= 0) {
+				if (waitpid(pid, &status, 0) == pid) break;
+			} else if (waitpid(pid, &status, WNOHANG) == pid) {
+				break;
+			} else if (!over && mc_group_cpu(pid) > cpu) {
+				kill(-pid, SIGKILL);
+				over = 1;
+				continue;
+			} else {
+				mc_sleep(0.05);
+				continue;
+			}
+			if (errno != EINTR) {
+				perror("waitpid");
+				kill(-pid, SIGKILL);
+				mc_group = 0;
+				return (1);
+			}
+		}
+		/* and whatever it left behind */
+		kill(-pid, SIGKILL);
+		mc_group = 0;
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+
+		if (over) {
+			fprintf(stderr, "%s:%d: %s exceeded its %ds of CPU\n",
+				file, i + 1, av[0], cpu);
+			failed = 1;
+		} else if (WIFSIGNALED(status)) {
+			fprintf(stderr, "%s:%d: %s killed by signal %d\n",
+				file, i + 1, av[0], WTERMSIG(status));
+			failed = 1;
+		} else if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "%s:%d: %s failed, exit status %d\n",
+				file, i + 1, av[0], WEXITSTATUS(status));
+			failed = 1;
+		}
+	}
+	return (failed);
+}
+
+static double
+mc_cpu(void)
+{
+	struct rusage	self, children;
+
+	getrusage(RUSAGE_SELF, &self);
+	getrusage(RUSAGE_CHILDREN, &children);
+	return (self.ru_utime.tv_sec + self.ru_stime.tv_sec
+		+ children.ru_utime.tv_sec + children.ru_stime.tv_sec
+		+ (self.ru_utime.tv_usec + self.ru_stime.tv_usec
+		   + children.ru_utime.tv_usec + children.ru_stime.tv_usec)
+		/ 1000000.);
+}
+
+static double
+mc_now(void)
+{
+	struct timeval	tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1000000.);
+}
+
+static void
+mc_sleep(double seconds)
+{
+	struct timespec	ts, left;
+
+	ts.tv_sec = (time_t)seconds;
+	ts.tv_nsec = (long)((seconds - ts.tv_sec) * 1000000000.);
+	while (nanosleep(&ts, &left) < 0 && errno == EINTR)
+		ts = left;
+}
+
+/*
+ * lmbench_mc -m seconds [-b cpu%] [-n rounds] [-o output] -f suite
+ *
+ * Returns -1 on a usage error, else whether any round failed.
+ */
+int
+mc_monitor(int ac, char **av)
+{
+	int	c, n, cpu, round, rounds = 0, failed = 0;
+	double	period = 0., budget = 1., start, used, wait;
+	char	*file = NULL;
+	char	**lines;
+	FILE	*f;
+
+	optind = 0;	/* reset getopt() */
+	while ((c = getopt(ac, av, "m:b:n:o:f:")) != EOF) {
+		switch (c) {
+		case 'm':
+			period = atof(optarg);
+			break;
+		case 'b':
+			budget = atof(optarg);
+			break;
+		case 'n':
+			rounds = atoi(optarg);
+			break;
+		case 'o':
+			setenv("LMBENCH_RECORD_FILE", optarg, 1);
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		default:
+			return (-1);
+		}
+	}
+	if (optind < ac || !file || period <= 0. || budget <= 0.
+	    || budget > 100. || rounds < 0)
+		return (-1);
+	budget /= 100.;
+	if (!getenv("LMBENCH_RECORD"))
+		setenv("LMBENCH_RECORD", "json", 1);
+
+	if (!strcmp(file, "-")) {
+		f = stdin;
+	} else if (!(f = fopen(file, "r"))) {
+		perror(file);
+		return (1);
+	}
+	lines = mc_load(f, &n);
+	if (f != stdin) fclose(f);
+	if (!lines) return (1);
+
+	/* no one benchmark may take more than a round's share */
+	cpu = (int)(budget * period);
+	if (cpu < 1) cpu = 1;
+
+	get_enough(0);
+	for (round = 0; !rounds || round < rounds; ++round) {
+		start = mc_now();
+		used = mc_cpu();
+		failed |= mc_suite(lines, n, file, cpu);
+		used = mc_cpu() - used;
+		if (rounds && round == rounds - 1)
+			break;
+
+		/* stretch the period until we are back within budget */
+		wait = used / budget;
+		if (wait > period) {
+			fprintf(stderr, "lmbench_mc: round %d used %.2fs of "
+				"CPU, over its %.2fs, next round in %.0fs\n",
+				round, used, budget * period, wait);
+		} else {
+			wait = period;
+		}
+		wait -= mc_now() - start;
+		if (wait > 0.)
+			mc_sleep(wait);
+	}
+	return (failed);
+}
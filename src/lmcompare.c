@@ -0,0 +1,493 @@
+/*
+ * lmcompare.c - compare two sets of lmbench results
+ *
+ * usage: lmcompare [-t threshold] [-c confidence] [-a] [-v]
+ *		old [old ...] -- new [new ...]
+ *	  lmcompare [options] old new
+ *
+ * Each file may hold LMBENCH_RECORD output, JSON or CSV, or be one of
+ * the results/<os>/<host>.<n> files written by scripts/lmbench.  The
+ * results of each side are pooled by benchmark: a record contributes
+ * its per-repetition samples (ns per benchmp iteration), a results
+ * file one value per "Name: value units" line and per point of each
+ * data set, so several runs of scripts/lmbench give several samples.
+ *
+ * For every benchmark found on both sides lmcompare prints the old and
+ * new medians, their difference and its confidence interval, taking
+ * the standard error of each median from a bootstrap of its samples
+ * (see lib_stats.c).  A difference is significant when it lies outside
+ * the interval and is larger than the threshold (default 5%); at least
+ * two samples a side are needed to tell.  The exit status is 1 when
+ * any benchmark got significantly worse, so it can gate a build, and 2
+ * when it could not read a file or ran out of memory.
+ *
+ * This replaces the plain percentages of scripts/getpercent and
+ * scripts/opercent, which cannot tell a change from run to run noise.
+ *
+ * Distributed under the FSF GPL with additional restriction that
+ * results may published only if
+ * (1) the benchmark is unmodified, and
+ * (2) the version in the sccsid below is included in the report.
+ */
+char	*id = "$Id$\n";
+
+#include "bench.h"
+
+#define	CMP_LINE	(64 * 1024)
+#define	CMP_FIELD	4096
+
+typedef struct {
+	char	*key;
+	char	*units;
+	int	higher;		/* higher values are better */
+	int	n[2];
+	int	size[2];
+	double	*v[2];
+} cmp_t;
+
+static cmp_t	*cmps = NULL;
+static int	ncmps = 0;
+static int	verbose = 0;
+
+static void	cmp_file(char *file, int side);
+static void	cmp_json(char *line, int side);
+static void	cmp_csv(char *line, char **cols, int ncols, int side);
+static void	cmp_text(char *line, char *title, int side);
+static void	cmp_add(char *key, char *units, int higher, int side, double v);
+static int	cmp_report(double threshold, double z, int all);
+
+int
+main(int ac, char **av)
+{
+	int	c, i, side, regressed;
+	int	all = 0;
+	double	threshold = 5.;
+	double	confidence = 95.;
+	double	z = 1.960;
+	char	*usage = "[-t threshold%] [-c 90|95|99] [-a] [-v] old [old ...] -- new [new ...]\n";
+
+	while (( c = getopt(ac, av, "t:c:av")) != EOF) {
+		switch(c) {
+		case 't':
+			threshold = atof(optarg);
+			break;
+		case 'c':
+			confidence = atof(optarg);
+			break;
+		case 'a':
+			all = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			lmbench_usage(ac, av, usage);
+			break;
+		}
+	}
+	/* the two sided normal quantiles, the bootstrap is near normal */
+	if (confidence == 90.) {
+		z = 1.645;
+	} else if (confidence == 95.) {
+		z = 1.960;
+	} else if (confidence == 99.) {
+		z = 2.576;
+	} else {
+		lmbench_usage(ac, av, usage);
+	}
+
+	for (i = optind; i < ac && strcmp(av[i], "--"); ++i)
+		;
+	if (i == ac && ac - optind == 2) {
+		cmp_file(av[optind], 0);
+		cmp_file(av[optind + 1], 1);
+	} else if (i < ac && i > optind && i < ac - 1) {
+		for (side = 0, i = optind; i < ac; ++i) {
+			if (!strcmp(av[i], "--")) {
+				side = 1;
+				continue;
+			}
+			cmp_file(av[i], side);
+		}
+	} else {
+		lmbench_usage(ac, av, usage);
+	}
+
+	srand(1);	/* the same files give the same intervals */
+	regressed = cmp_report(threshold, z, all);
+	return (regressed ? 1 : 0);
+}
+
+/* copy a JSON string at p into buf, returning the end of it */
+static char*
+json_string(char *p, char *buf, int len)
+{
+	int	i = 0;
+
+	if (*p++ != '"') {
+		buf[0] = 0;
+		return (p - 1);
+	}
+	for (; *p && *p != '"'; ++p) {
+		if (*p == '\\' && p[1]) {
+			++p;
+			if (*p == 'u' && strlen(p) >= 5) {
+				/* record only escapes control characters */
+				if (i < len - 1) buf[i++] = ' ';
+				p += 4;
+				continue;
+			}
+		}
+		if (i < len - 1) buf[i++] = *p;
+	}
+	buf[i] = 0;
+	return (*p ? p + 1 : p);
+}
+
+/*
+ * The value of the top level field key of a record.  Inside a string
+ * every '"' is escaped, so ,"key": cannot match there.
+ */
+static char*
+json_field(char *line, char *key)
+{
+	char	*p;
+	char	pattern[64];
+
+	sprintf(pattern, "\"%s\":", key);
+	for (p = line; (p = strstr(p, pattern)) != NULL; ++p) {
+		if (p > line && (p[-1] == ',' || p[-1] == '{'))
+			return (p + strlen(pattern));
+	}
+	return (NULL);
+}
+
+/* split a CSV line in place, "" quotes a quote */
+static int
+csv_split(char *line, char **cols, int max)
+{
+	int	n = 0;
+	char	*p = line, *q;
+
+	while (n < max) {
+		if (*p == '"') {
+			cols[n++] = q = ++p;
+			for (; *p; ++p) {
+				if (*p == '"' && p[1] == '"') {
+					*q++ = '"';
+					++p;
+				} else if (*p == '"') {
+					++p;
+					break;
+				} else {
+					*q++ = *p;
+				}
+			}
+			*q = 0;
+			/* whatever follows the quote up to the comma */
+			while (*p && *p != ',') ++p;
+		} else {
+			cols[n++] = p;
+			while (*p && *p != ',' && *p != '\n') ++p;
+		}
+		if (*p != ',') {
+			*p = 0;
+			break;
+		}
+		*p++ = 0;
+	}
+	return (n);
+}
+
+static int
+csv_column(char **cols, int ncols, char *name)
+{
+	int	i;
+
+	for (i = 0; i < ncols; ++i)
+		if (!strcmp(cols[i], name)) return (i);
+	return (-1);
+}
+
+static void
+cmp_file(char *file, int side)
+{
+	FILE	*f;
+	char	*line = (char*)malloc(CMP_LINE);
+	char	*header = NULL;
+	char	*cols[32];
+	char	title[CMP_FIELD];
+	int	ncols = 0;
+
+	if (!line) {
+		perror("malloc");
+		exit(2);
+	}
+	if (!(f = fopen(file, "r"))) {
+		perror(file);
+		exit(2);
+	}
+	title[0] = 0;
+	while (fgets(line, CMP_LINE, f)) {
+		if (line[0] == '{') {
+			cmp_json(line, side);
+		} else if (!strncmp(line, "benchmark,name,params,", 22)) {
+			if (header) free(header);
+			header = strdup(line);
+			ncols = csv_split(header, cols, 32);
+		} else if (header) {
+			cmp_csv(line, cols, ncols, side);
+		} else if (line[0] == '"') {
+			/* the title of a data set, up to the blank line */
+			strncpy(title, line + 1, CMP_FIELD - 1);
+			title[CMP_FIELD - 1] = 0;
+			title[strcspn(title, "\r\n")] = 0;
+		} else if (line[0] == '\n') {
+			title[0] = 0;
+		} else {
+			cmp_text(line, title, side);
+		}
+	}
+	fclose(f);
+	if (header) free(header);
+	free(line);
+}
+
+/* a record's key: benchmark, name and params */
+static char*
+cmp_key(char *benchmark, char *name, char *params)
+{
+	static char	key[3 * CMP_FIELD];
+
+	sprintf(key, "%s %s", benchmark, name);
+	if (*params) sprintf(key + strlen(key), " %s", params);
+	return (key);
+}
+
+/* the units of a value: 1 if higher is better, 0 if lower, -1 unknown */
+static int
+cmp_units(char *units)
+{
+	char	*lower[] = { "nanoseconds", "microseconds", "milliseconds",
+			     "seconds", "ns", "us", "usecs", "ms", NULL };
+	char	*higher[] = { "MB/sec", "MB/s", "KB/sec", "GB/sec",
+			      "ops/sec", NULL };
+	int	i;
+
+	for (i = 0; lower[i]; ++i)
+		if (!strcmp(units, lower[i])) return (0);
+	for (i = 0; higher[i]; ++i)
+		if (!strcmp(units, higher[i])) return (1);
+	return (-1);
+}
+
+/* records that restate the samples of another, or are not times */
+static int
+cmp_skip(char *name)
+{
+	return (!strcmp(name, "fairness") || !strcmp(name, "fresh"));
+}
+
+static void
+cmp_json(char *line, int side)
+{
+	char	*p, *key;
+	char	benchmark[CMP_FIELD], name[CMP_FIELD], params[CMP_FIELD];
+	char	units[CMP_FIELD];
+	int	higher, samples = 0;
+	uint64	ns, n;
+
+	if (!(p = json_field(line, "benchmark"))) return;
+	json_string(p, benchmark, CMP_FIELD);
+	name[0] = params[0] = units[0] = 0;
+	if ((p = json_field(line, "name"))) json_string(p, name, CMP_FIELD);
+	if ((p = json_field(line, "params"))) json_string(p, params, CMP_FIELD);
+	if ((p = json_field(line, "units"))) json_string(p, units, CMP_FIELD);
+	if (cmp_skip(name)) return;
+	key = cmp_key(benchmark, name, params);
+
+	/* "samples":[{"ns":123,"n":10},...] */
+	if ((p = json_field(line, "samples")) && *p == '[') {
+		while ((p = strstr(p, "{\"ns\":"))) {
+			ns = strtoull(p + 6, &p, 10);
+			if (strncmp(p, ",\"n\":", 5)) break;
+			n = strtoull(p + 5, &p, 10);
+			if (n == 0) continue;
+			cmp_add(key, "ns", 0, side, (double)ns / (double)n);
+			++samples;
+		}
+	}
+	if (samples) return;
+	if ((higher = cmp_units(units)) < 0 || !(p = json_field(line, "value")))
+		return;
+	cmp_add(key, units, higher, side, atof(p));
+}
+
+static void
+cmp_csv(char *line, char **cols, int ncols, int side)
+{
+	char	*fields[32];
+	char	*p, *key;
+	int	n, i, higher, samples = 0;
+	int	benchmark, name, params, value, units, s;
+	double	ns, count;
+
+	n = csv_split(line, fields, 32);
+	benchmark = csv_column(cols, ncols, "benchmark");
+	name = csv_column(cols, ncols, "name");
+	params = csv_column(cols, ncols, "params");
+	value = csv_column(cols, ncols, "value");
+	units = csv_column(cols, ncols, "units");
+	s = csv_column(cols, ncols, "samples");
+	if (benchmark < 0 || name < 0 || params < 0 || value < 0
+	    || units < 0 || benchmark >= n || name >= n || params >= n
+	    || value >= n || units >= n)
+		return;
+	if (cmp_skip(fields[name])) return;
+	key = cmp_key(fields[benchmark], fields[name], fields[params]);
+
+	/* "ns/n ns/n ..." */
+	if (s >= 0 && s < n) {
+		for (p = fields[s]; *p; ) {
+			ns = strtod(p, &p);
+			if (*p != '/') break;
+			count = strtod(p + 1, &p);
+			if (count > 0.) {
+				cmp_add(key, "ns", 0, side, ns / count);
+				++samples;
+			}
+			while (*p == ' ') ++p;
+		}
+	}
+	if (samples) return;
+	if ((higher = cmp_units(fields[units])) < 0) return;
+	for (i = 0; fields[value][i] == ' '; ++i)
+		;
+	if (!fields[value][i]) return;
+	cmp_add(key, fields[units], higher, side, atof(fields[value]));
+}
+
+/*
+ * A line of a results file: "Name: value units", or a point "x y" of
+ * the data set titled title.  Data sets of bandwidths go up when they
+ * get better, the rest are latencies.
+ */
+static void
+cmp_text(char *line, char *title, int side)
+{
+	char	*p, *e, *key;
+	char	units[CMP_FIELD];
+	char	name[CMP_FIELD];
+	double	x, y;
+	int	higher;
+
+	line[strcspn(line, "\r\n")] = 0;
+	if (*title) {
+		x = strtod(line, &p);
+		if (p == line) return;
+		y = strtod(p, &e);
+		if (e == p) return;
+		higher = strstr(title, "bandwidth") || strstr(title, "bcopy")
+			|| strstr(title, "bzero");
+		sprintf(name, "%.*s", CMP_FIELD - 64, title);
+		key = cmp_key(name, "", "");
+		sprintf(key + strlen(key), "%.6g", x);
+		cmp_add(key, higher ? "MB/sec" : "", higher, side, y);
+		return;
+	}
+	if (line[0] == '[' || !(p = strrchr(line, ':'))) return;
+	*p++ = 0;
+	y = strtod(p, &e);
+	if (e == p || sscanf(e, "%4095s", units) != 1) return;
+	if ((higher = cmp_units(units)) < 0) return;
+	cmp_add(line, units, higher, side, y);
+}
+
+static void
+cmp_add(char *key, char *units, int higher, int side, double v)
+{
+	int	i;
+	cmp_t	*c;
+
+	for (i = 0; i < ncmps; ++i)
+		if (!strcmp(cmps[i].key, key)) break;
+	if (i == ncmps) {
+		cmps = (cmp_t*)realloc(cmps, (ncmps + 1) * sizeof(cmp_t));
+		if (!cmps) {
+			perror("realloc");
+			exit(2);
+		}
+		bzero((void*)&cmps[ncmps], sizeof(cmp_t));
+		cmps[ncmps].key = strdup(key);
+		cmps[ncmps].units = strdup(units);
+		cmps[ncmps].higher = higher;
+		++ncmps;
+	}
+	c = &cmps[i];
+	if (c->n[side] == c->size[side]) {
+		c->size[side] = c->size[side] ? 2 * c->size[side] : 16;
+		c->v[side] = (double*)realloc(c->v[side],
+					      c->size[side] * sizeof(double));
+		if (!c->v[side]) {
+			perror("realloc");
+			exit(2);
+		}
+	}
+	c->v[side][c->n[side]++] = v;
+}
+
+/*
+ * Print the comparison, returning the number of significant
+ * regressions.
+ */
+static int
+cmp_report(double threshold, double z, int all)
+{
+	int	i, side, regressions = 0, improvements = 0, unknown = 0;
+	int	matched = 0;
+	double	m[2], se[2], change, ci;
+	char	*verdict;
+	cmp_t	*c;
+
+	printf("%-48s %5s %11s %5s %11s %9s %9s\n", "benchmark",
+	       "n", "old", "n", "new", "change", "+/-");
+	for (i = 0; i < ncmps; ++i) {
+		c = &cmps[i];
+		if (!c->n[0] || !c->n[1]) {
+			if (verbose)
+				fprintf(stderr, "%s: only in the %s results\n",
+					c->key, c->n[0] ? "old" : "new");
+			continue;
+		}
+		++matched;
+		for (side = 0; side < 2; ++side) {
+			m[side] = double_median(c->v[side], c->n[side]);
+			se[side] = c->n[side] > 1 ?
+				double_bootstrap_stderr(c->v[side], c->n[side],
+							double_median) : 0.;
+		}
+		if (m[0] == 0.) continue;
+		change = 100. * (m[1] - m[0]) / m[0];
+		ci = 100. * z * sqrt(se[0] * se[0] + se[1] * se[1]) / m[0];
+		if (c->n[0] < 2 || c->n[1] < 2) {
+			verdict = "?";
+			++unknown;
+		} else if (ABS(change) <= ci || ABS(change) < threshold) {
+			verdict = "";
+		} else if ((change > 0.) == (c->higher != 0)) {
+			verdict = "better";
+			++improvements;
+		} else {
+			verdict = "WORSE";
+			++regressions;
+		}
+		if (!all && !*verdict) continue;
+		printf("%-48.48s %5d %11.4g %5d %11.4g %+8.2f%% %8.2f%% %s\n",
+		       c->key, c->n[0], m[0], c->n[1], m[1], change,
+		       ci, verdict);
+	}
+	printf("%d compared, %d worse, %d better, %d with too few samples "
+	       "(threshold %.3g%%, z=%.3g)\n",
+	       matched, regressions, improvements, unknown, threshold, z);
+	return (regressions);
+}
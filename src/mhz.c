@@ -376,7 +376,7 @@ compute_mhz(result_t *r)
 		for (subset = 0, ntests = 0; subset < (1<<NTESTS); ++subset) {
 			for (j = 0, n = 0; j < NTESTS; ++j)
 				if (BIT_SET(subset, j) && r[j].N > TRIES/2)
-					data[n++] = r[j].v[r[j].N-1-i].u / (double)r[j].v[r[j].N-1-i].n;
+					data[n++] = r[j].v[r[j].N-1-i].u / (1000. * r[j].v[r[j].N-1-i].n);
 			if (n < 2
 			    || (n = filter_data(data, n)) < 2
 			    ||classes(data, n) < 2) 
@@ -423,14 +423,15 @@ print_data(double mhz, result_t* data)
 	names[7] = name_8();
 	names[8] = name_9();
 
-	printf("/* \"%s\", \"%s\", \"%s\", %d, %.0f, %d, %f, %lu */\n", 
+	printf("/* \"%s\", \"%s\", \"%s\", %d, %.0f, %d, %f, %lu ns */\n", 
 	       CPU_name, uname, email, speed, 
 	       mhz, get_enough(0), l_overhead(), (unsigned long)t_overhead());
+	printf("/* times in nanoseconds */\n");
 	printf("result_t* data[] = { \n");
 	for (i = 0; i < NTESTS; ++i) {
 	    printf("\t/* %s */ { %d, {", names[i], data[i].N);
 	    for (j = 0; j < data[i].N; ++j) {
-		printf("\n\t\t{ /* %f */ %lu, %lu}", data[i].v[j].u / (100. * data[i].v[j].n), (unsigned long)data[i].v[j].u, (unsigned long)data[i].v[j].n);
+		printf("\n\t\t{ /* %f */ %lu, %lu}", data[i].v[j].u / (100000. * data[i].v[j].n), (unsigned long)data[i].v[j].u, (unsigned long)data[i].v[j].n);
 		if (j < TRIES - 1) printf(", ");
 	    }
 	    if (i < NTESTS - 1) printf("}},\n");
@@ -470,7 +471,7 @@ main(int ac, char **av)
 	    for (j = 0; j < TRIES; ++j) {
 		for (k = 0; k < NTESTS; ++k) {
 		    (*loops[k])(0);
-		    insertsort(gettime(), get_n(), &data[k]);
+		    insertsort(gettime_ns(), get_n(), &data[k]);
 		}
 	    }
 	    save_data(data, data_save);
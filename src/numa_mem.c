@@ -0,0 +1,275 @@
+/*
+ * numa_mem.c - NUMA memory latency and bandwidth matrix
+ *
+ * usage: numa_mem [-L <line size>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]
+ *
+ * For every node with processors and every node with memory, pin the
+ * benchmark to a processor of the first (sched_pin) and move its memory
+ * to the second (mbind), then measure the load latency with the pointer
+ * chase of lat_mem_rd and par_mem (mem_initialize and mem_benchmarks[]
+ * in lib_mem.c) and the read and copy bandwidth with bw_mem's frd and
+ * fcp, or the vector kernels that stand in for them (lib_bw.c).  Last,
+ * every processor we may run on reads its own node's memory at the
+ * same time, for the machine's aggregate bandwidth.
+ *
+ * Distributed under the FSF GPL with additional restriction that
+ * results may published only if
+ * (1) the benchmark is unmodified, and
+ * (2) the version in the sccsid below is included in the report.
+ */
+char	*id = "$Id$\n";
+
+#include "bench.h"
+
+#define	MAXNODES	64
+#define	MAXCPUS		4096
+
+typedef struct _state {
+	struct bw_state bw;	/* first, it is the bandwidth loops' cookie */
+	struct mem_state mem;	/* the pointer chase */
+	int	cpu;		/* sched_pin() processor, or -1 */
+	int	node;		/* memory node, or -1 */
+	int	aggregate;	/* from the worker's place in agg_cpus[] */
+} state_t;
+
+/* the aggregate's processors, node by node, and their memory nodes */
+static int	agg_cpus[MAXCPUS];
+static int	agg_nodes[MAXCPUS];
+static int	nagg = 0;
+
+void	lat_init(iter_t iterations, void* cookie);
+void	lat_loads(iter_t iterations, void* cookie);
+void	lat_cleanup(iter_t iterations, void* cookie);
+void	bw_init(iter_t iterations, void* cookie);
+void	matrix(char* title, double m[MAXNODES][MAXNODES],
+	       int* cpus, int ncpus, int* mems, int nmems);
+
+int
+main(int ac, char **av)
+{
+	int	c, i, j;
+	int	warmup = 0;
+	int	repetitions = -1;
+	int	cpus[MAXNODES], mems[MAXNODES];
+	int	ncpus, nmems;
+	size_t	len = 64 * 1024 * 1024;
+	double	lat[MAXNODES][MAXNODES];
+	double	rd[MAXNODES][MAXNODES];
+	double	cp[MAXNODES][MAXNODES];
+	double	bw;
+	char	buf[128];
+	state_t	state;
+	bw_kernel_t *k;
+	void	(*frd)(iter_t iterations, void *cookie);
+	void	(*fcp)(iter_t iterations, void *cookie);
+	char   *usage = "[-L <line size>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]\n";
+
+	bzero(&state, sizeof(state));
+	state.mem.line = getpagesize() / 16;
+	if (topology_line() > 0)
+		state.mem.line = topology_line();
+	state.mem.pagesize = getpagesize();
+
+	while (( c = getopt(ac, av, "L:M:W:N:")) != EOF) {
+		switch(c) {
+		case 'L':
+			state.mem.line = atoi(optarg);
+			if (state.mem.line < sizeof(char*))
+				state.mem.line = sizeof(char*);
+			break;
+		case 'M':
+			len = bytes(optarg);
+			break;
+		case 'W':
+			warmup = atoi(optarg);
+			break;
+		case 'N':
+			repetitions = atoi(optarg);
+			break;
+		default:
+			lmbench_usage(ac, av, usage);
+			break;
+		}
+	}
+	if (optind < ac) lmbench_usage(ac, av, usage);
+
+	/* whole pages, and whole steps of the bandwidth loops */
+	len -= len % state.mem.pagesize;
+	if (len < state.mem.pagesize) lmbench_usage(ac, av, usage);
+	state.mem.width = 1;
+	state.mem.len = state.mem.maxlen = len;
+	state.bw.nbytes = len;
+	benchmp_thread_cookie(sizeof(state));
+
+	k = bw_kernel("auto");
+	frd = k->rd ? k->rd : bw_frd;
+	fcp = k->cp ? k->cp : bw_fcp;
+
+	ncpus = sched_nodes(cpus, MAXNODES, 0);
+	nmems = sched_nodes(mems, MAXNODES, 1);
+
+	for (i = 0; i < ncpus; ++i) {
+		for (j = 0; j < nmems; ++j) {
+			state.cpu = sched_node_cpu(cpus[i]);
+			state.node = mems[j];
+			sprintf(buf, "cpu_node=%d mem_node=%d size=%.6f",
+				cpus[i], mems[j], len / (1000. * 1000.));
+
+			lat[i][j] = 0.;
+			benchmp(lat_init, lat_loads, lat_cleanup, 0, 1,
+				warmup, repetitions, &state);
+			if (gettime() > 0) {
+				lat[i][j] = gettime_ns() / (100. * get_n());
+				record("numa latency", buf, lat[i][j],
+				       "nanoseconds");
+			}
+
+			rd[i][j] = 0.;
+			benchmp(bw_init, frd, bw_cleanup, 0, 1,
+				warmup, repetitions, &state);
+			if (gettime() > 0) {
+				rd[i][j] = len * get_n() / timespent() / 1e6;
+				record("numa rd bandwidth", buf, rd[i][j],
+				       "MB/sec");
+			}
+
+			cp[i][j] = 0.;
+			state.bw.need_buf2 = 1;
+			benchmp(bw_init, fcp, bw_cleanup, 0, 1,
+				warmup, repetitions, &state);
+			state.bw.need_buf2 = 0;
+			if (gettime() > 0) {
+				cp[i][j] = len * get_n() / timespent() / 1e6;
+				record("numa cp bandwidth", buf, cp[i][j],
+				       "MB/sec");
+			}
+		}
+	}
+	matrix("NUMA load latency (ns)", lat, cpus, ncpus, mems, nmems);
+	matrix("NUMA rd bandwidth (MB/sec)", rd, cpus, ncpus, mems, nmems);
+	matrix("NUMA cp bandwidth (MB/sec)", cp, cpus, ncpus, mems, nmems);
+
+	/*
+	 * a worker on every processor we may run on, each reading its
+	 * own node's memory, or wherever the kernel puts it when the
+	 * node has none; we place them, not LMBENCH_SCHED
+	 */
+	for (i = 0; i < ncpus; ++i) {
+		c = sched_node_cpus(cpus[i], agg_cpus + nagg, MAXCPUS - nagg);
+		for (j = 0; j < nmems && mems[j] != cpus[i]; ++j)
+			;
+		while (c-- > 0)
+			agg_nodes[nagg++] = j < nmems ? cpus[i] : -1;
+	}
+	if (nagg == 0) {
+		agg_cpus[0] = -1;
+		agg_nodes[0] = -1;
+		nagg = 1;
+	}
+	setenv("LMBENCH_SCHED", "DEFAULT", 1);
+	state.aggregate = 1;
+	benchmp(bw_init, frd, bw_cleanup, 0, nagg,
+		warmup, repetitions, &state);
+	if (gettime() > 0) {
+		bw = (double)nagg * len * get_n() / timespent() / 1e6;
+		fprintf(stderr, "NUMA aggregate rd bandwidth (%d processor%s, %d node%s): %.2f MB/sec\n",
+			nagg, nagg > 1 ? "s" : "", ncpus, ncpus > 1 ? "s" : "",
+			bw);
+		sprintf(buf, "cpus=%d nodes=%d size=%.6f", nagg, ncpus,
+			len / (1000. * 1000.));
+		record("numa aggregate rd bandwidth", buf, bw, "MB/sec");
+	}
+
+	return (0);
+}
+
+/*
+ * Print m with a row for each processor node and a column for each
+ * memory node, or "-" where the measurement failed.
+ */
+void
+matrix(char* title, double m[MAXNODES][MAXNODES],
+       int* cpus, int ncpus, int* mems, int nmems)
+{
+	int	i, j;
+
+	fprintf(stderr, "\"%s: processor node by memory node\n", title);
+	fprintf(stderr, "node");
+	for (j = 0; j < nmems; ++j)
+		fprintf(stderr, "\t%d", mems[j]);
+	fprintf(stderr, "\n");
+	for (i = 0; i < ncpus; ++i) {
+		fprintf(stderr, "%d", cpus[i]);
+		for (j = 0; j < nmems; ++j) {
+			if (m[i][j] > 0.)
+				fprintf(stderr, "\t%.2f", m[i][j]);
+			else
+				fprintf(stderr, "\t-");
+		}
+		fprintf(stderr, "\n");
+	}
+	fprintf(stderr, "\n");
+}
+
+/* pin to state->cpu and move [p, p + len) to state->node, as asked */
+static void
+place(state_t* state, void* p, size_t len)
+{
+	if (state->cpu >= 0 && sched_pin(state->cpu) < 0)
+		exit(1);
+	if (state->node >= 0 && sched_mbind(p, len, state->node) < 0) {
+		fprintf(stderr, "numa_mem: cannot place memory on node %d\n",
+			state->node);
+		exit(1);
+	}
+}
+
+void
+lat_init(iter_t iterations, void* cookie)
+{
+	state_t* state = (state_t*)cookie;
+
+	if (iterations) return;
+
+	mem_initialize(iterations, &state->mem);
+	if (!state->mem.initialized) exit(1);
+	place(state, state->mem.addr,
+	      state->mem.maxlen + 2 * state->mem.pagesize);
+
+	/* run through the chain once, now that it has moved */
+	(*mem_benchmarks[0])((state->mem.len / sizeof(char*) + 100) / 100,
+			     &state->mem);
+}
+
+void
+lat_loads(iter_t iterations, void* cookie)
+{
+	state_t* state = (state_t*)cookie;
+
+	(*mem_benchmarks[0])(iterations, &state->mem);
+}
+
+void
+lat_cleanup(iter_t iterations, void* cookie)
+{
+	state_t* state = (state_t*)cookie;
+
+	mem_cleanup(iterations, &state->mem);
+}
+
+void
+bw_init(iter_t iterations, void* cookie)
+{
+	state_t* state = (state_t*)cookie;
+
+	if (iterations) return;
+
+	if (state->aggregate) {
+		state->cpu = agg_cpus[benchmp_childid() % nagg];
+		state->node = agg_nodes[benchmp_childid() % nagg];
+	}
+	bw_initialize(iterations, &state->bw);
+	place(state, state->bw.buf, state->bw.nbytes);
+	if (state->bw.buf2)
+		place(state, state->bw.buf2_orig, state->bw.nbytes + 2048);
+}
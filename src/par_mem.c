@@ -33,10 +33,13 @@ main(int ac, char **av)
 	size_t	i;
 	size_t	maxlen = 64 * 1024 * 1024;
 	double	par;
+	char	buf[64];
 	struct mem_state state;
 	char   *usage = "[-L <line size>] [-M len[K|M]] [-W <warmup>] [-N <repetitions>]\n";
 
 	state.line = getpagesize() / 16;
+	if (topology_line() > 0)
+		state.line = topology_line();
 	state.pagesize = getpagesize();
 
 	while (( c = getopt(ac, av, "L:M:W:N:")) != EOF) {
@@ -67,6 +70,8 @@ main(int ac, char **av)
 		if (par > 0.) {
 			fprintf(stderr, "%.6f %.2f\n", 
 				i / (1000. * 1000.), par);
+			sprintf(buf, "size=%.6f", i / (1000. * 1000.));
+			record("memory parallelism", buf, par, "loads");
 		}
 	}
 
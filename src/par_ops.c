@@ -400,83 +400,115 @@ main(int ac, char **av)
 
 	par = max_parallelism(integer_bit_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "integer bit parallelism: %.2f\n", par);
+		record("integer bit parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(integer_add_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "integer add parallelism: %.2f\n", par);
+		record("integer add parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(integer_mul_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "integer mul parallelism: %.2f\n", par);
+		record("integer mul parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(integer_div_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "integer div parallelism: %.2f\n", par);
+		record("integer div parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(integer_mod_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "integer mod parallelism: %.2f\n", par);
+		record("integer mod parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(int64_bit_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "int64 bit parallelism: %.2f\n", par);
+		record("int64 bit parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(int64_add_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "int64 add parallelism: %.2f\n", par);
+		record("int64 add parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(int64_mul_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "int64 mul parallelism: %.2f\n", par);
+		record("int64 mul parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(int64_div_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "int64 div parallelism: %.2f\n", par);
+		record("int64 div parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(int64_mod_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "int64 mod parallelism: %.2f\n", par);
+		record("int64 mod parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(float_add_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "float add parallelism: %.2f\n", par);
+		record("float add parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(float_mul_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "float mul parallelism: %.2f\n", par);
+		record("float mul parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(float_div_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "float div parallelism: %.2f\n", par);
+		record("float div parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(double_add_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "double add parallelism: %.2f\n", par);
+		record("double add parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(double_mul_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "double mul parallelism: %.2f\n", par);
+		record("double mul parallelism", NULL, par, "operations");
+	}
 
 	par = max_parallelism(double_div_benchmarks, 
 			      warmup, repetitions, &state);
-	if (par > 0.)
+	if (par > 0.) {
 		fprintf(stderr, "double div parallelism: %.2f\n", par);
+		record("double div parallelism", NULL, par, "operations");
+	}
 
 
 	return(0);
@@ -1,7 +1,12 @@
 /*
  * steam.c - lmbench version of John McCalpin's STREAM benchmark
  *
- * usage: stream
+ * usage: stream [-v <stream version 1|2>] [-n] [-M <len>[K|M]] [-P <parallelism>]
+ *	[-W <warmup>] [-N <repetitions>]
+ *
+ * -n also runs each kernel which writes with non-temporal stores (and
+ * fill by zeroing cache lines, where the ISA can), and reports how much
+ * bandwidth the read for ownership of the plain stores costs.
  *
  * Copyright (c) 2000 Carl Staelin.
  * Copyright (c) 1994 Larry McVoy.  Distributed under the FSF GPL with
@@ -20,6 +25,7 @@ struct _state {
 	double*	c;
 	double	scalar;
 	int	len;
+	size_t	zero;	/* bytes zeroed by MEM_ZERO_LINE */
 };
 
 void initialize(iter_t iterations, void* cookie);
@@ -38,6 +44,19 @@ void daxpy(iter_t iterations, void* cookie);
 void sum(iter_t iterations, void* cookie);
 
 
+/* These write with non-temporal stores, or zero cache lines (-n) */
+void copy_nt(iter_t iterations, void* cookie);
+void scale_nt(iter_t iterations, void* cookie);
+void add_nt(iter_t iterations, void* cookie);
+void triad_nt(iter_t iterations, void* cookie);
+void fill_nt(iter_t iterations, void* cookie);
+void daxpy_nt(iter_t iterations, void* cookie);
+void fill_zero(iter_t iterations, void* cookie);
+
+double	stream(char* name, char* variant, benchmp_f kernel, int words, 
+	       double bw, int parallel, int warmup, int repetitions, 
+	       struct _state* state);
+
 /*
  * Assumptions:
  *
@@ -52,24 +71,33 @@ main(int ac, char **av)
 	int	parallel = 1;
 	int	warmup = 0;
 	int	repetitions = -1;
+	int	nt = 0;
 	int	c;
-	uint64	datasize;
+	double	bw;
 	struct _state state;
 	char   *p;
-	char   *usage = "[-v <stream version 1|2>] [-M <len>[K|M]] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
+	char   *usage = "[-v <stream version 1|2>] [-n] [-M <len>[K|M]] [-P <parallelism>] [-W <warmup>] [-N <repetitions>]\n";
 
         state.len = 1000 * 1000 * 3 * sizeof(double);
 	state.scalar = 3.0;
+	state.zero = 0;
 
-	while (( c = getopt(ac, av, "v:M:P:W:N:")) != EOF) {
+	while (( c = getopt(ac, av, "v:nM:P:W:N:")) != EOF) {
 		switch(c) {
 		case 'v':
 			version = atoi(optarg);
 			if (version != 1 && version != 2) 
 				lmbench_usage(ac, av, usage);
 			break;
+		case 'n':
+#ifndef MEM_NT
+			fprintf(stderr, "stream: no non-temporal stores here\n");
+			exit(1);
+#endif
+			nt = 1;
+			break;
 		case 'P':
-			parallel = atoi(optarg);
+			parallel = benchmp_parallel(optarg);
 			if (parallel <= 0) lmbench_usage(ac, av, usage);
 			break;
 		case 'M':
@@ -94,83 +122,100 @@ main(int ac, char **av)
 		
 	/* convert from bytes to array length */
 	state.len /= 3 * sizeof(double);
-	datasize = sizeof(double) * state.len * parallel;
 
-	if (version == 1) {
-		benchmp(initialize, copy, cleanup, 
-			0, parallel, warmup, repetitions, &state);
-		if (gettime() > 0) {
-			if (parallel <= 1) save_minimum();
-			nano("STREAM copy latency", state.len * get_n());
-			fprintf(stderr, "STREAM copy bandwidth: ");
-			mb(2 * datasize * get_n());
-		}
+#define	STREAM(name, kernel, words)					\
+	stream(name, NULL, kernel, words, 0., 				\
+	       parallel, warmup, repetitions, &state)
+#define	STREAM_NT(name, kernel, words) do {				\
+	if (nt && bw > 0.) stream(name, "nt", kernel, words, bw,	\
+	       parallel, warmup, repetitions, &state);			\
+} while (0)
 
-		benchmp(initialize, scale, cleanup, 
-			0, parallel, warmup, repetitions, &state);
-		if (gettime() > 0) {
-			if (parallel <= 1) save_minimum();
-			nano("STREAM scale latency", state.len * get_n());
-			fprintf(stderr, "STREAM scale bandwidth: ");
-			mb(2 * datasize * get_n());
-		}
-
-		benchmp(initialize, add, cleanup, 
-			0, parallel, warmup, repetitions, &state);
-		if (gettime() > 0) {
-			if (parallel <= 1) save_minimum();
-			nano("STREAM add latency", state.len * get_n());
-			fprintf(stderr, "STREAM add bandwidth: ");
-			mb(3 * datasize * get_n());
-		}
-
-		benchmp(initialize, triad, cleanup, 
-			0, parallel, warmup, repetitions, &state);
-		if (gettime() > 0) {
-			if (parallel <= 1) save_minimum();
-			nano("STREAM triad latency", state.len * get_n());
-			fprintf(stderr, "STREAM triad bandwidth: ");
-			mb(3 * datasize * get_n());
-		}
+	if (version == 1) {
+		bw = STREAM("STREAM copy", copy, 2);
+		STREAM_NT("STREAM copy", copy_nt, 2);
+		bw = STREAM("STREAM scale", scale, 2);
+		STREAM_NT("STREAM scale", scale_nt, 2);
+		bw = STREAM("STREAM add", add, 3);
+		STREAM_NT("STREAM add", add_nt, 3);
+		bw = STREAM("STREAM triad", triad, 3);
+		STREAM_NT("STREAM triad", triad_nt, 3);
 	} else {
-		benchmp(initialize, fill, cleanup, 
-			0, parallel, warmup, repetitions, &state);
-		if (gettime() > 0) {
-			if (parallel <= 1) save_minimum();
-			nano("STREAM2 fill latency", state.len * get_n());
-			fprintf(stderr, "STREAM2 fill bandwidth: ");
-			mb(datasize * get_n());
-		}
+		bw = STREAM("STREAM2 fill", fill, 1);
+		STREAM_NT("STREAM2 fill", fill_nt, 1);
+#ifdef MEM_ZERO
+		if (nt && bw > 0. && (state.zero = mem_zero_size()))
+			stream("STREAM2 fill", "zero", fill_zero, 1, bw,
+			       parallel, warmup, repetitions, &state);
+#endif
+		bw = STREAM("STREAM2 copy", copy, 2);
+		STREAM_NT("STREAM2 copy", copy_nt, 2);
+		bw = STREAM("STREAM2 daxpy", daxpy, 3);
+		STREAM_NT("STREAM2 daxpy", daxpy_nt, 3);
+		STREAM("STREAM2 sum", sum, 1);
+	}
 
-		benchmp(initialize, copy, cleanup, 
-			0, parallel, warmup, repetitions, &state);
-		if (gettime() > 0) {
-			if (parallel <= 1) save_minimum();
-			nano("STREAM2 copy latency", state.len * get_n());
-			fprintf(stderr, "STREAM2 copy bandwidth: ");
-			mb(2 * datasize * get_n());
-		}
+	return(0);
+}
 
-		benchmp(initialize, daxpy, cleanup, 
-			0, parallel, warmup, repetitions, &state);
-		if (gettime() > 0) {
-			if (parallel <= 1) save_minimum();
-			nano("STREAM2 daxpy latency", state.len * get_n());
-			fprintf(stderr, "STREAM2 daxpy bandwidth: ");
-			mb(3 * datasize * get_n());
-		}
+/* the size of the last level cache, or 0 if the system does not say */
+static size_t
+stream_llc(void)
+{
+	int	level;
+	topology_cache_t	*c, *llc = NULL;
 
-		benchmp(initialize, sum, cleanup, 
-			0, parallel, warmup, repetitions, &state);
-		if (gettime() > 0) {
-			if (parallel <= 1) save_minimum();
-			nano("STREAM2 sum latency", state.len * get_n());
-			fprintf(stderr, "STREAM2 sum bandwidth: ");
-			mb(datasize * get_n());
-		}
+	for (level = 1; level <= TOPOLOGY_MAXCACHES; ++level) {
+		if ((c = topology_cache(level)) != NULL)
+			llc = c;
 	}
+	return (llc ? llc->size : 0);
+}
 
-	return(0);
+/*
+ * Time one kernel, which moves words doubles per element, and print
+ * its latency and bandwidth, which it returns in MB/sec.  A variant
+ * ("nt" or "zero") of a kernel whose plain bandwidth was bw also
+ * reports the write allocate penalty: the share of the bandwidth the
+ * plain kernel loses to reading the lines it is about to overwrite.
+ * That only means something when the arrays are in memory, not in
+ * the last level cache; when the cache size is unknown it is given
+ * as the relative difference between the two, and when the arrays fit
+ * it is left out.
+ */
+double
+stream(char* name, char* variant, benchmp_f kernel, int words, double bw,
+       int parallel, int warmup, int repetitions, struct _state* state)
+{
+	double	mbs;
+	uint64	datasize = sizeof(double) * state->len * parallel;
+	size_t	llc = stream_llc();
+	char	buf[256];
+
+	benchmp(initialize, kernel, cleanup, 
+		0, parallel, warmup, repetitions, state);
+	if (gettime() <= 0) return (0.);
+	if (parallel <= 1) save_minimum();
+
+	sprintf(buf, "%s%s%s", name, variant ? " " : "", variant ? variant : "");
+	sprintf(buf + strlen(buf), " latency");
+	nano(buf, state->len * get_n());
+	buf[strlen(buf) - strlen(" latency")] = 0;
+	fprintf(stderr, "%s bandwidth: ", buf);
+	mb(words * datasize * get_n());
+	mbs = words * datasize * get_n() / (timespent() * 1000000.);
+
+	if (variant && mbs > 0. && (!llc || 3 * datasize > llc)) {
+		if (llc) {
+			sprintf(buf, "%s write allocate penalty", name);
+		} else {
+			sprintf(buf, "%s %s relative difference", 
+				name, variant);
+		}
+		fprintf(stderr, "%s: %.1f%%\n", buf, 100. * (1. - bw / mbs));
+		record(buf, variant, 100. * (1. - bw / mbs), "percent");
+	}
+	return (mbs);
 }
 
 void
@@ -181,9 +226,9 @@ initialize(iter_t iterations, void* cookie)
 	
 	if (iterations) return;
 
-	state->a = (double*)malloc(sizeof(double) * state->len);
-	state->b = (double*)malloc(sizeof(double) * state->len);
-	state->c = (double*)malloc(sizeof(double) * state->len);
+	state->a = (double*)mem_pages_malloc(sizeof(double) * state->len);
+	state->b = (double*)mem_pages_malloc(sizeof(double) * state->len);
+	state->c = (double*)mem_pages_malloc(sizeof(double) * state->len);
 
 	if (state->a == NULL || state->b == NULL || state->c == NULL) {
 		exit(1);
@@ -279,6 +324,134 @@ daxpy(iter_t iterations, void *cookie)
 	}
 }
 
+/*
+ * The same kernels with non-temporal stores.  The arrays are only
+ * 8 byte aligned, so the first element may be stored plainly.
+ */
+#ifdef MEM_NT
+#define NTBODY(dst, E)							\
+{									\
+	register int i;							\
+	register int N = state->len;					\
+	register double* a = state->a;					\
+	register double* b = state->b;					\
+	register double* c = state->c;					\
+	register double scalar = state->scalar;				\
+									\
+	state->a = state->b;						\
+	state->b = state->c;						\
+	state->c = a;							\
+									\
+	for (i = 0; i < N && ((unsigned long)&dst[i] & 15); ++i)	\
+		dst[i] = E(i);						\
+	for (; i + 2 <= N; i += 2)					\
+		MEM_NT_STORE2(&dst[i], E(i), E(i + 1));			\
+	for (; i < N; ++i)						\
+		dst[i] = E(i);						\
+	MEM_NT_FENCE();							\
+	use_pointer(b);							\
+	use_pointer(c);							\
+}
+
+#define	COPY(i)		a[i]
+#define	SCALE(i)	(scalar * c[i])
+#define	ADD(i)		(a[i] + b[i])
+#define	TRIAD(i)	(b[i] + scalar * c[i])
+#define	FILL(i)		0.
+#define	DAXPY(i)	(a[i] + scalar * b[i])
+
+void
+copy_nt(iter_t iterations, void *cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+
+	while (iterations-- > 0) {
+		NTBODY(c, COPY)
+	}
+}
+
+void
+scale_nt(iter_t iterations, void *cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+
+	while (iterations-- > 0) {
+		NTBODY(b, SCALE)
+	}
+}
+
+void
+add_nt(iter_t iterations, void *cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+
+	while (iterations-- > 0) {
+		NTBODY(c, ADD)
+	}
+}
+
+void
+triad_nt(iter_t iterations, void *cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+
+	while (iterations-- > 0) {
+		NTBODY(a, TRIAD)
+	}
+}
+
+void
+fill_nt(iter_t iterations, void *cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+
+	while (iterations-- > 0) {
+		NTBODY(a, FILL)
+	}
+}
+
+void
+daxpy_nt(iter_t iterations, void *cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+
+	while (iterations-- > 0) {
+		NTBODY(a, DAXPY)
+	}
+}
+#endif /* MEM_NT */
+
+#ifdef MEM_ZERO
+/* fill a with zeros a cache line at a time, but for the ragged ends */
+void
+fill_zero(iter_t iterations, void *cookie)
+{
+	struct _state* state = (struct _state*)cookie;
+	size_t	z = state->zero;
+
+	while (iterations-- > 0) {
+		register int N = state->len;
+		register double* a = state->a;
+		register char *p, *end;
+		register int i;
+
+		state->a = state->b;
+		state->b = state->c;
+		state->c = a;
+
+		p = (char*)(((unsigned long)a + z - 1) & ~(unsigned long)(z - 1));
+		end = (char*)((unsigned long)(a + N) & ~(unsigned long)(z - 1));
+		for (i = 0; i < N && (char*)&a[i] < p; ++i)
+			a[i] = 0.;
+		for (; p + z <= end; p += z)
+			MEM_ZERO_LINE(p);
+		if ((char*)&a[i] < p) i = (p - (char*)a) / sizeof(double);
+		for (; i < N; ++i)
+			a[i] = 0.;
+	}
+}
+#endif /* MEM_ZERO */
+
 void
 sum(iter_t iterations, void *cookie)
 {
@@ -299,9 +472,9 @@ cleanup(iter_t iterations, void* cookie)
 
 	if (iterations) return;
 
-	free(state->a);
-	free(state->b);
-	free(state->c);
+	mem_pages_free(state->a);
+	mem_pages_free(state->b);
+	mem_pages_free(state->c);
 }
 
 
@@ -15,6 +15,7 @@ void	context(uint64 xfers);
 uint64	delta(void);
 int	get_enough(int);
 uint64	get_n(void);
+uint64	gettime_ns(void);
 void	kb(uint64 bytes);
 double	l_overhead(void);
 char	last(char *s);
@@ -26,15 +27,19 @@ void	milli(char *s, uint64 n);
 void	morefds(void);
 void	nano(char *s, uint64 n);
 uint64	now(void);
+uint64	now_ns(void);
 void	ptime(uint64 n);
 void	rusage(void);
 void	save_n(uint64);
 void	settime(uint64 usecs);
+void	settime_ns(uint64 nsecs);
 void	start(struct timeval *tv);
 uint64	stop(struct timeval *begin, struct timeval *end);
 uint64	t_overhead(void);
 double	timespent(void);
 void	timing(FILE *out);
+char	*timing_clock(void);
+double	timing_ns_per_cycle(void);
 uint64	tvdelta(struct timeval *, struct timeval *);
 void	tvsub(struct timeval *tdiff, struct timeval *t1, struct timeval *t0);
 void	use_int(int result);
@@ -44,6 +44,8 @@ main(int ac, char **av)
 	state.width = 1;
 	state.pagesize = getpagesize();
 	state.line = sizeof(char*);
+	if (topology_line() > 0)
+		state.line = topology_line();
 
 	tlb = 2;
 
@@ -78,9 +80,11 @@ main(int ac, char **av)
 		if (print_cost) {
 			compute_times(tlb * 2, warmup, repetitions, &tlb_time, &cache_time, &state);
 			fprintf(stderr, "tlb: %d pages %.5f nanoseconds\n", tlb, tlb_time - cache_time);
+			record("tlb miss", NULL, tlb_time - cache_time, "nanoseconds");
 		} else {
 			fprintf(stderr, "tlb: %d pages\n", tlb);
 		}
+		record("tlb", NULL, tlb, "pages");
 	}
 
 	/*
@@ -146,7 +150,7 @@ compute_times(int pages, int warmup, int repetitions,
 	if (state->initialized) {
 		for (i = 0; i < TRIES; ++i) {
 			BENCH1(mem_benchmark_0(__n, state); __n = 1;, 0);
-			insertsort(gettime(), get_n(), &tlb_results);
+			insertsort(gettime_ns(), get_n(), &tlb_results);
 		}
 	}
 	tlb_cleanup(0, state);
@@ -157,18 +161,18 @@ compute_times(int pages, int warmup, int repetitions,
 	if (state->initialized) {
 		for (i = 0; i < TRIES; ++i) {
 			BENCH1(mem_benchmark_0(__n, state); __n = 1;, 0);
-			insertsort(gettime(), get_n(), &cache_results);
+			insertsort(gettime_ns(), get_n(), &cache_results);
 		}
 	}
 	mem_cleanup(0, state);
 
 	/* We want nanoseconds / load. */
 	set_results(&tlb_results);
-	*tlb_time = (1000. * (double)gettime()) / (100. * (double)get_n());
+	*tlb_time = (double)gettime_ns() / (100. * (double)get_n());
 
 	/* We want nanoseconds / load. */
 	set_results(&cache_results);
-	*cache_time = (1000. * (double)gettime()) / (100. * (double)get_n());
+	*cache_time = (double)gettime_ns() / (100. * (double)get_n());
 	set_results(r_save);
 
 	/*